@@ -15,7 +15,7 @@ if [ ! -d "$LIBJPEG_TURBO_SRC" ]; then
 fi
 
 #copy patch files to source
-cp patch/* $LIBJPEG_TURBO_SRC
+cp -r patch/* $LIBJPEG_TURBO_SRC
 
 #create build folder
 mkdir $LIBJPEG_TURBO_BUILD
@@ -54,3 +54,18 @@ echo "build ThreadSafeTest"
 cd test/ThreadSafeTest
 ./build_aarch64.sh $LIBJPEG_TURBO_PATH
 cd ../../
+
+echo "build AsyncDecode"
+cd test/AsyncDecode
+./build_aarch64.sh $LIBJPEG_TURBO_PATH
+cd ../../
+
+echo "build TJBatchDecode"
+cd test/TJBatchDecode
+./build_aarch64.sh $LIBJPEG_TURBO_PATH
+cd ../../
+
+echo "build VC8000TraceDump"
+cd test/VC8000TraceDump
+./build_aarch64.sh $LIBJPEG_TURBO_PATH
+cd ../../
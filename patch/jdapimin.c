@@ -24,6 +24,13 @@
 #include "jpeglib.h"
 #include "jdmaster.h"
 #include "jconfigint.h"
+#ifdef WITH_VC8000
+#include <setjmp.h>
+#include <pthread.h>
+#include "jpeglib_ext.h"
+#include "vc8000_costmodel.h"
+#include "vc8000_trace.h"
+#endif
 
 
 /*
@@ -189,14 +196,252 @@ jpeg_CreateDecompress_Ext(j_decompress_ptr cinfo, int version, size_t structsize
   }
 }
 
+GLOBAL(int)
+jpeg_hw_get_node_count(void)
+{
+  return vc8000_backend()->get_node_count();
+}
+
+GLOBAL(int)
+jpeg_hw_get_node_stats(int node, jpeg_hw_node_stats *stats)
+{
+  struct vc8000_node_stats sNodeStats;
+
+  if(vc8000_backend()->get_node_stats(node, &sNodeStats) != 0)
+    return -1;
+
+  memset(stats, 0, sizeof(jpeg_hw_node_stats));
+  strncpy(stats->dev_name, sNodeStats.dev_name, sizeof(stats->dev_name) - 1);
+  stats->inflight = sNodeStats.inflight;
+  stats->max_inflight = sNodeStats.max_inflight;
+  stats->jobs_submitted = sNodeStats.jobs_submitted;
+  stats->jobs_done = sNodeStats.jobs_done;
+  stats->jobs_failed = sNodeStats.jobs_failed;
+  stats->jobs_timeout = sNodeStats.jobs_timeout;
+  stats->busy_ns = sNodeStats.busy_ns;
+
+  return 0;
+}
+
+/* Decode statistics of all images of process */
+static jpeg_decode_totals s_sDecodeTotals;
+static pthread_mutex_t s_tDecodeTotalsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Last image finished on this thread */
+static __thread jpeg_decode_stats s_sThreadDecodeStats;
+
+GLOBAL(void)
+jpeg_get_decode_stats(j_decompress_ptr cinfo, jpeg_decode_stats *stats)
+{
+  const uint64_t *pu64StageNs = cinfo->master->au64HWStageNs;
+
+  memset(stats, 0, sizeof(jpeg_decode_stats));
+  stats->engine = cinfo->master->i32HWStatsEngine;
+  stats->fallback = cinfo->master->i32HWFallback;
+  stats->fallback_code = cinfo->master->i32HWFallbackCode;
+  stats->open_ns = pu64StageNs[eJPEG_STAGE_OPEN];
+  stats->setup_ns = pu64StageNs[eJPEG_STAGE_SETUP];
+  stats->fill_ns = pu64StageNs[eJPEG_STAGE_FILL];
+  stats->hw_decode_ns = pu64StageNs[eJPEG_STAGE_HW_DECODE];
+  stats->convert_ns = pu64StageNs[eJPEG_STAGE_CONVERT];
+  stats->sw_decode_ns = pu64StageNs[eJPEG_STAGE_SW_DECODE];
+  stats->teardown_ns = pu64StageNs[eJPEG_STAGE_TEARDOWN];
+}
+
+GLOBAL(void)
+jpeg_get_decode_totals(jpeg_decode_totals *totals)
+{
+  pthread_mutex_lock(&s_tDecodeTotalsLock);
+  *totals = s_sDecodeTotals;
+  pthread_mutex_unlock(&s_tDecodeTotalsLock);
+}
+
+GLOBAL(void)
+jpeg_reset_decode_totals(void)
+{
+  pthread_mutex_lock(&s_tDecodeTotalsLock);
+  memset(&s_sDecodeTotals, 0, sizeof(s_sDecodeTotals));
+  pthread_mutex_unlock(&s_tDecodeTotalsLock);
+}
+
+GLOBAL(void)
+jpeg_get_thread_decode_stats(jpeg_decode_stats *stats)
+{
+  *stats = s_sThreadDecodeStats;
+}
+
+/* Add finished image to process totals */
+static void vc8000_account_decode(j_decompress_ptr cinfo)
+{
+  jpeg_decode_stats sStats;
+
+  if(!cinfo->master->bHWStatsOpen)
+    return;
+
+  cinfo->master->bHWStatsOpen = FALSE;
+  jpeg_get_decode_stats(cinfo, &sStats);
+  s_sThreadDecodeStats = sStats;
+
+  pthread_mutex_lock(&s_tDecodeTotalsLock);
+  s_sDecodeTotals.images++;
+  if(sStats.engine == JPEG_HW_ENGINE_HW)
+    s_sDecodeTotals.hw_images++;
+  else
+    s_sDecodeTotals.sw_images++;
+  if((sStats.fallback >= 0) && (sStats.fallback < JPEG_HW_NUM_FALLBACK))
+    s_sDecodeTotals.fallback[sStats.fallback]++;
+  s_sDecodeTotals.open_ns += sStats.open_ns;
+  s_sDecodeTotals.setup_ns += sStats.setup_ns;
+  s_sDecodeTotals.fill_ns += sStats.fill_ns;
+  s_sDecodeTotals.hw_decode_ns += sStats.hw_decode_ns;
+  s_sDecodeTotals.convert_ns += sStats.convert_ns;
+  s_sDecodeTotals.sw_decode_ns += sStats.sw_decode_ns;
+  s_sDecodeTotals.teardown_ns += sStats.teardown_ns;
+  pthread_mutex_unlock(&s_tDecodeTotalsLock);
+}
+
+GLOBAL(void)
+jpeg_hw_set_pipeline_depth(int depth)
+{
+  vc8000_backend()->set_pipeline_depth(depth);
+}
+
+GLOBAL(int)
+jpeg_hw_set_backend(const char *name)
+{
+  return vc8000_backend_select(name);
+}
+
+GLOBAL(void)
+jpeg_hw_set_deadline(j_decompress_ptr cinfo, unsigned int timeout_ms)
+{
+  cinfo->master->u32HWJpegDeadlineMs = timeout_ms;
+}
+
+GLOBAL(void)
+jpeg_hw_set_dispatch(int mode)
+{
+  vc8000_costmodel_set_dispatch((mode == JPEG_HW_DISPATCH_HW) ? eVC8000_DISPATCH_HW : eVC8000_DISPATCH_COST_MODEL);
+}
+
+GLOBAL(void)
+jpeg_hw_set_convert_threads(int threads, unsigned int min_pixels)
+{
+  vc8000_convert_set_threads(threads, min_pixels);
+}
+
+GLOBAL(int)
+jpeg_hw_export_cost_model(const char *path)
+{
+  return vc8000_costmodel_export(path);
+}
+
+GLOBAL(int)
+jpeg_hw_import_cost_model(const char *path)
+{
+  return vc8000_costmodel_import(path);
+}
+
+GLOBAL(int)
+jpeg_hw_trace_dump(const char *path)
+{
+#if defined (WITH_VC8000_TRACE)
+  return vc8000_trace_dump(path);
+#else
+  return -1;
+#endif
+}
+
+/* Error manager of calibration decode, errors return to vc8000_calib_decode() */
+struct vc8000_calib_error_mgr {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+};
+
+static void vc8000_calib_error_exit(j_common_ptr cinfo)
+{
+  struct vc8000_calib_error_mgr *err = (struct vc8000_calib_error_mgr *)cinfo->err;
+
+  longjmp(err->setjmp_buffer, 1);
+}
+
+static int vc8000_calib_decode(const unsigned char *jpeg_buf,
+                               unsigned long jpeg_size,
+                               J_COLOR_SPACE out_color_space,
+                               unsigned int scale_num,
+                               unsigned int scale_denom,
+                               E_VC8000_ENGINE eEngine)
+{
+  struct jpeg_decompress_struct sInfo;
+  struct vc8000_calib_error_mgr sErr;
+  JSAMPARRAY pRow;
+
+  memset(&sInfo, 0, sizeof(sInfo));
+  sInfo.err = jpeg_std_error(&sErr.pub);
+  sErr.pub.error_exit = vc8000_calib_error_exit;
+
+  if(setjmp(sErr.setjmp_buffer)) {
+    jpeg_destroy_decompress(&sInfo);
+    return -1;
+  }
+
+  jpeg_create_decompress(&sInfo);
+  jpeg_mem_src(&sInfo, jpeg_buf, jpeg_size);
+  jpeg_read_header(&sInfo, TRUE);
+
+  sInfo.out_color_space = out_color_space;
+  sInfo.scale_num = scale_num;
+  sInfo.scale_denom = scale_denom;
+  sInfo.master->i32HWForceEngine = eEngine;
+
+  jpeg_start_decompress(&sInfo);
+
+  pRow = (*sInfo.mem->alloc_sarray) ((j_common_ptr)&sInfo, JPOOL_IMAGE,
+                                     sInfo.output_width * sInfo.output_components, 1);
+  while (sInfo.output_scanline < sInfo.output_height)
+    jpeg_read_scanlines(&sInfo, pRow, 1);
+
+  jpeg_finish_decompress(&sInfo);
+  jpeg_destroy_decompress(&sInfo);
+  return 0;
+}
+
+GLOBAL(int)
+jpeg_hw_calibrate(const unsigned char *jpeg_buf, unsigned long jpeg_size,
+                  J_COLOR_SPACE out_color_space, unsigned int scale_num,
+                  unsigned int scale_denom, int runs)
+{
+  int i;
+
+  for(i = 0; i < runs; i++) {
+    if(vc8000_calib_decode(jpeg_buf, jpeg_size, out_color_space, scale_num, scale_denom, eVC8000_ENGINE_HW) != 0)
+      return -1;
+    if(vc8000_calib_decode(jpeg_buf, jpeg_size, out_color_space, scale_num, scale_denom, eVC8000_ENGINE_SW) != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
 static void vc8000_destroy_decompress(j_decompress_ptr cinfo)
 {
+  int i32DecBufIndex;
+
+  //job submitted by jpeg_start_decompress_async() must finish before release
+  if(cinfo->master->bHWJpegJobPending) {
+    vc8000_backend()->poll_decode_done(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot, &i32DecBufIndex);
+    cinfo->master->bHWJpegJobPending = FALSE;
+    cinfo->master->bHWJpegDecodeDone = TRUE;
+  }
+
   if(cinfo->master->bHWJpegDecodeDone)
-    vc8000_jpeg_release_decompress(&cinfo->master->sHWJpegVideo);
+    vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
 
-  //close vc8000 v4l2 device for JPEG decoder
+  //return vc8000 decode session to pool
   if(cinfo->master->bHWJpegCodecOpened)
-    vc8000_v4l2_close(&cinfo->master->sHWJpegVideo);
+    vc8000_backend()->close(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
+
+  cinfo->master->psHWJpegVideo = NULL;
 
   if(cinfo->master->pMemSrcBuf)
   {
@@ -218,6 +463,11 @@ static void vc8000_destroy_decompress(j_decompress_ptr cinfo)
 GLOBAL(void)
 jpeg_destroy_decompress(j_decompress_ptr cinfo)
 {
+#ifdef WITH_VC8000
+  //decode session (or slot of pipelined session) not returned by jpeg_finish_decompress()
+  if(cinfo->master && cinfo->master->bHWJpegCodecOpened)
+    vc8000_destroy_decompress(cinfo);
+#endif
   jpeg_destroy((j_common_ptr)cinfo); /* use common routine */
 }
 
@@ -549,12 +799,39 @@ jpeg_has_multiple_scans(j_decompress_ptr cinfo)
 #ifdef WITH_VC8000
 static boolean vc8000_finish_decompress(j_decompress_ptr cinfo)
 {
+  uint64_t u64StartNs;
+  uint64_t u64DecodeNs = 0;
+  int i;
+
+  if(cinfo->master->bHWJpegJobPending)
+    jpeg_decompress_wait(cinfo);
+
+  //whole image is read, feed its decode time to cost model
+  if((cinfo->master->i32HWCostEngine != eVC8000_ENGINE_NONE) &&
+     (cinfo->output_scanline >= cinfo->output_height)) {
+    for(i = 0; i < eJPEG_STAGE_TEARDOWN; i++)
+      u64DecodeNs += cinfo->master->au64HWStageNs[i];
+
+    vc8000_costmodel_record(cinfo->master->u32HWCostKey,
+                            (E_VC8000_ENGINE)cinfo->master->i32HWCostEngine,
+                            cinfo->image_width * cinfo->image_height,
+                            u64DecodeNs);
+  }
+
+  cinfo->master->i32HWCostEngine = eVC8000_ENGINE_NONE;
+
+  u64StartNs = vc8000_costmodel_time_ns();
+
   if(cinfo->master->bHWJpegDecodeDone) {
-    vc8000_jpeg_release_decompress(&cinfo->master->sHWJpegVideo);
+    vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
   }
 
   cinfo->master->bHWJpegDecodeDone = FALSE;
 
+  vc8000_destroy_decompress(cinfo);
+  cinfo->master->au64HWStageNs[eJPEG_STAGE_TEARDOWN] += vc8000_costmodel_time_ns() - u64StartNs;
+
+  vc8000_account_decode(cinfo);
   return TRUE;
 }
 
@@ -565,7 +842,6 @@ jpeg_finish_decompress(j_decompress_ptr cinfo)
 {
 #ifdef WITH_VC8000
   vc8000_finish_decompress(cinfo);
-  vc8000_destroy_decompress(cinfo);
 #endif
 
   if ((cinfo->global_state == DSTATE_SCANNING ||
@@ -25,6 +25,10 @@
 #include "jdmerge.h"
 #include "jdsample.h"
 #include "jmemsys.h"
+#ifdef WITH_VC8000
+#include "jpeglib_ext.h"
+#include "vc8000_costmodel.h"
+#endif
 
 /* Forward declarations */
 LOCAL(boolean) output_pass_setup(j_decompress_ptr cinfo);
@@ -49,13 +53,23 @@ typedef enum
 	eJPEG_SUBSAMPLING_422,
 	eJPEG_SUBSAMPLING_444,
 	eJPEG_SUBSAMPLING_UNKNOWN,
+	eJPEG_SUBSAMPLING_440,    /* appended, values are part of cost model keys */
+	eJPEG_SUBSAMPLING_400,    /* single component */
 }E_JPEG_SUBSAMPLING;
 
 static E_JPEG_SUBSAMPLING
 get_subsampling(j_decompress_ptr cinfo)
 {
+  if(cinfo->num_components == 1)
+    return eJPEG_SUBSAMPLING_400;
+
   if(cinfo->num_components != 3)
     return eJPEG_SUBSAMPLING_UNKNOWN;
+
+  //both chroma components must be full MCU samples
+  if((cinfo->comp_info[1].h_samp_factor != 1) || (cinfo->comp_info[1].v_samp_factor != 1) ||
+     (cinfo->comp_info[2].h_samp_factor != 1) || (cinfo->comp_info[2].v_samp_factor != 1))
+    return eJPEG_SUBSAMPLING_UNKNOWN;
     
   if((cinfo->comp_info[0].h_samp_factor == 2) && (cinfo->comp_info[0].v_samp_factor == 2))
     return eJPEG_SUBSAMPLING_420;
@@ -69,6 +83,9 @@ get_subsampling(j_decompress_ptr cinfo)
   if((cinfo->comp_info[0].h_samp_factor == 1) && (cinfo->comp_info[0].v_samp_factor == 1))
     return eJPEG_SUBSAMPLING_444;
 
+  if((cinfo->comp_info[0].h_samp_factor == 1) && (cinfo->comp_info[0].v_samp_factor == 2))
+    return eJPEG_SUBSAMPLING_440;
+
   return eJPEG_SUBSAMPLING_UNKNOWN;
 }
 
@@ -76,54 +93,71 @@ get_subsampling(j_decompress_ptr cinfo)
   ((dimension * scalingFactor_num + scalingFactor_denom - 1) / \
    scalingFactor_denom)
 
-static void vc8000_CreateDecompress(j_decompress_ptr cinfo)
+static void vc8000_CreateDecompress(j_decompress_ptr cinfo,
+                                    int pixel_format,
+                                    uint32_t u32CapWidth,
+                                    uint32_t u32CapHeight)
 {
-  //open vc8000 v4l2 device for JPEG decoder
-  if(vc8000_v4l2_open(&cinfo->master->sHWJpegVideo) == 0)
+  if(cinfo->master->bHWJpegCodecOpened)
+    return;
+
+  //get vc8000 decode session for JPEG decoder, output to mmapped buffer may share a pipelined session
+  if(vc8000_backend()->open(&cinfo->master->psHWJpegVideo,
+                            &cinfo->master->i32HWJpegSlot,
+                            !cinfo->master->bHWJpegDirectFBEnable && !cinfo->master->bHWJpegZeroCopy,
+                            pixel_format,
+                            u32CapWidth,
+                            u32CapHeight,
+                            VC8000_STREAM_BUF_SIZE(cinfo->image_width, cinfo->image_height)) == 0)
     cinfo->master->bHWJpegCodecOpened = TRUE;
   else
     cinfo->master->bHWJpegCodecOpened = FALSE;  
 }
 
 #include <stdlib.h>
-#include <sys/time.h>
 #include <limits.h>
 
-static double getTimeSec(void)
+/* Add time since u64StartNs to stage of current image, return now */
+static uint64_t vc8000_stage_add(j_decompress_ptr cinfo,
+                                 E_JPEG_STAGE eStage,
+                                 uint64_t u64StartNs)
 {
-  struct timeval tv;
+  uint64_t u64Now = vc8000_costmodel_time_ns();
 
-  if (gettimeofday(&tv, NULL) < 0)
-	return 0.0;
-  else 
-	return (double)(tv.tv_sec ) + ((double)(tv.tv_usec / 1000000.));
+  cinfo->master->au64HWStageNs[eStage] += u64Now - u64StartNs;
+  return u64Now;
 }
 
-
-static int vc8000_start_decompress(j_decompress_ptr cinfo)
+/*
+ * Decide from header and output parameters whether VC8000 can decode the
+ * image.  Nothing in cinfo is modified and the device is not touched.
+ * Returns 0 and fills capture format/size if decodable, else -1 to -4.
+ */
+static int vc8000_check_decode(j_decompress_ptr cinfo,
+                               int *p_pixel_format,
+                               uint32_t *p_out_width,
+                               uint32_t *p_out_height)
 {
   int pixel_format;
-  int i32Ret;
 
-  cinfo->master->bHWJpegDecodeDone = FALSE;
-
-  if(cinfo->out_color_space == JCS_EXT_BGRA)
-  {
-    pixel_format = V4L2_PIX_FMT_ABGR32;
-  }
-  else if(cinfo->out_color_space == JCS_EXT_ARGB)
+  //raw data skips color conversion, out_color_space does not matter
+  if(cinfo->raw_data_out)
   {
-    pixel_format = V4L2_PIX_FMT_ABGR32;
-  }
-  else if(cinfo->out_color_space == JCS_EXT_BGR)
-  {
-    pixel_format = V4L2_PIX_FMT_ABGR32;
-  }
-  else if(cinfo->out_color_space == JCS_RGB)
-  {
-    pixel_format = V4L2_PIX_FMT_ABGR32;
+    E_JPEG_SUBSAMPLING eSubsampling = get_subsampling(cinfo);
+    if((eSubsampling == eJPEG_SUBSAMPLING_420) || (eSubsampling == eJPEG_SUBSAMPLING_400))
+      pixel_format = V4L2_PIX_FMT_NV12;  //Planar format
+    else if(eSubsampling == eJPEG_SUBSAMPLING_422)
+      pixel_format = V4L2_PIX_FMT_YUYV;  //packet format
+    else if((eSubsampling == eJPEG_SUBSAMPLING_444) &&
+            vc8000_backend()->capture_format_supported(V4L2_PIX_FMT_NV24))
+      pixel_format = V4L2_PIX_FMT_NV24;  //full chroma
+    //raw data must be the component samples: no capture format has 4:1:1/4:4:0 chroma
+    else
+      return -1;    
   }
-  else if(cinfo->out_color_space == JCS_EXT_RGB)
+  //every RGB layout comes from ABGR32, vc8000_convert_select() swizzles the rows
+  else if((cinfo->out_color_space == JCS_RGB) ||
+          ((cinfo->out_color_space >= JCS_EXT_RGB) && (cinfo->out_color_space <= JCS_EXT_ARGB)))
   {
     pixel_format = V4L2_PIX_FMT_ABGR32;
   }
@@ -131,15 +165,10 @@ static int vc8000_start_decompress(j_decompress_ptr cinfo)
   {
     pixel_format = V4L2_PIX_FMT_RGB565;
   }
-  else if(cinfo->raw_data_out)
+  else if((cinfo->out_color_space == JCS_GRAYSCALE) && !cinfo->master->bHWJpegDirectFBEnable &&
+          ((cinfo->num_components == 1) || (cinfo->jpeg_color_space == JCS_YCbCr)))
   {
-    E_JPEG_SUBSAMPLING eSubsampling = get_subsampling(cinfo);
-    if(eSubsampling == eJPEG_SUBSAMPLING_420)
-      pixel_format = V4L2_PIX_FMT_NV12;  //Planar format
-    else if(eSubsampling == eJPEG_SUBSAMPLING_422)
-      pixel_format = V4L2_PIX_FMT_YUYV;  //packet format
-    else
-      return -1;    
+    pixel_format = V4L2_PIX_FMT_NV12;  //Y plane is the grayscale image
   }
 //  else if(cinfo->out_color_space == JCS_YCbCr)
 //  {
@@ -148,12 +177,11 @@ static int vc8000_start_decompress(j_decompress_ptr cinfo)
   else 
 	return -2;
 
-  jpeg_calc_output_dimensions(cinfo);
-
   uint32_t decode_src_width;
   uint32_t decode_src_height;
   uint32_t estimate_output_width;
   uint32_t estimate_output_height;
+  int iRotOP = PP_ROTATION_NONE;
   
   //Align to VC8000 MCU dimension (16x16)
   decode_src_width = jdiv_round_up(cinfo->image_width, 16) * 16;
@@ -162,16 +190,8 @@ static int vc8000_start_decompress(j_decompress_ptr cinfo)
   estimate_output_width = SCALED(decode_src_width, cinfo->scale_num, cinfo->scale_denom);  
   estimate_output_height = SCALED(decode_src_height, cinfo->scale_num, cinfo->scale_denom);  
   
-  struct video_fb_info sFBInfo;
-  int iRotOP = PP_ROTATION_NONE;
-
-  sFBInfo.frame_buf_no = UINT_MAX;
-  
   if(cinfo->master->bHWJpegDirectFBEnable)
   {
-	sFBInfo.frame_buf_w = cinfo->master->sDirectFBParam.fb_width;
-	sFBInfo.frame_buf_h = cinfo->master->sDirectFBParam.fb_height;
-	sFBInfo.frame_buf_no = cinfo->master->sDirectFBParam.fb_no;
 	estimate_output_width = cinfo->master->sDirectFBParam.img_width;
 	estimate_output_height = cinfo->master->sDirectFBParam.img_height;	
 	iRotOP = cinfo->master->sDirectFBParam.rotation_op;
@@ -199,9 +219,75 @@ static int vc8000_start_decompress(j_decompress_ptr cinfo)
 	return -4;
   }
 
-  double dStartTime = getTimeSec();
-  i32Ret = vc8000_jpeg_prepare_decompress(
-			&cinfo->master->sHWJpegVideo,
+  *p_pixel_format = pixel_format;
+  *p_out_width = estimate_output_width;
+  *p_out_height = estimate_output_height;
+  return 0;
+}
+
+static int vc8000_start_decompress(j_decompress_ptr cinfo)
+{
+  int pixel_format;
+  int i32Ret;
+  uint32_t estimate_output_width;
+  uint32_t estimate_output_height;
+
+  cinfo->master->bHWJpegDecodeDone = FALSE;
+  cinfo->master->bHWJpegJobPending = FALSE;
+  cinfo->master->u32HWCropX = 0;
+
+  i32Ret = vc8000_check_decode(cinfo, &pixel_format, &estimate_output_width, &estimate_output_height);
+  if(i32Ret != 0)
+    return i32Ret;
+
+  jpeg_calc_output_dimensions(cinfo);
+
+  struct video_fb_info sFBInfo;
+  int iRotOP = PP_ROTATION_NONE;
+
+  sFBInfo.frame_buf_no = UINT_MAX;
+  
+  if(cinfo->master->bHWJpegDirectFBEnable)
+  {
+	sFBInfo.frame_buf_w = cinfo->master->sDirectFBParam.fb_width;
+	sFBInfo.frame_buf_h = cinfo->master->sDirectFBParam.fb_height;
+	sFBInfo.frame_buf_no = cinfo->master->sDirectFBParam.fb_no;
+	iRotOP = cinfo->master->sDirectFBParam.rotation_op;
+  }
+
+  //zero-copy: native output layout is decoded straight into caller buffer
+  int cap_memory = V4L2_MEMORY_MMAP;
+  uint32_t u32CapPixelSize = (pixel_format == V4L2_PIX_FMT_RGB565) ? 2 : 4;
+
+  cinfo->master->bHWJpegZeroCopy = FALSE;
+
+  if((cinfo->master->pu8HWUserBuf != NULL) && !cinfo->master->bHWJpegDirectFBEnable &&
+     ((((cinfo->out_color_space == JCS_EXT_BGRA) || (cinfo->out_color_space == JCS_EXT_BGRX)) &&
+       (pixel_format == V4L2_PIX_FMT_ABGR32)) ||
+      ((cinfo->out_color_space == JCS_RGB565) && (pixel_format == V4L2_PIX_FMT_RGB565))))
+  {
+    cap_memory = cinfo->master->bHWUserBufDmaBuf ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_USERPTR;
+
+    //capture rows must be the packed rows of the buffer (same pitch), else rows would
+    //have to move inside the buffer
+    if(vc8000_backend()->capture_memory_supported(cap_memory) &&
+       (estimate_output_width == cinfo->output_width) &&
+       (cinfo->master->u32HWUserBufSize >= (size_t)estimate_output_width * estimate_output_height * u32CapPixelSize))
+      cinfo->master->bHWJpegZeroCopy = TRUE;
+    else
+      cap_memory = V4L2_MEMORY_MMAP;
+  }
+
+  //claim device only when image is decodable by hardware
+  uint64_t u64StageStartNs = vc8000_costmodel_time_ns();
+
+  vc8000_CreateDecompress(cinfo, pixel_format, estimate_output_width, estimate_output_height);
+  u64StageStartNs = vc8000_stage_add(cinfo, eJPEG_STAGE_OPEN, u64StageStartNs);
+  if(!cinfo->master->bHWJpegCodecOpened)
+    return -11;
+
+  i32Ret = vc8000_backend()->prepare_decompress(
+			cinfo->master->psHWJpegVideo,
 			cinfo->image_width,
 			cinfo->image_height,
 			estimate_output_width,
@@ -211,27 +297,45 @@ static int vc8000_start_decompress(j_decompress_ptr cinfo)
 			cinfo->master->sDirectFBParam.img_pos_x,
 			cinfo->master->sDirectFBParam.img_pos_y,
 			iRotOP,
-			pixel_format);
+			pixel_format,
+			cap_memory,
+			(cinfo->master->eJpegSrcType == eJPEG_SRC_HW_STREAM) ?
+				(uint32_t)cinfo->master->src_hw_jpeg->bytes_in_buffer :
+				VC8000_STREAM_BUF_SIZE(cinfo->image_width, cinfo->image_height));
 
   if(i32Ret != 0) {
 //	printf("Not support by VC8000, output dimension width: %d, height: %d \n", estimate_output_width, estimate_output_height);
     return -5;
   }
 
-//  printf("vc8000_jpeg_prepare_decompress time %f sec\n", getTimeSec() - dStartTime);
+
+  if(cinfo->master->bHWJpegZeroCopy)
+  {
+    if(vc8000_backend()->set_capture_buffer(cinfo->master->psHWJpegVideo,
+                                            cinfo->master->i32HWJpegSlot,
+                                            cinfo->master->pu8HWUserBuf,
+                                            cinfo->master->i32HWUserDmaBufFd,
+                                            cinfo->master->u32HWUserBufSize) != 0)
+    {
+      vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
+      return -12;
+    }
+  }
     
   char *pchStreamBuf = NULL;
   unsigned int u32StreamBufSize = 0;
   unsigned int u32StreamLen = 0;
   
-  u32StreamBufSize = vc8000_jpeg_get_bitstream_buffer(&cinfo->master->sHWJpegVideo, &pchStreamBuf);
+  u32StreamBufSize = vc8000_backend()->get_bitstream_buffer(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot, &pchStreamBuf);
   
   if(pchStreamBuf == NULL)
   {
 	  //release resource
-	  vc8000_jpeg_release_decompress(&cinfo->master->sHWJpegVideo);
+	  vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
 	  return -6;
   }
+
+  u64StageStartNs = vc8000_stage_add(cinfo, eJPEG_STAGE_SETUP, u64StageStartNs);
   
   //fill bitstream to bitstream buffer
   struct jpeg_source_mgr *src_mgr = cinfo->master->src_hw_jpeg;
@@ -241,12 +345,22 @@ static int vc8000_start_decompress(j_decompress_ptr cinfo)
     if(src_mgr->bytes_in_buffer > u32StreamBufSize)
     {
 	  //release resource
-	  vc8000_jpeg_release_decompress(&cinfo->master->sHWJpegVideo);
+	  vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
 	  return -7;
 	}
     memcpy(pchStreamBuf, src_mgr->next_input_byte, src_mgr->bytes_in_buffer);
 	u32StreamLen = src_mgr->bytes_in_buffer; 
   }
+  else if(cinfo->master->eJpegSrcType == eJPEG_SRC_HW_STREAM)
+  {
+    //bitstream already written into hardware buffer by caller
+    if((const JOCTET *)pchStreamBuf != src_mgr->next_input_byte)
+    {
+	  vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
+	  return -13;
+    }
+	u32StreamLen = src_mgr->bytes_in_buffer; 
+  }
   else if(cinfo->master->eJpegSrcType == eJPEG_SRC_FILE)
   {
     long u64CurFilePos = cinfo->master->seek_file_pos(cinfo, 0, SEEK_SET);
@@ -264,7 +378,7 @@ static int vc8000_start_decompress(j_decompress_ptr cinfo)
 	if(u32StreamLen > u32StreamBufSize)
     {
 	  //release resource
-	  vc8000_jpeg_release_decompress(&cinfo->master->sHWJpegVideo);
+	  vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
 	  return -8;
 	}
   }
@@ -274,63 +388,298 @@ static int vc8000_start_decompress(j_decompress_ptr cinfo)
 
 	if(src)
 	{
-      vc8000_jpeg_release_decompress(&cinfo->master->sHWJpegVideo);
+      vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
       return -9;
 	}
   }
 
-//  printf("fill bitstream time %f sec\n", getTimeSec() - dStartTime);
+  vc8000_stage_add(cinfo, eJPEG_STAGE_FILL, u64StageStartNs);
+
+  //inqueue bitstream buffer, software takes over if hardware misses the deadline
+  vc8000_backend()->set_deadline(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot, cinfo->master->u32HWJpegDeadlineMs);
+  if(vc8000_backend()->inqueue_bitstream_buffer(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot, pchStreamBuf, u32StreamLen) != 0)
+  {
+    vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
+    return -10;
+  }
+
+  cinfo->master->i32PixelFormat = pixel_format;
+  cinfo->master->bHWJpegJobPending = TRUE;
 
-  //inqueue bitstream buffer
-  vc8000_jpeg_inqueue_bitstream_buffer(&cinfo->master->sHWJpegVideo, pchStreamBuf, u32StreamLen);
+  return 0;
+}
 
-//  printf("vc8000_jpeg_inqueue_bitstream_buffer time %f sec\n", getTimeSec() - dStartTime);
-  //wait decode done
+/*
+ * Complete the hardware decode job submitted by vc8000_start_decompress().
+ * Returns 1 if job is still running (only if bWait is FALSE), 0 if image is
+ * decoded by hardware, otherwise the image falls back to software decoder.
+ */
+static int vc8000_complete_decompress(j_decompress_ptr cinfo, boolean bWait)
+{
+  int i32Ret;
   int i32DecBufIndex = 0;
-  
-  i32Ret = vc8000_jpeg_poll_decode_done(&cinfo->master->sHWJpegVideo, &i32DecBufIndex);
-  
+
+  if(!cinfo->master->bHWJpegJobPending)
+    return cinfo->master->bHWJpegDecodeDone ? 0 : -10;
+
+  if(bWait)
+    i32Ret = vc8000_backend()->poll_decode_done(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot, &i32DecBufIndex);
+  else
+    i32Ret = vc8000_backend()->try_decode_done(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot, &i32DecBufIndex);
+
+  if(i32Ret == 1)
+    return 1;
+
+  cinfo->master->bHWJpegJobPending = FALSE;
+
+  cinfo->master->au64HWStageNs[eJPEG_STAGE_HW_DECODE] +=
+    vc8000_backend()->get_decode_time(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
+
   if(i32Ret != 0)
   {
-    //release resource
-    vc8000_jpeg_release_decompress(&cinfo->master->sHWJpegVideo);
+    //release resource, software decode of failed job is not a sample of cost model
+    vc8000_backend()->release_decompress(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
+    cinfo->master->i32HWCostEngine = eVC8000_ENGINE_NONE;
+    cinfo->master->i32HWFallback = (i32Ret == VC8000_JOB_ERR_TIMEOUT) ? JPEG_HW_FALLBACK_TIMEOUT : JPEG_HW_FALLBACK_DECODE;
+    cinfo->master->i32HWFallbackCode = i32Ret;
     return -10;
   }
 
-//  printf("vc8000_jpeg_poll_decode_done time %f sec\n", getTimeSec() - dStartTime);
+  cinfo->master->i32HWStatsEngine = JPEG_HW_ENGINE_HW;
 
-  cinfo->master->pu8DecodedBuf = cinfo->master->sHWJpegVideo.cap_buf_addr[i32DecBufIndex][0];
-  cinfo->master->i32PixelFormat = pixel_format;
-  cinfo->master->u32DecodeImageWidth = cinfo->master->sHWJpegVideo.cap_w;
-  cinfo->master->u32DecodeImageHeight = cinfo->master->sHWJpegVideo.cap_h;
+  cinfo->master->i32HWJpegCapIndex = i32DecBufIndex;
+
+  if(cinfo->master->bHWJpegZeroCopy)
+    cinfo->master->pu8DecodedBuf = cinfo->master->pu8HWUserBuf;
+  else
+    cinfo->master->pu8DecodedBuf = cinfo->master->psHWJpegVideo->cap_buf_addr[i32DecBufIndex][0];
+  cinfo->master->u32DecodeImageWidth = cinfo->master->psHWJpegVideo->cap_w;
+  cinfo->master->u32DecodeImageHeight = cinfo->master->psHWJpegVideo->cap_h;
+  cinfo->master->pfnHWConvertRow = vc8000_convert_select(cinfo->master->i32PixelFormat, cinfo->out_color_space);
   cinfo->master->bHWJpegDecodeDone = TRUE;
 
   return 0;
 }
 
+/* Map return code of vc8000_start_decompress() to JPEG_HW_FALLBACK_xxx */
+static int vc8000_fallback_reason(int i32Ret)
+{
+  switch(i32Ret) {
+  case -1:
+    return JPEG_HW_FALLBACK_RAW_SUBSAMPLING;
+  case -2:
+    return JPEG_HW_FALLBACK_COLOR_SPACE;
+  case -3:
+    return JPEG_HW_FALLBACK_TOO_SMALL;
+  case -4:
+    return JPEG_HW_FALLBACK_SCALE;
+  case -11:
+    return JPEG_HW_FALLBACK_DEVICE;
+  case -7:
+  case -8:
+  case -9:
+  case -13:
+    return JPEG_HW_FALLBACK_BITSTREAM;
+  case -10:
+    return JPEG_HW_FALLBACK_QUEUE;
+  default:
+    return JPEG_HW_FALLBACK_SETUP;   //-5, -6, -12
+  }
+}
+
+/* Software decoder init of a hardware decoded image is setup cost */
+static E_JPEG_STAGE vc8000_sw_stage(j_decompress_ptr cinfo)
+{
+  if(cinfo->master->bHWJpegJobPending || cinfo->master->bHWJpegDecodeDone)
+    return eJPEG_STAGE_SETUP;
+
+  return eJPEG_STAGE_SW_DECODE;
+}
+
+/*
+ * Pick decode engine for memory output. Frame buffer output is hardware only.
+ * Image is measured for the cost model from here to jpeg_finish_decompress().
+ */
+static E_VC8000_ENGINE vc8000_dispatch_decompress(j_decompress_ptr cinfo)
+{
+  int pixel_format;
+  uint32_t u32OutWidth;
+  uint32_t u32OutHeight;
+  E_VC8000_ENGINE eEngine;
+
+  if(cinfo->master->bHWJpegDirectFBEnable)
+    return eVC8000_ENGINE_HW;
+
+  //not decodable by hardware, nothing to compare
+  if(vc8000_check_decode(cinfo, &pixel_format, &u32OutWidth, &u32OutHeight) != 0)
+    return eVC8000_ENGINE_HW;
+
+  cinfo->master->u32HWCostKey = vc8000_costmodel_key(cinfo->image_width, cinfo->image_height,
+                                                     cinfo->scale_num, cinfo->scale_denom,
+                                                     cinfo->raw_data_out ? VC8000_COST_FMT_RAW : (int)cinfo->out_color_space,
+                                                     get_subsampling(cinfo));
+
+  if(cinfo->master->i32HWForceEngine != eVC8000_ENGINE_NONE)
+    eEngine = (E_VC8000_ENGINE)cinfo->master->i32HWForceEngine;
+  else
+    eEngine = vc8000_costmodel_choose(cinfo->master->u32HWCostKey);
+
+  cinfo->master->i32HWCostEngine = eEngine;
+  return eEngine;
+}
+
+/* Submit hardware decode job, return TRUE if a job is pending */
+static boolean vc8000_submit_decompress(j_decompress_ptr cinfo)
+{
+  int i32Ret;
+
+  //new image, statistics start over
+  cinfo->master->i32HWCostEngine = eVC8000_ENGINE_NONE;
+  cinfo->master->bHWStatsOpen = TRUE;
+  cinfo->master->i32HWStatsEngine = JPEG_HW_ENGINE_SW;
+  cinfo->master->i32HWFallback = JPEG_HW_FALLBACK_NONE;
+  cinfo->master->i32HWFallbackCode = 0;
+  memset(cinfo->master->au64HWStageNs, 0, sizeof(cinfo->master->au64HWStageNs));
+
+  if(cinfo->master->bHWJpegDeocdeEnable != TRUE) {
+    cinfo->master->i32HWFallback = JPEG_HW_FALLBACK_DISABLED;
+    return FALSE;
+  }
+
+  if(vc8000_dispatch_decompress(cinfo) == eVC8000_ENGINE_SW) {
+    cinfo->master->i32HWFallback = JPEG_HW_FALLBACK_COST_MODEL;
+    return FALSE;
+  }
+
+  i32Ret = vc8000_start_decompress(cinfo);
+  if(i32Ret == 0)
+    return TRUE;
+
+  cinfo->master->i32HWCostEngine = eVC8000_ENGINE_NONE;
+  cinfo->master->i32HWFallback = vc8000_fallback_reason(i32Ret);
+  cinfo->master->i32HWFallbackCode = i32Ret;
+  return FALSE;
+}
 
 #endif
 
+LOCAL(boolean) start_decompress_sw(j_decompress_ptr cinfo);
+
 GLOBAL(boolean)
 jpeg_start_decompress(j_decompress_ptr cinfo)
 {
 #ifdef WITH_VC8000
-  int ret;
+  uint64_t u64StartNs;
+  boolean bRet;
 
-  if(cinfo->master->bHWJpegDeocdeEnable == TRUE) {
-    vc8000_CreateDecompress(cinfo);
+  if(cinfo->global_state == DSTATE_READY) {
+    if(vc8000_submit_decompress(cinfo))
+      vc8000_complete_decompress(cinfo, TRUE);
   }
 
-  if(cinfo->master->bHWJpegCodecOpened) {
-	ret = vc8000_start_decompress(cinfo);
-//    if(ret != 0)
-//    {
-//		printf("JPEG fallback to software decompress reason %d \n", ret);
-//    }
-  }
+  u64StartNs = vc8000_costmodel_time_ns();
+  bRet = start_decompress_sw(cinfo);
+  vc8000_stage_add(cinfo, vc8000_sw_stage(cinfo), u64StartNs);
+  return bRet;
+#else
+  return start_decompress_sw(cinfo);
+#endif
+}
+
+#ifdef WITH_VC8000
+
+/*
+ * Asynchronous decompression initialization.
+ *
+ * Same as jpeg_start_decompress(), but if the image is decoded by VC8000 it
+ * returns without waiting for the hardware.  The return value is a file
+ * descriptor which becomes readable when the hardware decode is done, or -1
+ * if no hardware job is pending (the image is ready to be read).  Call
+ * jpeg_decompress_poll() or jpeg_decompress_wait() before reading scanlines.
+ * A non-suspending data source is required.
+ */
+
+GLOBAL(int)
+jpeg_start_decompress_async(j_decompress_ptr cinfo)
+{
+  int fd = -1;
+
+  if (cinfo->global_state != DSTATE_READY)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  uint64_t u64StartNs;
+
+  if(vc8000_submit_decompress(cinfo))
+    fd = vc8000_backend()->get_done_fd(cinfo->master->psHWJpegVideo, cinfo->master->i32HWJpegSlot);
+
+  u64StartNs = vc8000_costmodel_time_ns();
+  start_decompress_sw(cinfo);
+  vc8000_stage_add(cinfo, vc8000_sw_stage(cinfo), u64StartNs);
+  return fd;
+}
+
+
+/*
+ * Check from the parsed header and output parameters whether the image will
+ * be decoded by VC8000.  Call after jpeg_read_header() and setting the output
+ * parameters.  The device is not opened and cinfo is not modified.
+ */
+
+GLOBAL(boolean)
+jpeg_hw_can_decode(j_decompress_ptr cinfo)
+{
+  int pixel_format;
+  uint32_t u32OutWidth;
+  uint32_t u32OutHeight;
+
+  if (cinfo->global_state != DSTATE_READY)
+    return FALSE;
+
+  if (cinfo->master->bHWJpegDeocdeEnable != TRUE)
+    return FALSE;
+
+  return (vc8000_check_decode(cinfo, &pixel_format, &u32OutWidth, &u32OutHeight) == 0) ? TRUE : FALSE;
+}
+
+
+/*
+ * Check whether the decode started by jpeg_start_decompress_async() is done,
+ * without blocking.  Returns TRUE if scanlines can be read.
+ */
+
+GLOBAL(boolean)
+jpeg_decompress_poll(j_decompress_ptr cinfo)
+{
+  if(!cinfo->master->bHWJpegJobPending)
+    return TRUE;
+
+  return (vc8000_complete_decompress(cinfo, FALSE) != 1) ? TRUE : FALSE;
+}
+
+
+/*
+ * Wait for the decode started by jpeg_start_decompress_async().
+ */
+
+GLOBAL(boolean)
+jpeg_decompress_wait(j_decompress_ptr cinfo)
+{
+  if(cinfo->master->bHWJpegJobPending)
+    vc8000_complete_decompress(cinfo, TRUE);
+
+  return TRUE;
+}
 
 #endif
 
+
+/*
+ * Software part of jpeg_start_decompress().
+ */
+
+LOCAL(boolean)
+start_decompress_sw(j_decompress_ptr cinfo)
+{
   if (cinfo->global_state == DSTATE_READY) {
     /* First call: initialize master control, select active modules */
     jinit_master_decompress(cinfo);
@@ -506,6 +855,10 @@ jpeg_crop_scanline(j_decompress_ptr cinfo, JDIMENSION *xoffset,
    * will be used in single-scan decompressions.
    */
   cinfo->master->first_iMCU_col = (JDIMENSION)(long)(*xoffset) / (long)align;
+#ifdef WITH_VC8000
+  //hardware output is read at this pixel column
+  cinfo->master->u32HWCropX = *xoffset;
+#endif
   cinfo->master->last_iMCU_col =
     (JDIMENSION)jdiv_round_up((long)(*xoffset + cinfo->output_width),
                               (long)align) - 1;
@@ -580,52 +933,13 @@ static const int csPixelSize[JPEG_NUMCS] = {
   2,	/*JCS_RGB565*/
 };
 
-#if 1
-//from https://www.twblogs.net/a/5ef44dd90cb8aa7778837d67
-// size must multiple of 64
-static void _memcpy_fast(volatile void *dst, volatile void *src, int sz)
-{
-    asm volatile (
-        "NEONCopyPLD: \n"
-		"sub %[dst], %[dst], #64 \n"
-		"1: \n"
-		"ldnp q0, q1, [%[src]] \n"
-		"ldnp q2, q3, [%[src], #32] \n"
-		"add %[dst], %[dst], #64 \n"
-		"subs %[sz], %[sz], #64 \n"
-		"add %[src], %[src], #64 \n"
-		"stnp q0, q1, [%[dst]] \n"
-		"stnp q2, q3, [%[dst], #32] \n"
-		"b.gt 1b \n"
-		: [dst]"+r"(dst), [src]"+r"(src), [sz]"+r"(sz) : : "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "cc", "memory");
-}
-#else
-//from https://www.twblogs.net/a/5ef44dd90cb8aa7778837d67
-static void _memcpy_fast(volatile void *dst, volatile void *src, int sz)
-{
-    asm volatile (
-        "NEONCopyPLD: \n"
-		"sub %[src], %[src], #32 \n"
-		"sub %[dst], %[dst], #32 \n"
-		"1: \n"
-		"ldp q0, q1, [%[src], #32] \n"
-		"ldp q2, q3, [%[src], #64]! \n"
-		"subs %[sz], %[sz], #64 \n"
-		"stp q0, q1, [%[dst], #32] \n"
-		"stp q2, q3, [%[dst], #64]! \n"
-		"b.gt 1b \n"
-		: [dst]"+r"(dst), [src]"+r"(src), [sz]"+r"(sz) : : "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "cc", "memory");
-}
-#endif
-
 static JDIMENSION
 vc8000_read_scanlines(j_decompress_ptr cinfo, JSAMPARRAY scanlines,
                     JDIMENSION max_lines)
 {
   JDIMENSION row_ctr;
-  int i,j;
+  int i;
   unsigned char *pu8DecodedSrc;
-  unsigned char *pu8RGBRow;
   J_COLOR_SPACE eDecodedSrcCS;
   int i32DecodedSrcPixelSize;
   int i32OutputPixelSize;
@@ -648,203 +962,52 @@ vc8000_read_scanlines(j_decompress_ptr cinfo, JSAMPARRAY scanlines,
   if((cinfo->output_scanline + row_ctr) >= cinfo->output_height)
 	row_ctr = cinfo->output_height - cinfo->output_scanline;
 
-  for(i = 0; i < row_ctr; i ++)
-  {
-    pu8DecodedSrc = cinfo->master->pu8DecodedBuf + ((cinfo->output_scanline + i) * u32DecodedSrcRowBytes);
-    pu8DecodedSrc += cinfo->master->first_iMCU_col * i32DecodedSrcPixelSize;
-
-    if(cinfo->master->i32PixelFormat == V4L2_PIX_FMT_ABGR32)
-    {
-	  if((cinfo->out_color_space == JCS_EXT_RGB) || (cinfo->out_color_space == JCS_RGB))
-	  {
-	    //copy BGRA data to RGB888
-	    pu8RGBRow = scanlines[i];
-#if 0
-		//1608x1072: ~863.1ms
-        for(j = 0; j < cinfo->output_width; j ++)
-        {
-		  //RGB pixel size 3 bytes, BGRA pixel size 4 bytes
-          *pu8RGBRow++ = pu8DecodedSrc[2];  
-          *pu8RGBRow++ = pu8DecodedSrc[1];
-          *pu8RGBRow++ = pu8DecodedSrc[0];
-		  pu8DecodedSrc += i32DecodedSrcPixelSize;
-	    }
-#else
-		//1608x1072: ~76.3ms
-		int u32RemainBytes = u32RowBytes & 11;
-		int u32FirstCopyBytes = u32RowBytes - u32RemainBytes;
-
-		register uint32_t u32Temp0;
-		register uint32_t u32Temp1;
-		register uint32_t u32Temp2;
-
-		if(u32FirstCopyBytes)
-		{
-			for(j = 0; j < u32FirstCopyBytes; j = j + 12)
-			{
-			  //BGR pixel size 3 bytes, BGRA pixel size 4 bytes
-			  u32Temp0 = (pu8DecodedSrc[2]) | (pu8DecodedSrc[1] << 8) | (pu8DecodedSrc[0] <<  16) | (pu8DecodedSrc[6] <<  24);  
-			  u32Temp1 = (pu8DecodedSrc[5]) | (pu8DecodedSrc[4] << 8) | (pu8DecodedSrc[10] <<  16) | (pu8DecodedSrc[9] <<  24);  
-			  u32Temp2 = (pu8DecodedSrc[8]) | (pu8DecodedSrc[14] << 8) | (pu8DecodedSrc[13] <<  16) | (pu8DecodedSrc[12] <<  24);  
-
-			  *(uint32_t *)pu8RGBRow = u32Temp0;
-			  *(uint32_t *)(pu8RGBRow + 4) = u32Temp1;
-			  *(uint32_t *)(pu8RGBRow + 8) = u32Temp2;           
-			  pu8RGBRow += 12;
-			  pu8DecodedSrc += 16; //i32DecodedSrcPixelSize;
-			}
-		}
-
-		//remain bytes ( < 12bytes) 
-		if(u32RemainBytes)
-		{
-			for(j = 0; j < u32RemainBytes; j = j + 3)
-			{
-			  *pu8RGBRow++ = pu8DecodedSrc[2];  
-			  *pu8RGBRow++ = pu8DecodedSrc[1];
-			  *pu8RGBRow++ = pu8DecodedSrc[0];
-			  pu8DecodedSrc += i32DecodedSrcPixelSize;
-			}
-		}
-
-#endif
-
+  pu8DecodedSrc = cinfo->master->pu8DecodedBuf + (cinfo->output_scanline * u32DecodedSrcRowBytes);
+  pu8DecodedSrc += cinfo->master->u32HWCropX * i32DecodedSrcPixelSize;
 
-	  }
-	  else if(cinfo->out_color_space == JCS_EXT_BGR)
-	  {
-	     //copy BGRA data to BGR888
-	    pu8RGBRow = scanlines[i];
-
-#if 0		
-         for(j = 0; j < cinfo->output_width; j ++)
-         {
-		   //BGR pixel size 3 bytes, BGRA pixel size 4 bytes
-           *pu8RGBRow++ = pu8DecodedSrc[0];  
-           *pu8RGBRow++ = pu8DecodedSrc[1];
-           *pu8RGBRow++ = pu8DecodedSrc[2];
-		   pu8DecodedSrc += i32DecodedSrcPixelSize;
-	     }
-#else
-		int u32RemainBytes = u32RowBytes & 11;
-		int u32FirstCopyBytes = u32RowBytes - u32RemainBytes;
-
-		register uint32_t u32Temp0;
-		register uint32_t u32Temp1;
-		register uint32_t u32Temp2;
-
-		if(u32FirstCopyBytes)
-		{
-			for(j = 0; j < u32FirstCopyBytes; j = j + 12)
-			{
-			  //BGR pixel size 3 bytes, BGRA pixel size 4 bytes
-			  u32Temp0 = (pu8DecodedSrc[0]) | (pu8DecodedSrc[1] << 8) | (pu8DecodedSrc[2] <<  16) | (pu8DecodedSrc[4] <<  24);  
-			  u32Temp1 = (pu8DecodedSrc[5]) | (pu8DecodedSrc[6] << 8) | (pu8DecodedSrc[8] <<  16) | (pu8DecodedSrc[9] <<  24);  
-			  u32Temp2 = (pu8DecodedSrc[10]) | (pu8DecodedSrc[12] << 8) | (pu8DecodedSrc[13] <<  16) | (pu8DecodedSrc[14] <<  24);  
-
-			  *(uint32_t *)pu8RGBRow = u32Temp0;
-			  *(uint32_t *)(pu8RGBRow + 4) = u32Temp1;
-			  *(uint32_t *)(pu8RGBRow + 8) = u32Temp2;           
-			  pu8RGBRow += 12;
-			  pu8DecodedSrc += 16; //i32DecodedSrcPixelSize;
-			}
-		}
-
-		//remain bytes ( < 12bytes) 
-		if(u32RemainBytes)
-		{
-			for(j = 0; j < u32RemainBytes; j = j + 3)
-			{
-			  *pu8RGBRow++ = pu8DecodedSrc[0];  
-			  *pu8RGBRow++ = pu8DecodedSrc[1];
-			  *pu8RGBRow++ = pu8DecodedSrc[2];
-			  pu8DecodedSrc += i32DecodedSrcPixelSize;
-			}
-		}
-#endif
-
-	  }
-	  else if(cinfo->out_color_space == JCS_EXT_ARGB)
-	  {
-	    //copy BGRA data to ARGB
-	    pu8RGBRow = scanlines[i];
-
-#if 0		
-        for(j = 0; j < cinfo->output_width; j ++)
-        {
-		  //ARGB pixel size 4 bytes, BGRA pixel size 4 bytes
-          *pu8RGBRow++ = pu8DecodedSrc[3];  
-          *pu8RGBRow++ = pu8DecodedSrc[2];
-          *pu8RGBRow++ = pu8DecodedSrc[1];
-          *pu8RGBRow++ = pu8DecodedSrc[0];
-		  pu8DecodedSrc += i32DecodedSrcPixelSize;
-	    }
-#else
-		int u32RemainBytes = u32RowBytes & 15;
-		int u32FirstCopyBytes = u32RowBytes - u32RemainBytes;
-
-		register uint32_t u32Temp0;
-		register uint32_t u32Temp1;
-		register uint32_t u32Temp2;
-		register uint32_t u32Temp3;
-
-		if(u32FirstCopyBytes)
-		{
-			for(j = 0; j < u32FirstCopyBytes; j = j + 16)
-			{
-			  //ARGB pixel size 4 bytes, BGRA pixel size 4 bytes
-			  u32Temp0 = (pu8DecodedSrc[3]) | (pu8DecodedSrc[2] << 8) | (pu8DecodedSrc[1] <<  16) | (pu8DecodedSrc[0] <<  24);  
-			  u32Temp1 = (pu8DecodedSrc[7]) | (pu8DecodedSrc[6] << 8) | (pu8DecodedSrc[5] <<  16) | (pu8DecodedSrc[4] <<  24);  
-			  u32Temp2 = (pu8DecodedSrc[11]) | (pu8DecodedSrc[10] << 8) | (pu8DecodedSrc[9] <<  16) | (pu8DecodedSrc[8] <<  24);  
-			  u32Temp3 = (pu8DecodedSrc[15]) | (pu8DecodedSrc[14] << 8) | (pu8DecodedSrc[13] <<  16) | (pu8DecodedSrc[12] <<  24);  
-			  *(uint32_t *)pu8RGBRow = u32Temp0;
-			  *(uint32_t *)(pu8RGBRow + 4) = u32Temp1;
-			  *(uint32_t *)(pu8RGBRow + 8) = u32Temp2;
-			  *(uint32_t *)(pu8RGBRow + 12) = u32Temp3;    
-			  pu8RGBRow += 16;
-			  pu8DecodedSrc += 16; //i32DecodedSrcPixelSize;
-			}
-		}
-
-		//remain bytes ( < 16 bytes) 
-		if(u32RemainBytes)
-		{
-			for(j = 0; j < u32RemainBytes; j = j + 4)
-			{
-			  *pu8RGBRow++ = pu8DecodedSrc[3];  
-			  *pu8RGBRow++ = pu8DecodedSrc[2];
-			  *pu8RGBRow++ = pu8DecodedSrc[1];
-			  *pu8RGBRow++ = pu8DecodedSrc[0];
-			  pu8DecodedSrc += i32DecodedSrcPixelSize;
-			}
-		}
-#endif
+  if(!cinfo->master->bHWJpegZeroCopy)
+  {
+    //large reads may be striped over conversion threads
+    vc8000_convert_rows(cinfo->master->pfnHWConvertRow, pu8DecodedSrc, u32DecodedSrcRowBytes,
+                        scanlines, cinfo->output_width, row_ctr);
+    return row_ctr;
+  }
 
-	  }	   
-	  else
-	  {
+  //decoded in place. A row read to another place of the caller buffer (bottom-up
+  //rows, cropping) may overwrite capture rows not read yet, so the rest of the
+  //image is read from a copy of the capture
+  if(cinfo->master->pu8DecodedBuf == cinfo->master->pu8HWUserBuf)
+  {
+    JSAMPLE *pu8UserBufEnd = cinfo->master->pu8HWUserBuf + cinfo->master->u32HWUserBufSize;
+    size_t szCapture = (size_t)u32DecodedSrcRowBytes * cinfo->master->u32DecodeImageHeight;
+    unsigned char *pu8Row = pu8DecodedSrc;
 
-#if 1
-		int u32RemainBytes = u32RowBytes & 63;
-		int u32FastCopyBytes = u32RowBytes - u32RemainBytes;
+    for(i = 0; i < row_ctr; i ++)
+    {
+      if((scanlines[i] != pu8Row) &&
+         (scanlines[i] + u32RowBytes > cinfo->master->pu8HWUserBuf) && (scanlines[i] < pu8UserBufEnd))
+        break;
+      pu8Row += u32DecodedSrcRowBytes;
+    }
 
-	    pu8RGBRow = scanlines[i];
-		
-		if(u32FastCopyBytes)
-			_memcpy_fast(pu8RGBRow, pu8DecodedSrc, u32FastCopyBytes); //1608x1072: 57.6ms
+    if(i < row_ctr)
+    {
+      unsigned char *pu8Copy = (unsigned char *)
+        (*cinfo->mem->alloc_large) ((j_common_ptr)cinfo, JPOOL_IMAGE, szCapture);
 
-		if(u32RemainBytes)
-			memcpy(pu8RGBRow + u32FastCopyBytes, pu8DecodedSrc + u32FastCopyBytes, u32RemainBytes);
-#else
-		memcpy(scanlines[i], pu8DecodedSrc, u32RowBytes); //1608x1072: 97.3ms
-#endif
-	  }
+      memcpy(pu8Copy, cinfo->master->pu8DecodedBuf, szCapture);
+      cinfo->master->pu8DecodedBuf = pu8Copy;
+      pu8DecodedSrc = pu8Copy + (pu8DecodedSrc - cinfo->master->pu8HWUserBuf);
     }
-	else
-	{
+  }
+
+  for(i = 0; i < row_ctr; i ++)
+  {
+    //source is a copy or the destination lies outside of the capture
+    if(scanlines[i] != pu8DecodedSrc)
       memcpy(scanlines[i], pu8DecodedSrc, u32RowBytes);
-    }
-  }	
+    pu8DecodedSrc += u32DecodedSrcRowBytes;
+  }
 
   return row_ctr;
 }
@@ -865,16 +1028,22 @@ jpeg_read_scanlines(j_decompress_ptr cinfo, JSAMPARRAY scanlines,
   }
 
 #ifdef WITH_VC8000
+  uint64_t u64StartNs;
+
+  if(cinfo->master->bHWJpegJobPending)
+    jpeg_decompress_wait(cinfo);
+
+  u64StartNs = vc8000_costmodel_time_ns();
+
   if(cinfo->master->bHWJpegDecodeDone)
   {
     row_ctr = 0;
-    double dStartTime = getTimeSec();
     row_ctr = vc8000_read_scanlines(cinfo, scanlines, max_lines);
-    //printf("vc8000_read_scanlines time %f sec\n", getTimeSec() - dStartTime);
 
     if(row_ctr > 0)
     {
       cinfo->output_scanline += row_ctr;
+      vc8000_stage_add(cinfo, eJPEG_STAGE_CONVERT, u64StartNs);
       return row_ctr;
     }
   }
@@ -891,6 +1060,9 @@ jpeg_read_scanlines(j_decompress_ptr cinfo, JSAMPARRAY scanlines,
   row_ctr = 0;
   (*cinfo->main->process_data) (cinfo, scanlines, &row_ctr, max_lines);
   cinfo->output_scanline += row_ctr;
+#ifdef WITH_VC8000
+  vc8000_stage_add(cinfo, eJPEG_STAGE_SW_DECODE, u64StartNs);
+#endif
   return row_ctr;
 }
 
@@ -1187,107 +1359,99 @@ jpeg_skip_scanlines(j_decompress_ptr cinfo, JDIMENSION num_lines)
  */
 
 #ifdef WITH_VC8000
+/*
+ * Pixels per chroma sample (horizontal, vertical) of capture format.  Raw
+ * output is only captured in the format of its own subsampling, so this is
+ * the layout of the raw chroma planes too.
+ */
+static void
+vc8000_capture_layout(int pixel_format, unsigned int *pu32HDiv,
+                      unsigned int *pu32VDiv)
+{
+  *pu32HDiv = (pixel_format == V4L2_PIX_FMT_NV24) ? 1 : 2;
+  *pu32VDiv = (pixel_format == V4L2_PIX_FMT_NV12) ? 2 : 1;
+}
+
 static JDIMENSION
 vc8000_read_raw_data(j_decompress_ptr cinfo, JSAMPIMAGE data,
                    JDIMENSION max_lines)
 {
-  if((cinfo->master->i32PixelFormat != V4L2_PIX_FMT_YUYV) && (cinfo->master->i32PixelFormat != V4L2_PIX_FMT_NV12))
+  int pixel_format = cinfo->master->i32PixelFormat;
+
+  if((pixel_format != V4L2_PIX_FMT_YUYV) && (pixel_format != V4L2_PIX_FMT_NV12) &&
+     (pixel_format != V4L2_PIX_FMT_NV24))
     return 0;
 
-  int i, j;  
+  JDIMENSION j;
+  JDIMENSION u32BufRows = max_lines;
 
   if((max_lines + cinfo->output_scanline) > cinfo->output_height)
     max_lines = cinfo->output_height - cinfo->output_scanline;
 
   JSAMPROW *y_comp = data[0];
-  JSAMPROW *u_comp = data[1];
-  JSAMPROW *v_comp = data[2];
-  
-  uint32_t y_pos = 0;
-  uint32_t u_pos = 0;
-  uint32_t v_pos = 0;
+  JSAMPROW *u_comp = (cinfo->num_components == 3) ? data[1] : NULL;
+  JSAMPROW *v_comp = (cinfo->num_components == 3) ? data[2] : NULL;
+
+  unsigned char *pu8DecodedSrc;
+  unsigned int u32RowBytes;
+  unsigned int u32HDiv, u32VDiv;
+
+  vc8000_capture_layout(pixel_format, &u32HDiv, &u32VDiv);
+  //grayscale comes from the NV12 Y plane, no padding to chroma samples
+  if(u_comp == NULL)
+    u32HDiv = u32VDiv = 1;
 
-  unsigned char *pu8YComp;
-  unsigned char *pu8UComp;
-  unsigned char *pu8VComp;
+  //raw data can't be cropped (jpeg_crop_scanline() needs DSTATE_SCANNING), rows start at column 0
+  //odd width: chroma of the last (partial) sample is still returned
+  unsigned int u32ChromaWidth = (cinfo->output_width + u32HDiv - 1) / u32HDiv;
+  //Y rows are padded to whole chroma samples like software raw output (tjPlaneWidth()),
+  //padding comes from the decoded MCU padding of the capture buffer
+  unsigned int u32YWidth = u32ChromaWidth * u32HDiv;
 
+  if(u32YWidth > cinfo->master->u32DecodeImageWidth)
+    u32YWidth = cinfo->output_width;
 
-  if(cinfo->master->i32PixelFormat == V4L2_PIX_FMT_YUYV)
+  if(pixel_format == V4L2_PIX_FMT_YUYV)
   {
-    unsigned char *pu8DecodedSrc;
-    unsigned int u32YUYVPixelSize = 2;
-    unsigned int u32RowBytes = cinfo->master->u32DecodeImageWidth * u32YUYVPixelSize;
+    u32RowBytes = cinfo->master->u32DecodeImageWidth * 2;
 
-    for(j = 0; j < max_lines; j  ++)
+    //byte 1 of each pair goes to v_comp, byte 3 to u_comp
+    for(j = 0; j < max_lines; j ++)
     {
       pu8DecodedSrc = cinfo->master->pu8DecodedBuf + ((cinfo->output_scanline + j) * u32RowBytes);
-      pu8DecodedSrc += cinfo->master->first_iMCU_col * u32YUYVPixelSize;
-
-	  pu8YComp = y_comp[j];
-	  pu8UComp = u_comp[j];
-	  pu8VComp = v_comp[j];
-	  y_pos = 0;
-	  v_pos = 0;
-	  u_pos = 0;
-
-      for( i = 0; i < cinfo->output_width; i ++)
-      {
-		pu8YComp[y_pos] = pu8DecodedSrc[i * u32YUYVPixelSize];
-		y_pos ++;
-		
-		if(i & 0x1)
-		{
-		  pu8UComp[v_pos] = pu8DecodedSrc[(i * u32YUYVPixelSize) + 1];
-          v_pos ++;
-        }
-        else
-        {
-		  pu8VComp[u_pos] = pu8DecodedSrc[(i * u32YUYVPixelSize) + 1];
-          u_pos ++;
-		}
-	  }
-	}
+      vc8000_deinterleave_yuyv(pu8DecodedSrc, y_comp[j], v_comp[j], u_comp[j], u32YWidth);
+    }
   }
-
-  if(cinfo->master->i32PixelFormat == V4L2_PIX_FMT_NV12)
+  else
   {
-    unsigned char *pu8DecodedYSrc;
     unsigned char *pu8DecodedUVSrc;
-    unsigned char *pu8DecodedSrc;
-    unsigned int u32NV12PixelSize = 1;
-    unsigned int u32RowBytes = cinfo->master->u32DecodeImageWidth * u32NV12PixelSize;
+    JDIMENSION u32ChromaRows;
+    JDIMENSION u32YRows = max_lines;
+
+    //odd height: Y plane is padded to whole row pairs (tjPlaneHeight()) if buffer has room
+    if((u32VDiv == 2) && (max_lines & 1) && (max_lines < u32BufRows) &&
+       (cinfo->output_scanline + max_lines < cinfo->master->u32DecodeImageHeight))
+      u32YRows ++;
 
     //copy Y component first
-	pu8DecodedYSrc = cinfo->master->pu8DecodedBuf;
-    for(j = 0; j < max_lines; j ++)
+    u32RowBytes = cinfo->master->u32DecodeImageWidth;
+    for(j = 0; j < u32YRows; j ++)
     {
-	  pu8YComp = y_comp[j];
-	  pu8DecodedSrc = pu8DecodedYSrc + ((cinfo->output_scanline + j)* u32RowBytes);
-	  pu8DecodedSrc += cinfo->master->first_iMCU_col * u32NV12PixelSize;
-      memcpy(pu8YComp, pu8DecodedSrc, cinfo->output_width * u32NV12PixelSize);
+      pu8DecodedSrc = cinfo->master->pu8DecodedBuf + ((cinfo->output_scanline + j) * u32RowBytes);
+      memcpy(y_comp[j], pu8DecodedSrc, u32YWidth);
     }
 
-    //copy UV component
-	pu8DecodedUVSrc = pu8DecodedYSrc + (cinfo->master->u32DecodeImageWidth * cinfo->master->u32DecodeImageHeight * u32NV12PixelSize);
-    u32NV12PixelSize = 2;
-	u32RowBytes = cinfo->master->u32DecodeImageWidth / 2 * u32NV12PixelSize;
-    for(j = 0; j < (max_lines / 2); j  ++)
+    if(u_comp == NULL)
+      return max_lines;
+
+    //split UV component, partial last chroma row comes from its first line
+    pu8DecodedUVSrc = cinfo->master->pu8DecodedBuf + (cinfo->master->u32DecodeImageWidth * cinfo->master->u32DecodeImageHeight);
+    u32RowBytes = (cinfo->master->u32DecodeImageWidth / u32HDiv) * 2;
+    u32ChromaRows = (max_lines + u32VDiv - 1) / u32VDiv;
+    for(j = 0; j < u32ChromaRows; j ++)
     {
-      pu8DecodedSrc = pu8DecodedUVSrc + (((cinfo->output_scanline / 2) + j) * u32RowBytes);
-      pu8DecodedSrc += (cinfo->master->first_iMCU_col / 2) * u32NV12PixelSize;
-
-	  pu8UComp = u_comp[j];
-	  pu8VComp = v_comp[j];
-	  u_pos = 0;
-	  v_pos = 0;
-	  
-      for( i = 0; i < (cinfo->output_width / 2); i ++)
-      {
-        pu8UComp[u_pos] = pu8DecodedSrc[(i * u32NV12PixelSize)];
-        u_pos ++;
-        pu8VComp[v_pos] = pu8DecodedSrc[(i * u32NV12PixelSize) + 1];
-        v_pos ++;
-      }
+      pu8DecodedSrc = pu8DecodedUVSrc + (((cinfo->output_scanline / u32VDiv) + j) * u32RowBytes);
+      vc8000_deinterleave2(pu8DecodedSrc, u_comp[j], v_comp[j], u32ChromaWidth);
     }
   }
 
@@ -1311,11 +1475,19 @@ jpeg_read_raw_data(j_decompress_ptr cinfo, JSAMPIMAGE data,
   }
 
 #ifdef WITH_VC8000
+  uint64_t u64StartNs;
+
+  if(cinfo->master->bHWJpegJobPending)
+    jpeg_decompress_wait(cinfo);
+
+  u64StartNs = vc8000_costmodel_time_ns();
+
   if(cinfo->master->bHWJpegDecodeDone)
   {
 	lines_per_iMCU_row = vc8000_read_raw_data(cinfo, data, max_lines);
 	if(lines_per_iMCU_row > 0){
       cinfo->output_scanline += lines_per_iMCU_row;
+      vc8000_stage_add(cinfo, eJPEG_STAGE_CONVERT, u64StartNs);
 	  return lines_per_iMCU_row;
 	}
   }
@@ -1340,6 +1512,9 @@ jpeg_read_raw_data(j_decompress_ptr cinfo, JSAMPIMAGE data,
 
   /* OK, we processed one iMCU row. */
   cinfo->output_scanline += lines_per_iMCU_row;
+#ifdef WITH_VC8000
+  vc8000_stage_add(cinfo, eJPEG_STAGE_SW_DECODE, u64StartNs);
+#endif
   return lines_per_iMCU_row;
 }
 
@@ -289,8 +289,8 @@ jpeg_mem_dest(j_compress_ptr cinfo, unsigned char **outbuffer,
 
 #ifdef WITH_VC8000
 
-#include "vc8000_v4l2.h"
-#include "transupp.h"
+#include "vc8000_backend.h"
+#include "jpeglib_ext.h"            /* includes transupp.h */
 
 GLOBAL(int)
 jpeg_fb_dest(j_decompress_ptr cinfo, 
@@ -338,4 +338,167 @@ jpeg_fb_dest(j_decompress_ptr cinfo,
   return 0;
 }
 
+/*
+ * Session (or slot of pipelined session) holding the decoded image now
+ * belongs to the caller, all lines count as read
+ */
+LOCAL(void)
+hw_detach_capture(j_decompress_ptr cinfo, void **session, int *slot)
+{
+  struct jpeg_decomp_master *psMaster = cinfo->master;   
+
+  *session = psMaster->psHWJpegVideo;
+  *slot = psMaster->i32HWJpegSlot;
+  psMaster->psHWJpegVideo = NULL;
+  psMaster->bHWJpegCodecOpened = FALSE;
+  psMaster->bHWJpegDecodeDone = FALSE;
+
+  cinfo->output_scanline = cinfo->output_height;
+}
+
+/* Capture buffer goes back to rotation, session back to pool */
+LOCAL(void)
+hw_release_capture(void *session, int slot)
+{
+  struct video *psVideo = (struct video *)session;
+
+  vc8000_backend()->release_decompress(psVideo, slot);
+  vc8000_backend()->close(psVideo, slot);
+}
+
+GLOBAL(int)
+jpeg_hw_export_frame(j_decompress_ptr cinfo, jpeg_hw_frame *frame)
+{
+  struct jpeg_decomp_master *psMaster = cinfo->master;   
+  struct video *psVideo;
+  int i32DmaBufFd;
+  unsigned int u32PixelSize;
+
+  frame->fd = -1;
+  frame->session = NULL;
+
+  if((cinfo->global_state != DSTATE_SCANNING) && (cinfo->global_state != DSTATE_RAW_OK))
+    return -1;
+
+  jpeg_decompress_wait(cinfo);
+
+  if(!psMaster->bHWJpegDecodeDone || psMaster->bHWJpegZeroCopy || psMaster->bHWJpegDirectFBEnable)
+    return -2;
+
+  psVideo = psMaster->psHWJpegVideo;
+
+  if((psVideo->cap_buf_num_planes != 1) ||
+     (vc8000_backend()->export_capture(psVideo, psMaster->i32HWJpegCapIndex, &i32DmaBufFd) != 0))
+    return -3;
+
+  if(psMaster->i32PixelFormat == V4L2_PIX_FMT_ABGR32)
+    u32PixelSize = 4;
+  else if((psMaster->i32PixelFormat == V4L2_PIX_FMT_NV12) || (psMaster->i32PixelFormat == V4L2_PIX_FMT_NV24))
+    u32PixelSize = 1;
+  else
+    u32PixelSize = 2;
+
+  frame->fd = i32DmaBufFd;
+  frame->fourcc = psMaster->i32PixelFormat;
+  frame->width = psVideo->cap_w;
+  frame->height = psVideo->cap_h;
+  frame->stride = psVideo->cap_bytesperline ? psVideo->cap_bytesperline : psVideo->cap_w * u32PixelSize;
+  frame->offset = psMaster->u32HWCropX * u32PixelSize;
+  frame->size = psVideo->cap_buf_planes_size[psMaster->i32HWJpegCapIndex][0];
+
+  hw_detach_capture(cinfo, &frame->session, &frame->slot);
+  return 0;
+}
+
+GLOBAL(void)
+jpeg_hw_release_frame(jpeg_hw_frame *frame)
+{
+  if(frame->session == NULL)
+    return;
+
+  hw_release_capture(frame->session, frame->slot);
+  frame->session = NULL;
+  frame->fd = -1;
+}
+
+GLOBAL(int)
+jpeg_read_raw_nv12(j_decompress_ptr cinfo, jpeg_hw_nv12 *frame)
+{
+  struct jpeg_decomp_master *psMaster = cinfo->master;   
+  struct video *psVideo;
+  unsigned char *pu8Y;
+  unsigned char *pu8UV;
+  unsigned int u32Stride;
+
+  frame->session = NULL;
+
+  if((cinfo->global_state != DSTATE_SCANNING) && (cinfo->global_state != DSTATE_RAW_OK))
+    return -1;
+
+  if(cinfo->output_scanline != 0)
+    return -1;
+
+  jpeg_decompress_wait(cinfo);
+
+  if(!psMaster->bHWJpegDecodeDone || psMaster->bHWJpegZeroCopy || psMaster->bHWJpegDirectFBEnable ||
+     (psMaster->i32PixelFormat != V4L2_PIX_FMT_NV12))
+    return -2;
+
+  psVideo = psMaster->psHWJpegVideo;
+
+  //planes as read by vc8000_read_raw_data(), CbCr follows Y unless driver has a second plane
+  u32Stride = psVideo->cap_bytesperline ? psVideo->cap_bytesperline : psVideo->cap_w;
+  pu8Y = psVideo->cap_buf_addr[psMaster->i32HWJpegCapIndex][0];
+  if(psVideo->cap_buf_num_planes > 1)
+    pu8UV = psVideo->cap_buf_addr[psMaster->i32HWJpegCapIndex][1];
+  else
+    pu8UV = pu8Y + ((size_t)u32Stride * psVideo->cap_h);
+
+  //cropped output starts at a whole CbCr pair
+  frame->y = pu8Y + psMaster->u32HWCropX;
+  frame->uv = pu8UV + (psMaster->u32HWCropX & ~1U);
+  frame->stride = u32Stride;
+  frame->width = cinfo->output_width;
+  frame->height = cinfo->output_height;
+
+  hw_detach_capture(cinfo, &frame->session, &frame->slot);
+  return 0;
+}
+
+GLOBAL(void)
+jpeg_release_raw_nv12(jpeg_hw_nv12 *frame)
+{
+  if(frame->session == NULL)
+    return;
+
+  hw_release_capture(frame->session, frame->slot);
+  frame->session = NULL;
+  frame->y = NULL;
+  frame->uv = NULL;
+}
+
+GLOBAL(int)
+jpeg_hw_output_buffer(j_decompress_ptr cinfo,
+                      JSAMPLE *outbuffer,
+                      size_t outsize,
+                      int dmabuf_fd)
+{
+  struct jpeg_decomp_master *psMaster = cinfo->master;   
+
+  if((outbuffer == NULL) || (outsize == 0))
+  {
+    psMaster->pu8HWUserBuf = NULL;
+    psMaster->u32HWUserBufSize = 0;
+    psMaster->bHWUserBufDmaBuf = FALSE;
+    return 0;
+  }
+
+  psMaster->pu8HWUserBuf = outbuffer;
+  psMaster->u32HWUserBufSize = outsize;
+  psMaster->i32HWUserDmaBufFd = dmabuf_fd;
+  psMaster->bHWUserBufDmaBuf = (dmabuf_fd >= 0) ? TRUE : FALSE;
+
+  return 0;
+}
+
 #endif
@@ -393,3 +393,68 @@ jpeg_mem_src(j_decompress_ptr cinfo, const unsigned char *inbuffer,
 #endif
 }
 #endif
+
+
+#ifdef WITH_VC8000
+
+#include "jpeglib_ext.h"
+
+/*
+ * Hardware bitstream buffer as data source.  The caller gets the mmapped
+ * bitstream buffer of a VC8000 decode session, fills it (recv(), read(), ...)
+ * and passes the length to jpeg_hw_stream_src(), so the image is not copied
+ * again before the hardware decode.
+ */
+
+GLOBAL(JOCTET *)
+jpeg_hw_stream_buffer(j_decompress_ptr cinfo, size_t size, size_t *bufsize)
+{
+  char *pchStreamBuf = NULL;
+  int i32BufSize;
+
+  *bufsize = 0;
+
+  if ((cinfo->master->bHWJpegDeocdeEnable != TRUE) || cinfo->master->bHWJpegJobPending)
+    return NULL;
+
+  //claim session now, output size and format are known only after jpeg_read_header()
+  if (!cinfo->master->bHWJpegCodecOpened) {
+    if (vc8000_backend()->open(&cinfo->master->psHWJpegVideo,
+                               &cinfo->master->i32HWJpegSlot,
+                               false, 0, 0, 0, (uint32_t)size) != 0)
+      return NULL;
+    cinfo->master->bHWJpegCodecOpened = TRUE;
+  }
+
+  if (vc8000_backend()->prepare_bitstream(cinfo->master->psHWJpegVideo, (uint32_t)size) != 0)
+    return NULL;
+
+  i32BufSize = vc8000_backend()->get_bitstream_buffer(cinfo->master->psHWJpegVideo,
+                                                      cinfo->master->i32HWJpegSlot,
+                                                      &pchStreamBuf);
+  if (pchStreamBuf == NULL)
+    return NULL;
+
+  *bufsize = (size_t)i32BufSize;
+  return (JOCTET *)pchStreamBuf;
+}
+
+GLOBAL(void)
+jpeg_hw_stream_src(j_decompress_ptr cinfo, unsigned long insize)
+{
+  char *pchStreamBuf = NULL;
+
+  if (!cinfo->master->bHWJpegCodecOpened)
+    ERREXIT(cinfo, JERR_INPUT_EMPTY);
+
+  vc8000_backend()->get_bitstream_buffer(cinfo->master->psHWJpegVideo,
+                                         cinfo->master->i32HWJpegSlot, &pchStreamBuf);
+  if (pchStreamBuf == NULL)
+    ERREXIT(cinfo, JERR_INPUT_EMPTY);
+
+  //software decoder reads the same buffer if hardware can't take the image
+  jpeg_mem_src(cinfo, (const unsigned char *)pchStreamBuf, insize);
+  cinfo->master->eJpegSrcType = eJPEG_SRC_HW_STREAM;
+}
+
+#endif
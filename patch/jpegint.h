@@ -17,7 +17,8 @@
  */
 
 #ifdef WITH_VC8000
-#include "vc8000_v4l2.h"		/* vc8000 hardware JPEG decoder support */
+#include "vc8000_backend.h"		/* vc8000 hardware JPEG decoder support */
+#include "vc8000_convert.h"
 #endif
 
 /* Declarations for both compression & decompression */
@@ -175,9 +176,22 @@ struct jpeg_direct_fb_param {
 typedef enum {
 	eJPEG_SRC_UNKNOWN,
 	eJPEG_SRC_MEM,	
-	eJPEG_SRC_FILE	
+	eJPEG_SRC_FILE,
+	eJPEG_SRC_HW_STREAM		/* bitstream written by caller into hardware buffer */
 }E_JPEG_SRC_TYPE;
 
+/* Stages of one decode, timed for jpeg_get_decode_stats() */
+typedef enum {
+	eJPEG_STAGE_OPEN,		/* claim decode session */
+	eJPEG_STAGE_SETUP,		/* buffer setup, decoder init */
+	eJPEG_STAGE_FILL,		/* bitstream fill */
+	eJPEG_STAGE_HW_DECODE,	/* hardware job submit to done */
+	eJPEG_STAGE_CONVERT,	/* pixel conversion out of capture buffer */
+	eJPEG_STAGE_SW_DECODE,	/* software decode */
+	eJPEG_STAGE_TEARDOWN,	/* release session */
+	eJPEG_STAGE_CNT
+}E_JPEG_STAGE;
+
 #endif
 
 /* Master control module */
@@ -207,17 +221,42 @@ struct jpeg_decomp_master {
 
   boolean bHWJpegCodecOpened;
   boolean bHWJpegDecodeDone;
+  boolean bHWJpegJobPending;    /* decode job submitted, not yet completed */
   boolean bHWJpegDeocdeEnable;
   
   unsigned char *pu8DecodedBuf;
   int i32PixelFormat;
   unsigned int u32DecodeImageWidth;
   unsigned int u32DecodeImageHeight;
+  PFN_VC8000_CONVERT_ROW pfnHWConvertRow;  /* capture row to scanline, by format */
+  JDIMENSION u32HWCropX;        /* left edge of jpeg_crop_scanline() output, in pixels */
 
-  struct video sHWJpegVideo;
+  struct video *psHWJpegVideo;  /* decode session taken from session pool */
+  int i32HWJpegSlot;            /* bitstream/capture buffer slot of session */
 
   boolean bHWJpegDirectFBEnable;
   struct jpeg_direct_fb_param sDirectFBParam;
+
+  /* Caller output buffer, decoded in place by hardware (zero-copy) */
+  JSAMPLE *pu8HWUserBuf;
+  size_t u32HWUserBufSize;
+  int i32HWUserDmaBufFd;
+  boolean bHWUserBufDmaBuf;     /* import i32HWUserDmaBufFd instead of USERPTR */
+  boolean bHWJpegZeroCopy;      /* current image decoded into pu8HWUserBuf */
+  int i32HWJpegCapIndex;        /* capture buffer holding current image */
+  unsigned int u32HWJpegDeadlineMs;  /* hardware decode deadline, 0: none */
+
+  /* HW/SW dispatch cost model */
+  int i32HWCostEngine;          /* engine measured for current image, E_VC8000_ENGINE */
+  int i32HWForceEngine;         /* engine forced by calibration, NONE: by cost model */
+  unsigned int u32HWCostKey;
+
+  /* Statistics of current image, see jpeg_get_decode_stats() */
+  boolean bHWStatsOpen;         /* image started, not yet added to totals */
+  int i32HWStatsEngine;         /* JPEG_HW_ENGINE_xxx */
+  int i32HWFallback;            /* JPEG_HW_FALLBACK_xxx */
+  int i32HWFallbackCode;        /* return code of failed step */
+  uint64_t au64HWStageNs[eJPEG_STAGE_CNT];
   
   JOCTET *pMemSrcBuf;
 #endif
@@ -10,6 +10,18 @@ extern "C" {
 #endif
 #endif
 
+/* VC8000 device node statistics */
+typedef struct {
+  char dev_name[32];                /* device node, e.g. /dev/video0 */
+  int inflight;                     /* decodes currently dispatched to node */
+  int max_inflight;
+  unsigned long jobs_submitted;
+  unsigned long jobs_done;
+  unsigned long jobs_failed;
+  unsigned long jobs_timeout;      /* jobs cancelled at deadline */
+  unsigned long long busy_ns;       /* time hardware held by decode jobs */
+} jpeg_hw_node_stats;
+
 EXTERN(void) jpeg_CreateDecompress_Ext(j_decompress_ptr cinfo, int version, size_t structsize, boolean enalbeHWDecode);
 
 EXTERN(int)
@@ -23,6 +35,237 @@ jpeg_fb_dest(j_decompress_ptr cinfo,
             unsigned int img_pos_y,
             JXFORM_CODE xform);
 
+/*
+ * Zero-copy output.  Register a contiguous buffer receiving the whole image
+ * with packed rows (output_width * pixel size bytes each).  If the output
+ * format is produced natively by the VC8000 post-processor (JCS_EXT_BGRA,
+ * JCS_EXT_BGRX, JCS_RGB565), the hardware output is exactly output_width wide
+ * and the buffer holds the hardware output size (height aligned to 16 rows, so
+ * 1920x1080 needs 1088 rows), the image is decoded straight into it: jpeg_read_scanlines() with top-down row pointers into the buffer does
+ * not touch the pixels.  Other row pointers into the buffer are served from a
+ * copy of the decoded image.  dmabuf_fd >= 0 imports a dmabuf (outbuffer
+ * is its CPU mapping), otherwise outbuffer is registered as user pointer.
+ * Otherwise decoding goes on as usual.  Pass NULL to unregister.
+ */
+EXTERN(int) jpeg_hw_output_buffer(j_decompress_ptr cinfo, JSAMPLE *outbuffer,
+                                  size_t outsize, int dmabuf_fd);
+
+/* Decoded frame exported as dmabuf */
+typedef struct {
+  int fd;                           /* dmabuf fd, owned by library */
+  unsigned int fourcc;              /* V4L2 pixel format (V4L2_PIX_FMT_ABGR32 is DRM_FORMAT_ARGB8888) */
+  unsigned int width;               /* frame size, may be padded beyond output size */
+  unsigned int height;
+  unsigned int stride;              /* bytes per row */
+  unsigned int offset;              /* byte offset of first output pixel */
+  size_t size;                      /* dmabuf size */
+  void *session;                    /* private */
+  int slot;                         /* private */
+} jpeg_hw_frame;
+
+/*
+ * Hand the capture buffer of a hardware decode over as dmabuf, instead of
+ * reading scanlines.  Call after jpeg_start_decompress() (waits for an async
+ * decode), returns 0 on success or <0 if the image is not in a capture
+ * buffer (software decode, jpeg_fb_dest(), jpeg_hw_output_buffer()).  On
+ * success all scanlines count as read, so jpeg_finish_decompress() can be
+ * called; the buffer stays out of rotation until jpeg_hw_release_frame().
+ */
+EXTERN(int) jpeg_hw_export_frame(j_decompress_ptr cinfo, jpeg_hw_frame *frame);
+EXTERN(void) jpeg_hw_release_frame(jpeg_hw_frame *frame);
+
+/* NV12 planes of a hardware decode, read in place */
+typedef struct {
+  JSAMPLE *y;                       /* first output pixel of Y plane */
+  JSAMPLE *uv;                      /* first output pixel pair of interleaved CbCr plane */
+  unsigned int stride;              /* bytes per row of both planes */
+  unsigned int width;               /* output size, chroma has (width + 1) / 2 pairs per row */
+  unsigned int height;              /* and (height + 1) / 2 rows */
+  void *session;                    /* private */
+  int slot;                         /* private */
+} jpeg_hw_nv12;
+
+/*
+ * Return the NV12 capture buffer of a hardware decode in place, instead of
+ * splitting it into planes with jpeg_read_raw_data() (4:2:0 JPEG with
+ * raw_data_out) or copying Y rows with jpeg_read_scanlines() (JCS_GRAYSCALE).
+ * Call after jpeg_start_decompress() before reading any line.  Returns 0 on
+ * success or <0 if the image was not decoded to NV12 by hardware; read the
+ * image as usual then.  On success all lines count as read, and the buffer
+ * stays out of the capture queue until jpeg_release_raw_nv12().
+ */
+EXTERN(int) jpeg_read_raw_nv12(j_decompress_ptr cinfo, jpeg_hw_nv12 *frame);
+EXTERN(void) jpeg_release_raw_nv12(jpeg_hw_nv12 *frame);
+
+/*
+ * Write the JPEG straight into the VC8000 bitstream buffer.  Before
+ * jpeg_read_header(), jpeg_hw_stream_buffer() returns the mmapped bitstream
+ * buffer (at least size bytes, actual size in *bufsize) of the decode session
+ * claimed for cinfo, or NULL if hardware is not available.  After filling it,
+ * jpeg_hw_stream_src() makes it the data source, the bitstream is then
+ * decoded in place.  The buffer belongs to cinfo until
+ * jpeg_finish_decompress()/jpeg_destroy_decompress().
+ */
+EXTERN(JOCTET *) jpeg_hw_stream_buffer(j_decompress_ptr cinfo, size_t size,
+                                       size_t *bufsize);
+EXTERN(void) jpeg_hw_stream_src(j_decompress_ptr cinfo, unsigned long insize);
+
+/*
+ * TRUE if the image will be decoded by VC8000, decided from the parsed header
+ * and output parameters only (call after jpeg_read_header() and setting
+ * out_color_space/scaling).  The device is not opened.
+ */
+EXTERN(boolean) jpeg_hw_can_decode(j_decompress_ptr cinfo);
+
+/*
+ * Asynchronous decompression. jpeg_start_decompress_async() returns a file
+ * descriptor which becomes readable when the VC8000 decode is done (-1 if the
+ * image is not decoded by hardware). jpeg_decompress_poll() returns TRUE once
+ * scanlines can be read, jpeg_decompress_wait() blocks until then.
+ */
+EXTERN(int) jpeg_start_decompress_async(j_decompress_ptr cinfo);
+EXTERN(boolean) jpeg_decompress_poll(j_decompress_ptr cinfo);
+EXTERN(boolean) jpeg_decompress_wait(j_decompress_ptr cinfo);
+
+/* Number of VC8000 device nodes used for load balancing */
+EXTERN(int) jpeg_hw_get_node_count(void);
+
+/* Statistics of VC8000 device node, return 0 on success */
+EXTERN(int) jpeg_hw_get_node_stats(int node, jpeg_hw_node_stats *stats);
+
+/*
+ * Pipelined mode. Images decoded to memory with the same output size and
+ * format share one VC8000 session with up to depth bitstream/capture buffer
+ * pairs in rotation (one per decompress object).  Hardware decodes the images
+ * back to back, while bitstream of next image is filled and scanlines of
+ * previous image are read.  Use several decompress objects (threads or
+ * jpeg_start_decompress_async()) to benefit.  Default depth is 1 (disabled).
+ */
+EXTERN(void) jpeg_hw_set_pipeline_depth(int depth);
+
+/*
+ * Decoder backend: "v4l2" (VC8000 driver, default) or "emu" (in-process
+ * emulator decoding by software into the VC8000 output layouts, to run the
+ * hardware path on machines without VC8000).  Environment variable
+ * VC8000_BACKEND selects it at first use.  Call before the first decode.
+ * Return 0, or -1 if the name is unknown.
+ */
+EXTERN(int) jpeg_hw_set_backend(const char *name);
+
+/*
+ * Hardware decode deadline of this decompress object in milliseconds, counted
+ * from job submission.  If VC8000 has not finished by then, the job is
+ * cancelled and the image is decoded by software.  0 (default) waits forever.
+ */
+EXTERN(void) jpeg_hw_set_deadline(j_decompress_ptr cinfo, unsigned int timeout_ms);
+
+/*
+ * HW/SW dispatch.  With JPEG_HW_DISPATCH_COST_MODEL (default), decode latency
+ * of VC8000 and software is measured per image class (source size, scale,
+ * output format and subsampling) and each image decoded to memory goes to
+ * the faster engine.  New classes are calibrated by the first decodes, or
+ * ahead of time by jpeg_hw_calibrate() with a representative image.  The
+ * model can be exported and imported on identical boards; the file named by
+ * environment variable VC8000_COSTMODEL_FILE is imported at first use.
+ * JPEG_HW_DISPATCH_HW uses the hardware for every decodable image.
+ * Frame buffer output always uses the hardware.
+ */
+#define JPEG_HW_DISPATCH_HW          0
+#define JPEG_HW_DISPATCH_COST_MODEL  1
+
+EXTERN(void) jpeg_hw_set_dispatch(int mode);
+EXTERN(int) jpeg_hw_calibrate(const unsigned char *jpeg_buf,
+                              unsigned long jpeg_size,
+                              J_COLOR_SPACE out_color_space,
+                              unsigned int scale_num,
+                              unsigned int scale_denom, int runs);
+/* Return number of model entries written/read, or -1 */
+EXTERN(int) jpeg_hw_export_cost_model(const char *path);
+EXTERN(int) jpeg_hw_import_cost_model(const char *path);
+
+/*
+ * Conversion of hardware decoded rows into scanlines on several threads.  A
+ * jpeg_read_scanlines() call of at least min_pixels output pixels is split
+ * into cache sized stripes converted by the caller and threads - 1 pool
+ * workers (at most 8 threads in total).  The pool converts one image at a
+ * time, concurrent reads convert on their own thread.  Default is 1 thread
+ * (disabled), environment variable VC8000_CONVERT_THREADS sets the thread
+ * count at first use.
+ */
+EXTERN(void) jpeg_hw_set_convert_threads(int threads, unsigned int min_pixels);
+
+/*
+ * Write V4L2 event trace of library built with -DWITH_VC8000_TRACE=1 (see
+ * vc8000_trace.h). Return number of records written, or -1
+ */
+EXTERN(int) jpeg_hw_trace_dump(const char *path);
+
+/* Engine which decoded the image */
+#define JPEG_HW_ENGINE_HW  1
+#define JPEG_HW_ENGINE_SW  2
+
+/* Why the image was decoded by software */
+typedef enum {
+  JPEG_HW_FALLBACK_NONE = 0,        /* decoded by VC8000 */
+  JPEG_HW_FALLBACK_DISABLED,        /* hardware decode disabled on object */
+  JPEG_HW_FALLBACK_RAW_SUBSAMPLING, /* no capture format holds the raw samples (4:4:0, 4:1:1) */
+  JPEG_HW_FALLBACK_COLOR_SPACE,     /* out_color_space not supported */
+  JPEG_HW_FALLBACK_TOO_SMALL,       /* output smaller than 64x64 */
+  JPEG_HW_FALLBACK_SCALE,           /* width and height scaled in different direction */
+  JPEG_HW_FALLBACK_COST_MODEL,      /* software is faster for this image class */
+  JPEG_HW_FALLBACK_DEVICE,          /* no decode session available */
+  JPEG_HW_FALLBACK_SETUP,           /* buffer setup failed */
+  JPEG_HW_FALLBACK_BITSTREAM,       /* bitstream too large or source not supported */
+  JPEG_HW_FALLBACK_QUEUE,           /* job submit failed */
+  JPEG_HW_FALLBACK_DECODE,          /* hardware decode error */
+  JPEG_HW_FALLBACK_TIMEOUT,         /* deadline passed, see jpeg_hw_set_deadline() */
+  JPEG_HW_NUM_FALLBACK
+} JPEG_HW_FALLBACK;
+
+/* Statistics of the current/last image of a decompress object, times in ns */
+typedef struct {
+  int engine;                       /* JPEG_HW_ENGINE_xxx */
+  int fallback;                     /* JPEG_HW_FALLBACK_xxx */
+  int fallback_code;                /* internal return code of failed step */
+  unsigned long long open_ns;       /* claim decode session */
+  unsigned long long setup_ns;      /* buffer setup and decoder init */
+  unsigned long long fill_ns;       /* bitstream fill */
+  unsigned long long hw_decode_ns;  /* hardware job, submit to done */
+  unsigned long long convert_ns;    /* pixel conversion out of capture buffer */
+  unsigned long long sw_decode_ns;  /* software decode */
+  unsigned long long teardown_ns;   /* release session */
+} jpeg_decode_stats;
+
+/* Process-wide totals of images finished by jpeg_finish_decompress() */
+typedef struct {
+  unsigned long images;
+  unsigned long hw_images;
+  unsigned long sw_images;
+  unsigned long fallback[JPEG_HW_NUM_FALLBACK];
+  unsigned long long open_ns;
+  unsigned long long setup_ns;
+  unsigned long long fill_ns;
+  unsigned long long hw_decode_ns;
+  unsigned long long convert_ns;
+  unsigned long long sw_decode_ns;
+  unsigned long long teardown_ns;
+} jpeg_decode_totals;
+
+/*
+ * Valid after jpeg_start_decompress(); teardown and the final conversion
+ * time are added by jpeg_finish_decompress().
+ */
+EXTERN(void) jpeg_get_decode_stats(j_decompress_ptr cinfo,
+                                   jpeg_decode_stats *stats);
+EXTERN(void) jpeg_get_decode_totals(jpeg_decode_totals *totals);
+EXTERN(void) jpeg_reset_decode_totals(void);
+
+/*
+ * Statistics of the last image finished on the calling thread, for wrappers
+ * which own the decompress object (TurboJPEG).  engine is 0 if the thread has
+ * not finished an image yet.
+ */
+EXTERN(void) jpeg_get_thread_decode_stats(jpeg_decode_stats *stats);
 
 #ifdef __cplusplus
 #ifndef DONT_USE_EXTERN_C
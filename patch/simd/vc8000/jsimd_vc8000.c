@@ -0,0 +1,176 @@
+/**
+ * @file jsimd_vc8000.c: VC8000 conversion kernel dispatch and C kernels
+ *
+ * Copyright (C) 2021 nuvoton
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "jsimd_vc8000.h"
+
+/* Force kernel table by name */
+#define SIMD_ENV_NAME		"VC8000_SIMD"
+
+static const struct vc8000_simd_kernels *s_psBestKernels = NULL;
+static pthread_once_t s_tSimdOnce = PTHREAD_ONCE_INIT;
+
+void vc8000_simd_c_swizzle4to3(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	uint8_t u8Order0 = pu8Order[0];
+	uint8_t u8Order1 = pu8Order[1];
+	uint8_t u8Order2 = pu8Order[2];
+	uint32_t i;
+
+	for(i = 0; i < u32Pixels; i ++) {
+		pu8Dst[0] = pu8Src[u8Order0];
+		pu8Dst[1] = pu8Src[u8Order1];
+		pu8Dst[2] = pu8Src[u8Order2];
+		pu8Src += 4;
+		pu8Dst += 3;
+	}
+}
+
+void vc8000_simd_c_swizzle4to4(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	uint8_t u8Order0 = pu8Order[0];
+	uint8_t u8Order1 = pu8Order[1];
+	uint8_t u8Order2 = pu8Order[2];
+	uint8_t u8Order3 = pu8Order[3];
+	uint32_t i;
+
+	for(i = 0; i < u32Pixels; i ++) {
+		pu8Dst[0] = pu8Src[u8Order0];
+		pu8Dst[1] = pu8Src[u8Order1];
+		pu8Dst[2] = pu8Src[u8Order2];
+		pu8Dst[3] = pu8Src[u8Order3];
+		pu8Src += 4;
+		pu8Dst += 4;
+	}
+}
+
+void vc8000_simd_c_copy(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Bytes
+)
+{
+	memcpy(pu8Dst, pu8Src, u32Bytes);
+}
+
+void vc8000_simd_c_deinterleave2(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst0,
+	uint8_t *pu8Dst1,
+	uint32_t u32Pairs
+)
+{
+	uint32_t i;
+
+	for(i = 0; i < u32Pairs; i ++) {
+		pu8Dst0[i] = pu8Src[0];
+		pu8Dst1[i] = pu8Src[1];
+		pu8Src += 2;
+	}
+}
+
+void vc8000_simd_c_deinterleave_yuyv(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Y,
+	uint8_t *pu8C1,
+	uint8_t *pu8C3,
+	uint32_t u32Pixels
+)
+{
+	uint32_t u32Pairs = u32Pixels / 2;
+	uint32_t i;
+
+	for(i = 0; i < u32Pairs; i ++) {
+		pu8Y[0] = pu8Src[0];
+		pu8Y[1] = pu8Src[2];
+		pu8C1[i] = pu8Src[1];
+		pu8C3[i] = pu8Src[3];
+		pu8Src += 4;
+		pu8Y += 2;
+	}
+
+	//last pixel pair is complete in the capture row
+	if(u32Pixels & 1) {
+		pu8Y[0] = pu8Src[0];
+		pu8C1[i] = pu8Src[1];
+		pu8C3[i] = pu8Src[3];
+	}
+}
+
+static const struct vc8000_simd_kernels s_sCKernels = {
+	.name = "c",
+	.swizzle4to3 = vc8000_simd_c_swizzle4to3,
+	.swizzle4to4 = vc8000_simd_c_swizzle4to4,
+	.copy = vc8000_simd_c_copy,
+	.deinterleave2 = vc8000_simd_c_deinterleave2,
+	.deinterleave_yuyv = vc8000_simd_c_deinterleave_yuyv,
+};
+
+const struct vc8000_simd_kernels *vc8000_simd_get(
+	E_VC8000_SIMD eSimd
+)
+{
+	switch(eSimd) {
+	case eVC8000_SIMD_C:
+		return &s_sCKernels;
+	case eVC8000_SIMD_SSSE3:
+	case eVC8000_SIMD_AVX2:
+		return vc8000_simd_x86_get(eSimd);
+	case eVC8000_SIMD_NEON:
+		return vc8000_simd_neon_get();
+	default:
+		break;
+	}
+
+	return NULL;
+}
+
+static void vc8000_simd_init(void)
+{
+	const char *szName = getenv(SIMD_ENV_NAME);
+	const struct vc8000_simd_kernels *psKernels;
+	int i;
+
+	if(szName && szName[0]) {
+		for(i = 0; i < eVC8000_SIMD_CNT; i ++) {
+			psKernels = vc8000_simd_get((E_VC8000_SIMD)i);
+			if(psKernels && (strcmp(psKernels->name, szName) == 0)) {
+				s_psBestKernels = psKernels;
+				return;
+			}
+		}
+
+		fprintf(stderr, "VC8000 SIMD %s not supported \n", szName);
+	}
+
+	//later instruction sets are faster
+	s_psBestKernels = &s_sCKernels;
+	for(i = eVC8000_SIMD_C + 1; i < eVC8000_SIMD_CNT; i ++) {
+		psKernels = vc8000_simd_get((E_VC8000_SIMD)i);
+		if(psKernels)
+			s_psBestKernels = psKernels;
+	}
+}
+
+const struct vc8000_simd_kernels *vc8000_simd_best(void)
+{
+	pthread_once(&s_tSimdOnce, vc8000_simd_init);
+	return s_psBestKernels;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file jsimd_vc8000.h VC8000 capture buffer conversion kernels
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Byte swizzle and copy kernels converting VC8000 capture rows to scanlines,
+ * and deinterleave kernels splitting NV12/NV24/YUYV rows into raw data
+ * planes.
+ * Each instruction set has its own kernel table; vc8000_simd_best() picks the
+ * fastest one supported by the CPU at first use. Environment variable
+ * VC8000_SIMD (c, ssse3, avx2, neon) forces a table. All tables are bit exact
+ * to the C kernels.
+ */
+
+#ifndef __JSIMD_VC8000_H__
+#define __JSIMD_VC8000_H__
+
+#include <inttypes.h>
+
+typedef enum {
+	eVC8000_SIMD_C = 0,
+	eVC8000_SIMD_SSSE3,
+	eVC8000_SIMD_AVX2,
+	eVC8000_SIMD_NEON,
+	eVC8000_SIMD_CNT,
+} E_VC8000_SIMD;
+
+/*
+ * pu8Order gives the source byte (0..3) of each destination byte of a pixel,
+ * e.g. {2, 1, 0} converts BGRA to RGB.
+ */
+struct vc8000_simd_kernels {
+	const char *name;
+
+	//4 bytes pixel to 3 bytes pixel
+	void (*swizzle4to3)(const uint8_t *pu8Src, uint8_t *pu8Dst, uint32_t u32Pixels, const uint8_t *pu8Order);
+
+	//4 bytes pixel to 4 bytes pixel
+	void (*swizzle4to4)(const uint8_t *pu8Src, uint8_t *pu8Dst, uint32_t u32Pixels, const uint8_t *pu8Order);
+
+	void (*copy)(const uint8_t *pu8Src, uint8_t *pu8Dst, uint32_t u32Bytes);
+
+	//byte pairs to two planes (NV12 CbCr row)
+	void (*deinterleave2)(const uint8_t *pu8Src, uint8_t *pu8Dst0, uint8_t *pu8Dst1, uint32_t u32Pairs);
+
+	//YUYV row to planes: bytes 0 and 2 of each pixel pair to pu8Y, byte 1 to
+	//pu8C1, byte 3 to pu8C3. Odd u32Pixels also fill chroma of the last pair
+	void (*deinterleave_yuyv)(const uint8_t *pu8Src, uint8_t *pu8Y, uint8_t *pu8C1, uint8_t *pu8C3, uint32_t u32Pixels);
+};
+
+//Kernel table of instruction set, NULL if not built in or not supported by CPU
+const struct vc8000_simd_kernels *vc8000_simd_get(
+	E_VC8000_SIMD eSimd
+);
+
+//Fastest kernel table of this CPU, or the one forced by VC8000_SIMD
+const struct vc8000_simd_kernels *vc8000_simd_best(void);
+
+/* Generic C kernels, also used for the row tails of SIMD kernels */
+void vc8000_simd_c_swizzle4to3(const uint8_t *pu8Src, uint8_t *pu8Dst, uint32_t u32Pixels, const uint8_t *pu8Order);
+void vc8000_simd_c_swizzle4to4(const uint8_t *pu8Src, uint8_t *pu8Dst, uint32_t u32Pixels, const uint8_t *pu8Order);
+void vc8000_simd_c_copy(const uint8_t *pu8Src, uint8_t *pu8Dst, uint32_t u32Bytes);
+void vc8000_simd_c_deinterleave2(const uint8_t *pu8Src, uint8_t *pu8Dst0, uint8_t *pu8Dst1, uint32_t u32Pairs);
+void vc8000_simd_c_deinterleave_yuyv(const uint8_t *pu8Src, uint8_t *pu8Y, uint8_t *pu8C1, uint8_t *pu8C3, uint32_t u32Pixels);
+
+/* Tables of jsimd_vc8000_x86.c and jsimd_vc8000_neon.c, NULL if not built in */
+const struct vc8000_simd_kernels *vc8000_simd_x86_get(E_VC8000_SIMD eSimd);
+const struct vc8000_simd_kernels *vc8000_simd_neon_get(void);
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * @file jsimd_vc8000_neon.c: NEON VC8000 conversion kernels
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * vld4 splits 16 pixels into byte planes, the planes are stored back in
+ * destination order by vst3/vst4. NV12 chroma and YUYV rows are split into
+ * planes by vld2/vld4. On AArch64 the copy kernel streams 64 bytes
+ * per iteration with non-temporal ldnp/stnp.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "jsimd_vc8000.h"
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+
+#include <arm_neon.h>
+
+/*
+Plane indices of vld4 result must be constants: a runtime index into
+uint8x16x4_t makes the compiler keep it on the stack and reload it every 16
+pixels. The loops are inlined with the orders of vc8000_convert.c, other
+orders are converted by the C kernels.
+*/
+static inline __attribute__((always_inline)) uint32_t vc8000_neon_swizzle4to3_loop(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	uint8_t u8Order0,
+	uint8_t u8Order1,
+	uint8_t u8Order2
+)
+{
+	uint32_t i = 0;
+
+	for(; i + 16 <= u32Pixels; i += 16) {
+		uint8x16x4_t sIn = vld4q_u8(pu8Src);
+		uint8x16x3_t sOut;
+
+		sOut.val[0] = sIn.val[u8Order0];
+		sOut.val[1] = sIn.val[u8Order1];
+		sOut.val[2] = sIn.val[u8Order2];
+		vst3q_u8(pu8Dst, sOut);
+
+		pu8Src += 64;
+		pu8Dst += 48;
+	}
+
+	return i;
+}
+
+static inline __attribute__((always_inline)) uint32_t vc8000_neon_swizzle4to4_loop(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	uint8_t u8Order0,
+	uint8_t u8Order1,
+	uint8_t u8Order2,
+	uint8_t u8Order3
+)
+{
+	uint32_t i = 0;
+
+	for(; i + 16 <= u32Pixels; i += 16) {
+		uint8x16x4_t sIn = vld4q_u8(pu8Src);
+		uint8x16x4_t sOut;
+
+		sOut.val[0] = sIn.val[u8Order0];
+		sOut.val[1] = sIn.val[u8Order1];
+		sOut.val[2] = sIn.val[u8Order2];
+		sOut.val[3] = sIn.val[u8Order3];
+		vst4q_u8(pu8Dst, sOut);
+
+		pu8Src += 64;
+		pu8Dst += 64;
+	}
+
+	return i;
+}
+
+static void vc8000_neon_swizzle4to3(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	uint8_t u8Order0 = pu8Order[0];
+	uint8_t u8Order1 = pu8Order[1];
+	uint8_t u8Order2 = pu8Order[2];
+	uint32_t i = 0;
+
+	//BGRA -> RGB, BGRA -> BGR
+	if((u8Order0 == 2) && (u8Order1 == 1) && (u8Order2 == 0))
+		i = vc8000_neon_swizzle4to3_loop(pu8Src, pu8Dst, u32Pixels, 2, 1, 0);
+	else if((u8Order0 == 0) && (u8Order1 == 1) && (u8Order2 == 2))
+		i = vc8000_neon_swizzle4to3_loop(pu8Src, pu8Dst, u32Pixels, 0, 1, 2);
+
+	vc8000_simd_c_swizzle4to3(pu8Src + (i * 4), pu8Dst + (i * 3), u32Pixels - i, pu8Order);
+}
+
+static void vc8000_neon_swizzle4to4(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	uint8_t u8Order0 = pu8Order[0];
+	uint8_t u8Order1 = pu8Order[1];
+	uint8_t u8Order2 = pu8Order[2];
+	uint8_t u8Order3 = pu8Order[3];
+	uint32_t i = 0;
+
+	//byte reverse (BGRA <-> ARGB) needs no plane split
+	if((u8Order0 == 3) && (u8Order1 == 2) && (u8Order2 == 1) && (u8Order3 == 0)) {
+		for(; i + 16 <= u32Pixels; i += 16) {
+			vst1q_u8(pu8Dst, vrev32q_u8(vld1q_u8(pu8Src)));
+			vst1q_u8(pu8Dst + 16, vrev32q_u8(vld1q_u8(pu8Src + 16)));
+			vst1q_u8(pu8Dst + 32, vrev32q_u8(vld1q_u8(pu8Src + 32)));
+			vst1q_u8(pu8Dst + 48, vrev32q_u8(vld1q_u8(pu8Src + 48)));
+
+			pu8Src += 64;
+			pu8Dst += 64;
+		}
+	}
+	//BGRA -> RGBA, BGRA -> ABGR
+	else if((u8Order0 == 2) && (u8Order1 == 1) && (u8Order2 == 0) && (u8Order3 == 3)) {
+		i = vc8000_neon_swizzle4to4_loop(pu8Src, pu8Dst, u32Pixels, 2, 1, 0, 3);
+		pu8Src += i * 4;
+		pu8Dst += i * 4;
+	}
+	else if((u8Order0 == 3) && (u8Order1 == 0) && (u8Order2 == 1) && (u8Order3 == 2)) {
+		i = vc8000_neon_swizzle4to4_loop(pu8Src, pu8Dst, u32Pixels, 3, 0, 1, 2);
+		pu8Src += i * 4;
+		pu8Dst += i * 4;
+	}
+
+	vc8000_simd_c_swizzle4to4(pu8Src, pu8Dst, u32Pixels - i, pu8Order);
+}
+
+static void vc8000_neon_deinterleave2(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst0,
+	uint8_t *pu8Dst1,
+	uint32_t u32Pairs
+)
+{
+	uint32_t i = 0;
+
+	for(; i + 16 <= u32Pairs; i += 16) {
+		uint8x16x2_t sIn = vld2q_u8(pu8Src);
+
+		vst1q_u8(pu8Dst0 + i, sIn.val[0]);
+		vst1q_u8(pu8Dst1 + i, sIn.val[1]);
+		pu8Src += 32;
+	}
+
+	vc8000_simd_c_deinterleave2(pu8Src, pu8Dst0 + i, pu8Dst1 + i, u32Pairs - i);
+}
+
+static void vc8000_neon_deinterleave_yuyv(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Y,
+	uint8_t *pu8C1,
+	uint8_t *pu8C3,
+	uint32_t u32Pixels
+)
+{
+	uint32_t u32Pairs = u32Pixels / 2;
+	uint32_t i = 0;
+
+	//16 pixel pairs: Y0 C1 Y1 C3 planes, Y planes interleaved back
+	for(; i + 16 <= u32Pairs; i += 16) {
+		uint8x16x4_t sIn = vld4q_u8(pu8Src);
+		uint8x16x2_t sY;
+
+		sY.val[0] = sIn.val[0];
+		sY.val[1] = sIn.val[2];
+		vst2q_u8(pu8Y + (i * 2), sY);
+		vst1q_u8(pu8C1 + i, sIn.val[1]);
+		vst1q_u8(pu8C3 + i, sIn.val[3]);
+		pu8Src += 64;
+	}
+
+	vc8000_simd_c_deinterleave_yuyv(pu8Src, pu8Y + (i * 2), pu8C1 + i, pu8C3 + i, u32Pixels - (i * 2));
+}
+
+#if defined (__aarch64__)
+//from https://www.twblogs.net/a/5ef44dd90cb8aa7778837d67
+// size must multiple of 64
+static void _memcpy_fast(volatile void *dst, volatile void *src, int sz)
+{
+    asm volatile (
+        "NEONCopyPLD: \n"
+		"sub %[dst], %[dst], #64 \n"
+		"1: \n"
+		"ldnp q0, q1, [%[src]] \n"
+		"ldnp q2, q3, [%[src], #32] \n"
+		"add %[dst], %[dst], #64 \n"
+		"subs %[sz], %[sz], #64 \n"
+		"add %[src], %[src], #64 \n"
+		"stnp q0, q1, [%[dst]] \n"
+		"stnp q2, q3, [%[dst], #32] \n"
+		"b.gt 1b \n"
+		: [dst]"+r"(dst), [src]"+r"(src), [sz]"+r"(sz) : : "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "cc", "memory");
+}
+
+static void vc8000_neon_copy(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Bytes
+)
+{
+	uint32_t u32FastCopyBytes = u32Bytes & ~63U;
+
+	if(u32FastCopyBytes)
+		_memcpy_fast(pu8Dst, (void *)pu8Src, u32FastCopyBytes);
+
+	if(u32Bytes - u32FastCopyBytes)
+		memcpy(pu8Dst + u32FastCopyBytes, pu8Src + u32FastCopyBytes, u32Bytes - u32FastCopyBytes);
+}
+#else
+#define vc8000_neon_copy	vc8000_simd_c_copy
+#endif
+
+static const struct vc8000_simd_kernels s_sNEONKernels = {
+	.name = "neon",
+	.swizzle4to3 = vc8000_neon_swizzle4to3,
+	.swizzle4to4 = vc8000_neon_swizzle4to4,
+	.copy = vc8000_neon_copy,
+	.deinterleave2 = vc8000_neon_deinterleave2,
+	.deinterleave_yuyv = vc8000_neon_deinterleave_yuyv,
+};
+
+const struct vc8000_simd_kernels *vc8000_simd_neon_get(void)
+{
+	return &s_sNEONKernels;
+}
+
+#else
+
+const struct vc8000_simd_kernels *vc8000_simd_neon_get(void)
+{
+	return NULL;
+}
+
+#endif
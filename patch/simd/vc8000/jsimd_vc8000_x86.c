@@ -0,0 +1,279 @@
+/**
+ * @file jsimd_vc8000_x86.c: SSSE3/AVX2 VC8000 conversion kernels
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Built for any x86 target; kernels are compiled with target attributes and
+ * only handed out when the CPU reports the instruction set. pshufb moves the
+ * bytes of each pixel, 4 to 3 bytes kernels pack the 12 bytes of every 4
+ * pixels with byte shifts (SSSE3) or a dword permute (AVX2). Deinterleave
+ * kernels gather the bytes of each plane with pshufb and unpack the halves.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "jsimd_vc8000.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+
+#include <immintrin.h>
+
+//pshufb control of 4 pixels, 4 to 3 bytes. Top 4 bytes are zeroed
+static void vc8000_x86_mask4to3(
+	const uint8_t *pu8Order,
+	uint8_t *pu8Mask
+)
+{
+	int i;
+
+	for(i = 0; i < 16; i ++)
+		pu8Mask[i] = (i < 12) ? (((i / 3) * 4) + pu8Order[i % 3]) : 0x80;
+}
+
+//pshufb control of 4 pixels, 4 to 4 bytes
+static void vc8000_x86_mask4to4(
+	const uint8_t *pu8Order,
+	uint8_t *pu8Mask
+)
+{
+	int i;
+
+	for(i = 0; i < 16; i ++)
+		pu8Mask[i] = ((i / 4) * 4) + pu8Order[i % 4];
+}
+
+__attribute__((target("ssse3")))
+static void vc8000_ssse3_swizzle4to3(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	uint8_t au8Mask[16];
+	__m128i xMask;
+	uint32_t i = 0;
+
+	vc8000_x86_mask4to3(pu8Order, au8Mask);
+	xMask = _mm_loadu_si128((const __m128i *)au8Mask);
+
+	//16 pixels: 64 bytes in, 48 bytes out
+	for(; i + 16 <= u32Pixels; i += 16) {
+		__m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 0)), xMask);
+		__m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 16)), xMask);
+		__m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 32)), xMask);
+		__m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 48)), xMask);
+
+		_mm_storeu_si128((__m128i *)(pu8Dst + 0), _mm_or_si128(x0, _mm_slli_si128(x1, 12)));
+		_mm_storeu_si128((__m128i *)(pu8Dst + 16), _mm_or_si128(_mm_srli_si128(x1, 4), _mm_slli_si128(x2, 8)));
+		_mm_storeu_si128((__m128i *)(pu8Dst + 32), _mm_or_si128(_mm_srli_si128(x2, 8), _mm_slli_si128(x3, 4)));
+
+		pu8Src += 64;
+		pu8Dst += 48;
+	}
+
+	vc8000_simd_c_swizzle4to3(pu8Src, pu8Dst, u32Pixels - i, pu8Order);
+}
+
+__attribute__((target("ssse3")))
+static void vc8000_ssse3_swizzle4to4(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	uint8_t au8Mask[16];
+	__m128i xMask;
+	uint32_t i = 0;
+
+	vc8000_x86_mask4to4(pu8Order, au8Mask);
+	xMask = _mm_loadu_si128((const __m128i *)au8Mask);
+
+	for(; i + 16 <= u32Pixels; i += 16) {
+		__m128i x0 = _mm_loadu_si128((const __m128i *)(pu8Src + 0));
+		__m128i x1 = _mm_loadu_si128((const __m128i *)(pu8Src + 16));
+		__m128i x2 = _mm_loadu_si128((const __m128i *)(pu8Src + 32));
+		__m128i x3 = _mm_loadu_si128((const __m128i *)(pu8Src + 48));
+
+		_mm_storeu_si128((__m128i *)(pu8Dst + 0), _mm_shuffle_epi8(x0, xMask));
+		_mm_storeu_si128((__m128i *)(pu8Dst + 16), _mm_shuffle_epi8(x1, xMask));
+		_mm_storeu_si128((__m128i *)(pu8Dst + 32), _mm_shuffle_epi8(x2, xMask));
+		_mm_storeu_si128((__m128i *)(pu8Dst + 48), _mm_shuffle_epi8(x3, xMask));
+
+		pu8Src += 64;
+		pu8Dst += 64;
+	}
+
+	vc8000_simd_c_swizzle4to4(pu8Src, pu8Dst, u32Pixels - i, pu8Order);
+}
+
+__attribute__((target("avx2")))
+static void vc8000_avx2_swizzle4to3(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	uint8_t au8Mask[16];
+	__m256i yMask;
+	__m256i yPack;
+	uint32_t i = 0;
+	int k;
+
+	vc8000_x86_mask4to3(pu8Order, au8Mask);
+	yMask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)au8Mask));
+
+	//12 bytes of each lane to low 24 bytes
+	yPack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+	//32 pixels: 128 bytes in, 96 bytes out
+	for(; i + 32 <= u32Pixels; i += 32) {
+		for(k = 0; k < 4; k ++) {
+			__m256i y0 = _mm256_loadu_si256((const __m256i *)(pu8Src + (k * 32)));
+
+			y0 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(y0, yMask), yPack);
+			_mm_storeu_si128((__m128i *)(pu8Dst + (k * 24)), _mm256_castsi256_si128(y0));
+			_mm_storel_epi64((__m128i *)(pu8Dst + (k * 24) + 16), _mm256_extracti128_si256(y0, 1));
+		}
+
+		pu8Src += 128;
+		pu8Dst += 96;
+	}
+
+	vc8000_ssse3_swizzle4to3(pu8Src, pu8Dst, u32Pixels - i, pu8Order);
+}
+
+__attribute__((target("avx2")))
+static void vc8000_avx2_swizzle4to4(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	uint8_t au8Mask[16];
+	__m256i yMask;
+	uint32_t i = 0;
+
+	vc8000_x86_mask4to4(pu8Order, au8Mask);
+	yMask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)au8Mask));
+
+	for(; i + 32 <= u32Pixels; i += 32) {
+		__m256i y0 = _mm256_loadu_si256((const __m256i *)(pu8Src + 0));
+		__m256i y1 = _mm256_loadu_si256((const __m256i *)(pu8Src + 32));
+		__m256i y2 = _mm256_loadu_si256((const __m256i *)(pu8Src + 64));
+		__m256i y3 = _mm256_loadu_si256((const __m256i *)(pu8Src + 96));
+
+		_mm256_storeu_si256((__m256i *)(pu8Dst + 0), _mm256_shuffle_epi8(y0, yMask));
+		_mm256_storeu_si256((__m256i *)(pu8Dst + 32), _mm256_shuffle_epi8(y1, yMask));
+		_mm256_storeu_si256((__m256i *)(pu8Dst + 64), _mm256_shuffle_epi8(y2, yMask));
+		_mm256_storeu_si256((__m256i *)(pu8Dst + 96), _mm256_shuffle_epi8(y3, yMask));
+
+		pu8Src += 128;
+		pu8Dst += 128;
+	}
+
+	vc8000_ssse3_swizzle4to4(pu8Src, pu8Dst, u32Pixels - i, pu8Order);
+}
+
+__attribute__((target("ssse3")))
+static void vc8000_ssse3_deinterleave2(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst0,
+	uint8_t *pu8Dst1,
+	uint32_t u32Pairs
+)
+{
+	//even bytes to low 8 bytes, odd bytes to high 8 bytes
+	const __m128i xSplit = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+	uint32_t i = 0;
+
+	for(; i + 16 <= u32Pairs; i += 16) {
+		__m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 0)), xSplit);
+		__m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 16)), xSplit);
+
+		_mm_storeu_si128((__m128i *)(pu8Dst0 + i), _mm_unpacklo_epi64(x0, x1));
+		_mm_storeu_si128((__m128i *)(pu8Dst1 + i), _mm_unpackhi_epi64(x0, x1));
+		pu8Src += 32;
+	}
+
+	vc8000_simd_c_deinterleave2(pu8Src, pu8Dst0 + i, pu8Dst1 + i, u32Pairs - i);
+}
+
+__attribute__((target("ssse3")))
+static void vc8000_ssse3_deinterleave_yuyv(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Y,
+	uint8_t *pu8C1,
+	uint8_t *pu8C3,
+	uint32_t u32Pixels
+)
+{
+	//Y bytes to low 8 bytes, byte 1 of pairs to bytes 8..11, byte 3 to bytes 12..15
+	const __m128i xSplit = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 5, 9, 13, 3, 7, 11, 15);
+	uint32_t u32Pairs = u32Pixels / 2;
+	uint32_t i = 0;
+
+	//16 pixel pairs: 64 bytes in, 32 Y bytes, 16 bytes of each chroma plane out
+	for(; i + 16 <= u32Pairs; i += 16) {
+		__m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 0)), xSplit);
+		__m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 16)), xSplit);
+		__m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 32)), xSplit);
+		__m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pu8Src + 48)), xSplit);
+		__m128i xC01 = _mm_unpackhi_epi32(x0, x1);	//C1 x0, C1 x1, C3 x0, C3 x1
+		__m128i xC23 = _mm_unpackhi_epi32(x2, x3);
+
+		_mm_storeu_si128((__m128i *)(pu8Y + (i * 2)), _mm_unpacklo_epi64(x0, x1));
+		_mm_storeu_si128((__m128i *)(pu8Y + (i * 2) + 16), _mm_unpacklo_epi64(x2, x3));
+		_mm_storeu_si128((__m128i *)(pu8C1 + i), _mm_unpacklo_epi64(xC01, xC23));
+		_mm_storeu_si128((__m128i *)(pu8C3 + i), _mm_unpackhi_epi64(xC01, xC23));
+		pu8Src += 64;
+	}
+
+	vc8000_simd_c_deinterleave_yuyv(pu8Src, pu8Y + (i * 2), pu8C1 + i, pu8C3 + i, u32Pixels - (i * 2));
+}
+
+//libc memcpy already picks the widest vector copy of the CPU. Deinterleave
+//kernels are memory bound, AVX2 table shares the SSSE3 ones
+static const struct vc8000_simd_kernels s_sSSSE3Kernels = {
+	.name = "ssse3",
+	.swizzle4to3 = vc8000_ssse3_swizzle4to3,
+	.swizzle4to4 = vc8000_ssse3_swizzle4to4,
+	.copy = vc8000_simd_c_copy,
+	.deinterleave2 = vc8000_ssse3_deinterleave2,
+	.deinterleave_yuyv = vc8000_ssse3_deinterleave_yuyv,
+};
+
+static const struct vc8000_simd_kernels s_sAVX2Kernels = {
+	.name = "avx2",
+	.swizzle4to3 = vc8000_avx2_swizzle4to3,
+	.swizzle4to4 = vc8000_avx2_swizzle4to4,
+	.copy = vc8000_simd_c_copy,
+	.deinterleave2 = vc8000_ssse3_deinterleave2,
+	.deinterleave_yuyv = vc8000_ssse3_deinterleave_yuyv,
+};
+
+const struct vc8000_simd_kernels *vc8000_simd_x86_get(E_VC8000_SIMD eSimd)
+{
+	__builtin_cpu_init();
+
+	if((eSimd == eVC8000_SIMD_SSSE3) && __builtin_cpu_supports("ssse3"))
+		return &s_sSSSE3Kernels;
+
+	//AVX2 kernels finish rows with SSSE3
+	if((eSimd == eVC8000_SIMD_AVX2) && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("ssse3"))
+		return &s_sAVX2Kernels;
+
+	return NULL;
+}
+
+#else
+
+const struct vc8000_simd_kernels *vc8000_simd_x86_get(E_VC8000_SIMD eSimd)
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,255 @@
+/**
+ * @file vc8ksimdtest.c: VC8000 conversion kernel test and microbenchmark
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Without arguments every kernel table supported by the CPU is checked bit
+ * exact against the C kernels, for all byte orders, widths 0..TEST_MAX_PIXELS
+ * (odd ones included) and unaligned source/destination. Bytes around the destination row must
+ * stay untouched. Return 0 if all tables pass.
+ *
+ * -bench [WxH] [iterations] reports Mpixel/s of each kernel and table.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "jsimd_vc8000.h"
+
+#define TEST_MAX_PIXELS		300
+#define TEST_GUARD			64
+#define TEST_GUARD_BYTE		0xA5
+
+#define BENCH_DEF_WIDTH		1920
+#define BENCH_DEF_HEIGHT	1080
+#define BENCH_DEF_ITER		50
+
+typedef enum {
+	eTEST_KERNEL_4TO3 = 0,
+	eTEST_KERNEL_4TO4,
+	eTEST_KERNEL_COPY,
+	eTEST_KERNEL_DEINTERLEAVE2,
+	eTEST_KERNEL_YUYV,
+	eTEST_KERNEL_CNT,
+} E_TEST_KERNEL;
+
+static const char *s_aszKernelName[eTEST_KERNEL_CNT] = {"swizzle4to3", "swizzle4to4", "copy", "deinterleave2", "deinterleave_yuyv"};
+
+//Distance of planes written by deinterleave kernels
+#define TEST_PLANE_STRIDE	(TEST_MAX_PIXELS + 16)
+
+static uint64_t test_time_ns(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000ULL + tNow.tv_nsec;
+}
+
+//All byte orders of destination pixel, return count
+static int test_orders(
+	int i32DstBytes,
+	uint8_t au8Orders[][4]
+)
+{
+	int i32Cnt = 0;
+	int a, b, c, d;
+
+	for(a = 0; a < 4; a ++)
+		for(b = 0; b < 4; b ++)
+			for(c = 0; c < 4; c ++)
+				for(d = 0; d < ((i32DstBytes == 4) ? 4 : 1); d ++) {
+					au8Orders[i32Cnt][0] = a;
+					au8Orders[i32Cnt][1] = b;
+					au8Orders[i32Cnt][2] = c;
+					au8Orders[i32Cnt][3] = d;
+					i32Cnt ++;
+				}
+
+	return i32Cnt;
+}
+
+static void test_run_kernel(
+	const struct vc8000_simd_kernels *psKernels,
+	E_TEST_KERNEL eKernel,
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels,
+	const uint8_t *pu8Order
+)
+{
+	switch(eKernel) {
+	case eTEST_KERNEL_4TO3:
+		psKernels->swizzle4to3(pu8Src, pu8Dst, u32Pixels, pu8Order);
+		break;
+	case eTEST_KERNEL_4TO4:
+		psKernels->swizzle4to4(pu8Src, pu8Dst, u32Pixels, pu8Order);
+		break;
+	case eTEST_KERNEL_COPY:
+		psKernels->copy(pu8Src, pu8Dst, u32Pixels * 4);
+		break;
+	case eTEST_KERNEL_DEINTERLEAVE2:
+		psKernels->deinterleave2(pu8Src, pu8Dst, pu8Dst + TEST_PLANE_STRIDE, u32Pixels);
+		break;
+	default:
+		psKernels->deinterleave_yuyv(pu8Src, pu8Dst, pu8Dst + TEST_PLANE_STRIDE, pu8Dst + (TEST_PLANE_STRIDE * 2), u32Pixels);
+		break;
+	}
+}
+
+static int test_kernels(
+	const struct vc8000_simd_kernels *psKernels
+)
+{
+	const struct vc8000_simd_kernels *psRef = vc8000_simd_get(eVC8000_SIMD_C);
+	static uint8_t au8Orders[256][4];
+	uint8_t au8Src[(TEST_MAX_PIXELS * 4) + 16];
+	uint8_t au8Ref[(TEST_MAX_PIXELS * 4) + (TEST_GUARD * 2) + 16];
+	uint8_t au8Dst[(TEST_MAX_PIXELS * 4) + (TEST_GUARD * 2) + 16];
+	int i32Orders;
+	int i32Failed = 0;
+	int e, o, i32SrcOff, i32DstOff;
+	uint32_t u32Pixels;
+	size_t i;
+
+	for(i = 0; i < sizeof(au8Src); i ++)
+		au8Src[i] = (uint8_t)rand();
+
+	for(e = 0; e < eTEST_KERNEL_CNT; e ++) {
+		if((e == eTEST_KERNEL_4TO3) || (e == eTEST_KERNEL_4TO4))
+			i32Orders = test_orders((e == eTEST_KERNEL_4TO3) ? 3 : 4, au8Orders);
+		else
+			i32Orders = 1;
+
+		for(o = 0; o < i32Orders; o ++) {
+			for(u32Pixels = 0; u32Pixels <= TEST_MAX_PIXELS; u32Pixels ++) {
+				for(i32SrcOff = 0; i32SrcOff < 4; i32SrcOff ++) {
+					for(i32DstOff = 0; i32DstOff < 4; i32DstOff ++) {
+						uint8_t *pu8Ref = au8Ref + TEST_GUARD + i32DstOff;
+						uint8_t *pu8Dst = au8Dst + TEST_GUARD + i32DstOff;
+
+						memset(au8Ref, TEST_GUARD_BYTE, sizeof(au8Ref));
+						memset(au8Dst, TEST_GUARD_BYTE, sizeof(au8Dst));
+
+						test_run_kernel(psRef, e, au8Src + i32SrcOff, pu8Ref, u32Pixels, au8Orders[o]);
+						test_run_kernel(psKernels, e, au8Src + i32SrcOff, pu8Dst, u32Pixels, au8Orders[o]);
+
+						if(memcmp(au8Ref, au8Dst, sizeof(au8Dst)) != 0) {
+							fprintf(stderr, "%s %s: mismatch, order %d%d%d%d, %u pixels, offset %d/%d \n",
+								psKernels->name, s_aszKernelName[e],
+								au8Orders[o][0], au8Orders[o][1], au8Orders[o][2], au8Orders[o][3],
+								u32Pixels, i32SrcOff, i32DstOff);
+							i32Failed ++;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return i32Failed;
+}
+
+static void bench_kernels(
+	const struct vc8000_simd_kernels *psKernels,
+	uint32_t u32Width,
+	uint32_t u32Height,
+	int i32Iterations
+)
+{
+	static const uint8_t au8Order[4] = {2, 1, 0, 3};
+	uint8_t *pu8Src = malloc((size_t)u32Width * u32Height * 4);
+	uint8_t *pu8Dst = malloc((size_t)u32Width * u32Height * 4);
+	uint64_t u64StartNs;
+	uint64_t u64Ns;
+	uint32_t y;
+	int e, n;
+
+	if((pu8Src == NULL) || (pu8Dst == NULL)) {
+		free(pu8Src);
+		free(pu8Dst);
+		return;
+	}
+
+	memset(pu8Src, 0x5A, (size_t)u32Width * u32Height * 4);
+
+	for(e = 0; e < eTEST_KERNEL_CNT; e ++) {
+		uint32_t u32DstRow = (e == eTEST_KERNEL_4TO3) ? u32Width * 3 : u32Width * 4;
+		size_t szPlane = (size_t)u32Width * u32Height;
+
+		u64StartNs = test_time_ns();
+		for(n = 0; n < i32Iterations; n ++) {
+			for(y = 0; y < u32Height; y ++) {
+				const uint8_t *pu8SrcRow = pu8Src + ((size_t)y * u32Width * 4);
+
+				//deinterleave kernels write planes of u32Width bytes per row
+				if(e == eTEST_KERNEL_DEINTERLEAVE2)
+					psKernels->deinterleave2(pu8SrcRow, pu8Dst + ((size_t)y * u32Width),
+											pu8Dst + szPlane + ((size_t)y * u32Width), u32Width);
+				else if(e == eTEST_KERNEL_YUYV)
+					psKernels->deinterleave_yuyv(pu8SrcRow, pu8Dst + ((size_t)y * u32Width),
+											pu8Dst + szPlane + ((size_t)y * u32Width),
+											pu8Dst + (szPlane * 2) + ((size_t)y * u32Width), u32Width);
+				else
+					test_run_kernel(psKernels, e, pu8SrcRow, pu8Dst + ((size_t)y * u32DstRow), u32Width, au8Order);
+			}
+		}
+		u64Ns = test_time_ns() - u64StartNs;
+
+		printf("%s,%s,%ux%u,%.3f ms,%.1f Mpixel/s\n", psKernels->name, s_aszKernelName[e],
+			u32Width, u32Height, (double)u64Ns / i32Iterations / 1000000.0,
+			(double)u32Width * u32Height * i32Iterations * 1000.0 / u64Ns);
+	}
+
+	free(pu8Src);
+	free(pu8Dst);
+}
+
+int main(int argc, char *argv[])
+{
+	const struct vc8000_simd_kernels *psKernels;
+	uint32_t u32Width = BENCH_DEF_WIDTH;
+	uint32_t u32Height = BENCH_DEF_HEIGHT;
+	int i32Iterations = BENCH_DEF_ITER;
+	int i32Failed = 0;
+	int i;
+
+	if((argc > 1) && (strcmp(argv[1], "-bench") == 0)) {
+		if((argc > 2) && (sscanf(argv[2], "%ux%u", &u32Width, &u32Height) != 2)) {
+			fprintf(stderr, "vc8ksimdtest -bench [WxH] [iterations] \n");
+			return -1;
+		}
+		if(argc > 3)
+			i32Iterations = atoi(argv[3]);
+		if(i32Iterations <= 0)
+			i32Iterations = 1;
+
+		printf("simd,kernel,size,time per image,speed\n");
+		for(i = 0; i < eVC8000_SIMD_CNT; i ++) {
+			psKernels = vc8000_simd_get((E_VC8000_SIMD)i);
+			if(psKernels)
+				bench_kernels(psKernels, u32Width, u32Height, i32Iterations);
+		}
+		return 0;
+	}
+
+	for(i = 0; i < eVC8000_SIMD_CNT; i ++) {
+		psKernels = vc8000_simd_get((E_VC8000_SIMD)i);
+		if(psKernels == NULL)
+			continue;
+
+		if(test_kernels(psKernels) == 0) {
+			printf("%s: passed \n", psKernels->name);
+		}
+		else {
+			printf("%s: FAILED \n", psKernels->name);
+			i32Failed ++;
+		}
+	}
+
+	printf("best: %s \n", vc8000_simd_best()->name);
+	return i32Failed ? 1 : 0;
+}
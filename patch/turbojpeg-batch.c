@@ -0,0 +1,447 @@
+/**
+ * @file turbojpeg-batch.c: hybrid VC8000/CPU batch decompression
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Images of a batch are split into one queue per engine: the VC8000 feeder
+ * takes large images the hardware supports, CPU workers take the rest.  Each
+ * queue is ordered largest first.  An idle engine steals the smallest image
+ * left in another queue, the feeder only steals images the hardware supports.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "jinclude.h"
+#define JPEG_INTERNALS
+#include "jpeglib.h"
+#include "jerror.h"
+#include "turbojpeg_ext.h"
+#include "jpeglib_ext.h"
+#include "vc8000_costmodel.h"
+
+/* Hardware wins above this output size (see performance table in README) */
+#define BATCH_HW_MIN_PIXELS		(640 * 480)
+
+/* Maximum output resolution of VC8000 */
+#define BATCH_HW_MAX_WIDTH		1920
+#define BATCH_HW_MAX_HEIGHT		1080
+
+#define BATCH_MAX_SW_THREADS	32
+
+static const tjscalingfactor s_asScalingFactors[] = {
+  { 2, 1 }, { 15, 8 }, { 7, 4 }, { 13, 8 }, { 3, 2 }, { 11, 8 }, { 5, 4 },
+  { 9, 8 }, { 1, 1 }, { 7, 8 }, { 3, 4 }, { 5, 8 }, { 1, 2 }, { 3, 8 },
+  { 1, 4 }, { 1, 8 }
+};
+
+#define NUMSF  (int)(sizeof(s_asScalingFactors) / sizeof(tjscalingfactor))
+
+static const J_COLOR_SPACE s_aePixelFormatCS[TJ_NUMPF] = {
+  JCS_EXT_RGB, JCS_EXT_BGR, JCS_EXT_RGBX, JCS_EXT_BGRX, JCS_EXT_XBGR,
+  JCS_EXT_XRGB, JCS_GRAYSCALE, JCS_EXT_RGBA, JCS_EXT_BGRA, JCS_EXT_ABGR,
+  JCS_EXT_ARGB, JCS_CMYK
+};
+
+struct batch_error_mgr {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+};
+
+/* Queue of one engine, owner pops from head, thieves steal from tail */
+struct batch_queue {
+  pthread_mutex_t lock;
+  int *pi32Job;
+  int i32Head;
+  int i32Tail;
+};
+
+struct batch_ctx;
+
+struct batch_worker {
+  struct batch_ctx *psCtx;
+  int i32Queue;                 /* own queue */
+  int i32Engine;                /* TJBATCH_ENGINE_HW/SW */
+  pthread_t tThread;
+  int i32Stolen;
+  uint64_t u64BusyNs;
+};
+
+struct batch_ctx {
+  tjbatchjob *psJobs;
+  boolean *pbHWEligible;
+  struct batch_queue *psQueue;
+  int i32QueueCnt;
+};
+
+struct batch_sort_item {
+  int i32Job;
+  unsigned long u32Pixels;
+};
+
+
+static void batch_error_exit(j_common_ptr cinfo)
+{
+  struct batch_error_mgr *err = (struct batch_error_mgr *)cinfo->err;
+
+  longjmp(err->setjmp_buffer, 1);
+}
+
+/* Warnings of corrupt data do not stop the batch */
+static void batch_output_message(j_common_ptr cinfo)
+{
+}
+
+/* Read header and set output parameters of job, same rules as tjDecompress2() */
+static int batch_setup(j_decompress_ptr cinfo, tjbatchjob *psJob)
+{
+  int i32Width, i32Height;
+  int i;
+
+  if ((psJob->pixelFormat < 0) || (psJob->pixelFormat >= TJ_NUMPF))
+    return -1;
+
+  jpeg_mem_src(cinfo, psJob->jpegBuf, psJob->jpegSize);
+  jpeg_read_header(cinfo, TRUE);
+
+  cinfo->out_color_space = s_aePixelFormatCS[psJob->pixelFormat];
+  if (psJob->flags & TJFLAG_FASTDCT)
+    cinfo->dct_method = JDCT_FASTEST;
+  if (psJob->flags & TJFLAG_FASTUPSAMPLE)
+    cinfo->do_fancy_upsampling = FALSE;
+
+  i32Width = psJob->width ? psJob->width : (int)cinfo->image_width;
+  i32Height = psJob->height ? psJob->height : (int)cinfo->image_height;
+
+  for (i = 0; i < NUMSF; i++) {
+    if ((TJSCALED((int)cinfo->image_width, s_asScalingFactors[i]) <= i32Width) &&
+        (TJSCALED((int)cinfo->image_height, s_asScalingFactors[i]) <= i32Height))
+      break;
+  }
+  if (i >= NUMSF)
+    return -1;
+
+  cinfo->scale_num = s_asScalingFactors[i].num;
+  cinfo->scale_denom = s_asScalingFactors[i].denom;
+  return 0;
+}
+
+/* Decide whether VC8000 can decode the job, return output pixels or 0 on error */
+static unsigned long batch_classify(tjbatchjob *psJob, boolean *pbHWEligible)
+{
+  struct jpeg_decompress_struct sInfo;
+  struct batch_error_mgr sErr;
+  unsigned long u32Pixels = 0;
+
+  *pbHWEligible = FALSE;
+
+  memset(&sInfo, 0, sizeof(sInfo));
+  sInfo.err = jpeg_std_error(&sErr.pub);
+  sErr.pub.error_exit = batch_error_exit;
+  sErr.pub.output_message = batch_output_message;
+
+  if (setjmp(sErr.setjmp_buffer)) {
+    jpeg_destroy_decompress(&sInfo);
+    return 0;
+  }
+
+  jpeg_create_decompress(&sInfo);
+
+  if (batch_setup(&sInfo, psJob) == 0) {
+    jpeg_calc_output_dimensions(&sInfo);
+    u32Pixels = (unsigned long)sInfo.output_width * sInfo.output_height;
+
+    if (!sInfo.progressive_mode &&
+        (sInfo.jpeg_color_space != JCS_CMYK) && (sInfo.jpeg_color_space != JCS_YCCK) &&
+        (sInfo.output_width <= BATCH_HW_MAX_WIDTH) && (sInfo.output_height <= BATCH_HW_MAX_HEIGHT) &&
+        jpeg_hw_can_decode(&sInfo))
+      *pbHWEligible = TRUE;
+  }
+
+  jpeg_destroy_decompress(&sInfo);
+  return u32Pixels;
+}
+
+/* Decompress one job by engine, return engine which did the work or NONE on error */
+static int batch_decode(tjbatchjob *psJob, int i32Engine)
+{
+  struct jpeg_decompress_struct sInfo;
+  struct batch_error_mgr sErr;
+  JSAMPROW * volatile ppRows = NULL;   /* freed after longjmp */
+  int i32Pitch;
+  int i32Ret = TJBATCH_ENGINE_NONE;
+  JDIMENSION i;
+
+  memset(&sInfo, 0, sizeof(sInfo));
+  sInfo.err = jpeg_std_error(&sErr.pub);
+  sErr.pub.error_exit = batch_error_exit;
+  sErr.pub.output_message = batch_output_message;
+
+  if (setjmp(sErr.setjmp_buffer)) {
+    free(ppRows);
+    jpeg_destroy_decompress(&sInfo);
+    return TJBATCH_ENGINE_NONE;
+  }
+
+  jpeg_CreateDecompress_Ext(&sInfo, JPEG_LIB_VERSION, sizeof(struct jpeg_decompress_struct),
+                            (i32Engine == TJBATCH_ENGINE_HW) ? TRUE : FALSE);
+
+  if (batch_setup(&sInfo, psJob) != 0)
+    goto bailout;
+
+  //feeder decides by image class, not by cost model
+  if (i32Engine == TJBATCH_ENGINE_HW)
+    sInfo.master->i32HWForceEngine = eVC8000_ENGINE_HW;
+
+  jpeg_start_decompress(&sInfo);
+
+  i32Pitch = psJob->pitch ? psJob->pitch : (int)sInfo.output_width * tjPixelSize[psJob->pixelFormat];
+  ppRows = (JSAMPROW *)malloc(sizeof(JSAMPROW) * sInfo.output_height);
+  if (ppRows == NULL)
+    goto bailout;
+
+  for (i = 0; i < sInfo.output_height; i++) {
+    if (psJob->flags & TJFLAG_BOTTOMUP)
+      ppRows[i] = &psJob->dstBuf[(sInfo.output_height - i - 1) * (size_t)i32Pitch];
+    else
+      ppRows[i] = &psJob->dstBuf[i * (size_t)i32Pitch];
+  }
+
+  //hardware may fall back to software, report the engine which ran
+  i32Ret = sInfo.master->bHWJpegDecodeDone ? TJBATCH_ENGINE_HW : TJBATCH_ENGINE_SW;
+
+  while (sInfo.output_scanline < sInfo.output_height)
+    jpeg_read_scanlines(&sInfo, &ppRows[sInfo.output_scanline],
+                        sInfo.output_height - sInfo.output_scanline);
+
+  jpeg_finish_decompress(&sInfo);
+
+bailout:
+  free(ppRows);
+  jpeg_destroy_decompress(&sInfo);
+  return i32Ret;
+}
+
+static int batch_queue_pop(struct batch_queue *psQueue)
+{
+  int i32Job = -1;
+
+  pthread_mutex_lock(&psQueue->lock);
+  if (psQueue->i32Head < psQueue->i32Tail)
+    i32Job = psQueue->pi32Job[psQueue->i32Head++];
+  pthread_mutex_unlock(&psQueue->lock);
+
+  return i32Job;
+}
+
+/* Steal smallest job from tail of queue, hardware thief skips jobs it cannot decode */
+static int batch_queue_steal(struct batch_ctx *psCtx, struct batch_queue *psQueue,
+                             boolean bHWOnly)
+{
+  int i32Job = -1;
+  int i;
+
+  pthread_mutex_lock(&psQueue->lock);
+  for (i = psQueue->i32Tail - 1; i >= psQueue->i32Head; i--) {
+    if (bHWOnly && !psCtx->pbHWEligible[psQueue->pi32Job[i]])
+      continue;
+
+    i32Job = psQueue->pi32Job[i];
+    psQueue->pi32Job[i] = psQueue->pi32Job[psQueue->i32Tail - 1];
+    psQueue->i32Tail--;
+    break;
+  }
+  pthread_mutex_unlock(&psQueue->lock);
+
+  return i32Job;
+}
+
+static void *batch_worker_thread(void *arg)
+{
+  struct batch_worker *psWorker = (struct batch_worker *)arg;
+  struct batch_ctx *psCtx = psWorker->psCtx;
+  boolean bHWOnly = (psWorker->i32Engine == TJBATCH_ENGINE_HW) ? TRUE : FALSE;
+  int i32Job;
+  int i;
+
+  while (1) {
+    i32Job = batch_queue_pop(&psCtx->psQueue[psWorker->i32Queue]);
+
+    for (i = 1; (i32Job < 0) && (i < psCtx->i32QueueCnt); i++) {
+      i32Job = batch_queue_steal(psCtx, &psCtx->psQueue[(psWorker->i32Queue + i) % psCtx->i32QueueCnt], bHWOnly);
+      if (i32Job >= 0)
+        psWorker->i32Stolen++;
+    }
+
+    //queues only shrink, nothing left anywhere
+    if (i32Job < 0)
+      break;
+
+    uint64_t u64StartNs = vc8000_costmodel_time_ns();
+    tjbatchjob *psJob = &psCtx->psJobs[i32Job];
+
+    psJob->engine = batch_decode(psJob, psWorker->i32Engine);
+    psJob->status = (psJob->engine != TJBATCH_ENGINE_NONE) ? 0 : -1;
+    psWorker->u64BusyNs += vc8000_costmodel_time_ns() - u64StartNs;
+  }
+
+  return NULL;
+}
+
+static int batch_sort_desc(const void *a, const void *b)
+{
+  const struct batch_sort_item *psA = (const struct batch_sort_item *)a;
+  const struct batch_sort_item *psB = (const struct batch_sort_item *)b;
+
+  if (psA->u32Pixels > psB->u32Pixels)
+    return -1;
+  if (psA->u32Pixels < psB->u32Pixels)
+    return 1;
+  return psA->i32Job - psB->i32Job;
+}
+
+DLLEXPORT int tjDecompressBatch(tjbatchjob *jobs, int numJobs, int numThreads,
+                                tjbatchstats *stats)
+{
+  struct batch_ctx sCtx;
+  struct batch_worker *psWorkers = NULL;
+  struct batch_sort_item *psSort = NULL;
+  int *pi32QueueMem = NULL;
+  boolean bHW;
+  int i32WorkerCnt = 0;
+  int i32SWQueue0;
+  int i32HWCnt = 0;
+  int i32SWCnt = 0;
+  int i32Ret = -1;
+  uint64_t u64StartNs = vc8000_costmodel_time_ns();
+  int i;
+
+  memset(&sCtx, 0, sizeof(sCtx));
+  if (stats)
+    memset(stats, 0, sizeof(tjbatchstats));
+
+  if ((jobs == NULL) || (numJobs < 0) || (numThreads < 0))
+    return -1;
+
+  if (numThreads == 0) {
+    numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads < 1)
+      numThreads = 1;
+  }
+  if (numThreads > BATCH_MAX_SW_THREADS)
+    numThreads = BATCH_MAX_SW_THREADS;
+
+  bHW = (jpeg_hw_get_node_count() > 0) ? TRUE : FALSE;
+
+  //queue 0 belongs to hardware feeder if there is a VC8000
+  i32SWQueue0 = bHW ? 1 : 0;
+  sCtx.psJobs = jobs;
+  sCtx.i32QueueCnt = i32SWQueue0 + numThreads;
+  sCtx.pbHWEligible = (boolean *)calloc(numJobs + 1, sizeof(boolean));
+  sCtx.psQueue = (struct batch_queue *)calloc(sCtx.i32QueueCnt, sizeof(struct batch_queue));
+  psSort = (struct batch_sort_item *)malloc(sizeof(struct batch_sort_item) * (numJobs + 1));
+  pi32QueueMem = (int *)malloc(sizeof(int) * (numJobs + 1) * sCtx.i32QueueCnt);
+  psWorkers = (struct batch_worker *)calloc(sCtx.i32QueueCnt, sizeof(struct batch_worker));
+  if (!sCtx.pbHWEligible || !sCtx.psQueue || !psSort || !pi32QueueMem || !psWorkers)
+    goto bailout;
+
+  for (i = 0; i < sCtx.i32QueueCnt; i++) {
+    pthread_mutex_init(&sCtx.psQueue[i].lock, NULL);
+    sCtx.psQueue[i].pi32Job = &pi32QueueMem[i * (numJobs + 1)];
+  }
+
+  //classify, largest first
+  for (i = 0; i < numJobs; i++) {
+    jobs[i].status = -1;
+    jobs[i].engine = TJBATCH_ENGINE_NONE;
+    psSort[i].i32Job = i;
+    psSort[i].u32Pixels = batch_classify(&jobs[i], &sCtx.pbHWEligible[i]);
+    if (!bHW)
+      sCtx.pbHWEligible[i] = FALSE;
+  }
+  qsort(psSort, numJobs, sizeof(struct batch_sort_item), batch_sort_desc);
+
+  for (i = 0; i < numJobs; i++) {
+    int i32Job = psSort[i].i32Job;
+    struct batch_queue *psQueue;
+
+    //corrupt header, nothing to decode
+    if (psSort[i].u32Pixels == 0)
+      continue;
+
+    if (sCtx.pbHWEligible[i32Job] && (psSort[i].u32Pixels >= BATCH_HW_MIN_PIXELS))
+      psQueue = &sCtx.psQueue[0];
+    else
+      psQueue = &sCtx.psQueue[i32SWQueue0 + (i32SWCnt++ % numThreads)];
+
+    psQueue->pi32Job[psQueue->i32Tail++] = i32Job;
+  }
+
+  for (i = 0; i < sCtx.i32QueueCnt; i++) {
+    psWorkers[i].psCtx = &sCtx;
+    psWorkers[i].i32Queue = i;
+    psWorkers[i].i32Engine = (i < i32SWQueue0) ? TJBATCH_ENGINE_HW : TJBATCH_ENGINE_SW;
+    if (pthread_create(&psWorkers[i].tThread, NULL, batch_worker_thread, &psWorkers[i]) != 0)
+      break;
+    i32WorkerCnt++;
+  }
+
+  //a thread could not be created, drain left over queues here by software
+  if (i32WorkerCnt < sCtx.i32QueueCnt) {
+    psWorkers[i32WorkerCnt].i32Engine = TJBATCH_ENGINE_SW;
+    batch_worker_thread(&psWorkers[i32WorkerCnt]);
+  }
+
+  for (i = 0; i < i32WorkerCnt; i++)
+    pthread_join(psWorkers[i].tThread, NULL);
+
+  i32HWCnt = 0;
+  i32SWCnt = 0;
+  for (i = 0; i < numJobs; i++) {
+    if (jobs[i].engine == TJBATCH_ENGINE_HW)
+      i32HWCnt++;
+    else if (jobs[i].engine == TJBATCH_ENGINE_SW)
+      i32SWCnt++;
+  }
+
+  if (stats) {
+    double dElapsed = (double)(vc8000_costmodel_time_ns() - u64StartNs) / 1000000000.;
+
+    stats->hwJobs = i32HWCnt;
+    stats->swJobs = i32SWCnt;
+    stats->failedJobs = numJobs - i32HWCnt - i32SWCnt;
+    stats->swThreads = numThreads;
+    stats->elapsed = dElapsed;
+
+    for (i = 0; i < sCtx.i32QueueCnt; i++) {
+      stats->stolenJobs += psWorkers[i].i32Stolen;
+      if (psWorkers[i].i32Engine == TJBATCH_ENGINE_HW)
+        stats->hwBusy += (double)psWorkers[i].u64BusyNs / 1000000000.;
+      else
+        stats->swBusy += (double)psWorkers[i].u64BusyNs / 1000000000.;
+    }
+
+    if (dElapsed > 0) {
+      stats->hwUtilization = stats->hwBusy / dElapsed;
+      stats->swUtilization = stats->swBusy / (dElapsed * numThreads);
+    }
+  }
+
+  i32Ret = (i32HWCnt + i32SWCnt == numJobs) ? 0 : -1;
+
+bailout:
+  if (sCtx.psQueue) {
+    for (i = 0; i < sCtx.i32QueueCnt; i++)
+      pthread_mutex_destroy(&sCtx.psQueue[i].lock);
+  }
+  free(psWorkers);
+  free(pi32QueueMem);
+  free(psSort);
+  free(sCtx.psQueue);
+  free(sCtx.pbHWEligible);
+  return i32Ret;
+}
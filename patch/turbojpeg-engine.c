@@ -0,0 +1,28 @@
+/**
+ * @file turbojpeg-engine.c: engine report of TurboJPEG decompress calls
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * The TurboJPEG handle keeps its decompress object private, so the engine is
+ * taken from the per thread statistics of the last image finished by the
+ * calling thread (jpeg_get_thread_decode_stats()).
+ */
+#include <stdio.h>
+
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "turbojpeg_ext.h"
+#include "jpeglib_ext.h"
+
+DLLEXPORT int tjGetDecodeEngine(void)
+{
+  jpeg_decode_stats sStats;
+
+  jpeg_get_thread_decode_stats(&sStats);
+
+  if (sStats.engine == JPEG_HW_ENGINE_HW)
+    return TJBATCH_ENGINE_HW;
+  if (sStats.engine == JPEG_HW_ENGINE_SW)
+    return TJBATCH_ENGINE_SW;
+  return TJBATCH_ENGINE_NONE;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file turbojpeg-nv12.c: in place NV12 output of VC8000 decodes
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * TurboJPEG front end of jpeg_read_raw_nv12(). The image is decoded by the
+ * VC8000 to NV12 and the capture buffer is handed out without copying or
+ * plane splitting; the decompress object is gone when the call returns.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "jinclude.h"
+#define JPEG_INTERNALS
+#include "jpeglib.h"
+#include "jerror.h"
+#include "turbojpeg_ext.h"
+#include "jpeglib_ext.h"
+#include "vc8000_costmodel.h"
+
+struct nv12_error_mgr {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+};
+
+static void nv12_error_exit(j_common_ptr cinfo)
+{
+  struct nv12_error_mgr *err = (struct nv12_error_mgr *)cinfo->err;
+
+  longjmp(err->setjmp_buffer, 1);
+}
+
+/* Warnings of corrupt data do not fail the decode */
+static void nv12_output_message(j_common_ptr cinfo)
+{
+}
+
+/* Largest scaling factor which fits width x height, same rule as tjDecompress2() */
+static int nv12_set_scale(j_decompress_ptr cinfo, int width, int height)
+{
+  tjscalingfactor *psFactors;
+  int i32Factors;
+  int i;
+
+  if (width == 0)
+    width = (int)cinfo->image_width;
+  if (height == 0)
+    height = (int)cinfo->image_height;
+
+  psFactors = tjGetScalingFactors(&i32Factors);
+  if (psFactors == NULL)
+    return -1;
+
+  for (i = 0; i < i32Factors; i++) {
+    if ((TJSCALED((int)cinfo->image_width, psFactors[i]) <= width) &&
+        (TJSCALED((int)cinfo->image_height, psFactors[i]) <= height)) {
+      cinfo->scale_num = psFactors[i].num;
+      cinfo->scale_denom = psFactors[i].denom;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+DLLEXPORT int tjDecompressToNV12(const unsigned char *jpegBuf,
+                                 unsigned long jpegSize, int width, int height,
+                                 int flags, tjnv12frame *frame)
+{
+  struct jpeg_decompress_struct sInfo;
+  struct nv12_error_mgr sErr;
+  jpeg_hw_nv12 sNV12;
+  volatile int i32Ret = -1;
+
+  if ((jpegBuf == NULL) || (jpegSize == 0) || (frame == NULL) ||
+      (width < 0) || (height < 0))
+    return -1;
+
+  memset(frame, 0, sizeof(*frame));
+  sNV12.session = NULL;
+
+  memset(&sInfo, 0, sizeof(sInfo));
+  sInfo.err = jpeg_std_error(&sErr.pub);
+  sErr.pub.error_exit = nv12_error_exit;
+  sErr.pub.output_message = nv12_output_message;
+
+  if (setjmp(sErr.setjmp_buffer)) {
+    jpeg_release_raw_nv12(&sNV12);
+    jpeg_destroy_decompress(&sInfo);
+    return -1;
+  }
+
+  jpeg_CreateDecompress_Ext(&sInfo, JPEG_LIB_VERSION, sizeof(struct jpeg_decompress_struct), TRUE);
+  jpeg_mem_src(&sInfo, jpegBuf, jpegSize);
+  jpeg_read_header(&sInfo, TRUE);
+
+  if (nv12_set_scale(&sInfo, width, height) != 0)
+    goto bailout;
+  if (flags & TJFLAG_FASTDCT)
+    sInfo.dct_method = JDCT_FASTEST;
+
+  //4:2:0 color is decoded as raw data, grayscale through the Y plane
+  if (sInfo.num_components == 1)
+    sInfo.out_color_space = JCS_GRAYSCALE;
+  else
+    sInfo.raw_data_out = TRUE;
+
+  //caller asked for the capture buffer, cost model must not pick software
+  sInfo.master->i32HWForceEngine = eVC8000_ENGINE_HW;
+
+  jpeg_start_decompress(&sInfo);
+
+  if (jpeg_read_raw_nv12(&sInfo, &sNV12) != 0) {
+    jpeg_abort_decompress(&sInfo);
+    goto bailout;
+  }
+
+  jpeg_finish_decompress(&sInfo);
+
+  frame->y = sNV12.y;
+  frame->uv = sNV12.uv;
+  frame->stride = (int)sNV12.stride;
+  frame->width = (int)sNV12.width;
+  frame->height = (int)sNV12.height;
+  frame->session = sNV12.session;
+  frame->slot = sNV12.slot;
+  i32Ret = 0;
+
+bailout:
+  jpeg_destroy_decompress(&sInfo);
+  return i32Ret;
+}
+
+DLLEXPORT void tjReleaseNV12(tjnv12frame *frame)
+{
+  jpeg_hw_nv12 sNV12;
+
+  if ((frame == NULL) || (frame->session == NULL))
+    return;
+
+  memset(&sNV12, 0, sizeof(sNV12));
+  sNV12.session = frame->session;
+  sNV12.slot = frame->slot;
+  jpeg_release_raw_nv12(&sNV12);
+
+  memset(frame, 0, sizeof(*frame));
+}
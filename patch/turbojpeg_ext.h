@@ -0,0 +1,173 @@
+#ifndef TURBOJPEG_EXT_H
+#define TURBOJPEG_EXT_H
+
+#include "turbojpeg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Engine which decoded a batch job or image
+ */
+enum TJBATCHENGINE {
+  /** Not decoded */
+  TJBATCH_ENGINE_NONE = 0,
+  /** VC8000 hardware decoder */
+  TJBATCH_ENGINE_HW,
+  /** Software decoder (CPU worker) */
+  TJBATCH_ENGINE_SW
+};
+
+/**
+ * One image of a batch decode
+ */
+typedef struct {
+  /** JPEG image to decompress */
+  const unsigned char *jpegBuf;
+  /** Size of the JPEG image (in bytes) */
+  unsigned long jpegSize;
+  /** Destination image buffer, see #tjDecompress2() */
+  unsigned char *dstBuf;
+  /** Desired width (in pixels) of the destination image, 0 = source width */
+  int width;
+  /** Bytes per row in the destination image, 0 = width * pixel size */
+  int pitch;
+  /** Desired height (in pixels) of the destination image, 0 = source height */
+  int height;
+  /** Pixel format of the destination image (see @ref TJPF "Pixel formats") */
+  int pixelFormat;
+  /** Bitwise OR of TJFLAG_BOTTOMUP, TJFLAG_FASTUPSAMPLE, TJFLAG_FASTDCT and
+      TJFLAG_ACCURATEDCT */
+  int flags;
+  /** Output: 0 on success, -1 if the image could not be decompressed */
+  int status;
+  /** Output: engine which decompressed the image (see #TJBATCHENGINE) */
+  int engine;
+} tjbatchjob;
+
+/**
+ * Utilization report of a batch decode
+ */
+typedef struct {
+  /** Number of images decompressed by the VC8000 */
+  int hwJobs;
+  /** Number of images decompressed by the CPU workers */
+  int swJobs;
+  /** Number of images which failed */
+  int failedJobs;
+  /** Number of images taken from the queue of another engine/worker */
+  int stolenJobs;
+  /** Number of CPU workers */
+  int swThreads;
+  /** Wall time of the batch (in seconds) */
+  double elapsed;
+  /** Time the hardware feeder spent decompressing (in seconds) */
+  double hwBusy;
+  /** Time all CPU workers spent decompressing (in seconds) */
+  double swBusy;
+  /** hwBusy / elapsed */
+  double hwUtilization;
+  /** swBusy / (elapsed * swThreads) */
+  double swUtilization;
+} tjbatchstats;
+
+/**
+ * Decompress a batch of JPEG images using the VC8000 and a pool of CPU
+ * workers at the same time.
+ *
+ * One hardware feeder thread decompresses large images which the VC8000
+ * supports, largest first.  Small images and images the hardware cannot
+ * decode (progressive, CMYK/YCCK, output larger than 1920x1080, unsupported
+ * pixel format) are decompressed by the CPU workers.  An engine or worker that
+ * runs out of work steals images from the others, so both the hardware and
+ * all cores are kept busy until the batch is done.
+ *
+ * @param jobs array of images to decompress.  The status and engine fields
+ * are filled in.
+ *
+ * @param numJobs number of images
+ *
+ * @param numThreads number of CPU workers, 0 = number of online CPUs
+ *
+ * @param stats if not NULL, receives the engine utilization of the batch
+ *
+ * @return 0 if all images were decompressed, or -1 if any image failed (see
+ * the status field of each job.)
+ */
+DLLEXPORT int tjDecompressBatch(tjbatchjob *jobs, int numJobs, int numThreads,
+                                tjbatchstats *stats);
+
+/**
+ * Engine which decompressed the last image finished by the calling thread,
+ * for any TurboJPEG decompress function (e.g. to tell whether
+ * #tjDecompressToYUVPlanes() used the VC8000.)
+ *
+ * The value is only valid when read on the same thread right after the
+ * decompress call returns: the next image finished on this thread replaces
+ * it, and images of other threads never set it.  #tjDecompressBatch() decodes
+ * on its own threads; use the engine field of each job instead.
+ *
+ * @return #TJBATCH_ENGINE_HW, #TJBATCH_ENGINE_SW, or #TJBATCH_ENGINE_NONE if
+ * no image was finished on this thread yet
+ */
+DLLEXPORT int tjGetDecodeEngine(void);
+
+/**
+ * NV12 image decoded by the VC8000, returned in place
+ */
+typedef struct {
+  /** Y plane, first output pixel */
+  unsigned char *y;
+  /** Interleaved CbCr plane, first output pixel pair */
+  unsigned char *uv;
+  /** Bytes per row of both planes */
+  int stride;
+  /** Output width (in pixels), chroma rows hold (width + 1) / 2 pairs */
+  int width;
+  /** Output height (in pixels), the CbCr plane has (height + 1) / 2 rows */
+  int height;
+  /** Private */
+  void *session;
+  /** Private */
+  int slot;
+} tjnv12frame;
+
+/**
+ * Decompress a JPEG image with the VC8000 to NV12 and return the capture
+ * buffer planes without copying them.
+ *
+ * 4:2:0 color images are decoded as raw YCbCr, grayscale images through the Y
+ * plane (the hardware may reject them).  The frame keeps the capture buffer
+ * out of the hardware queue until #tjReleaseNV12() is called.
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param width desired width (in pixels) of the image, 0 = source width
+ *
+ * @param height desired height (in pixels) of the image, 0 = source height
+ *
+ * @param flags bitwise OR of TJFLAG_FASTDCT
+ *
+ * @param frame receives the planes
+ *
+ * @return 0 if successful, or -1 if the image cannot be decoded to NV12 by
+ * the hardware (use #tjDecompressToYUV2() then.)
+ */
+DLLEXPORT int tjDecompressToNV12(const unsigned char *jpegBuf,
+                                 unsigned long jpegSize, int width, int height,
+                                 int flags, tjnv12frame *frame);
+
+/**
+ * Return the capture buffer of a frame from #tjDecompressToNV12() to the
+ * hardware.  The plane pointers are invalid afterwards.
+ */
+DLLEXPORT void tjReleaseNV12(tjnv12frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
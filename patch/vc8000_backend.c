@@ -0,0 +1,79 @@
+/**
+ * @file vc8000_backend.c: VC8000 decode backend selection
+ *
+ * Copyright (C) 2021 nuvoton
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "vc8000_backend.h"
+
+/* Backend selected at first use */
+#define BACKEND_ENV_NAME		"VC8000_BACKEND"
+
+static const struct vc8000_backend *s_apsBackends[] = {
+	&g_sVC8000V4L2Backend,
+	&g_sVC8000EmuBackend,
+};
+
+static const struct vc8000_backend *s_psBackend = NULL;
+static pthread_once_t s_tBackendOnce = PTHREAD_ONCE_INIT;
+
+static const struct vc8000_backend *vc8000_backend_find(const char *szName)
+{
+	int i;
+
+	for(i = 0; i < sizeof(s_apsBackends) / sizeof(s_apsBackends[0]); i ++) {
+		if(strcmp(s_apsBackends[i]->name, szName) == 0)
+			return s_apsBackends[i];
+	}
+
+	return NULL;
+}
+
+static void vc8000_backend_init(void)
+{
+	const char *szName = getenv(BACKEND_ENV_NAME);
+	const struct vc8000_backend *psBackend = NULL;
+	const struct vc8000_backend *psUnset = NULL;
+
+	if(szName && szName[0]) {
+		psBackend = vc8000_backend_find(szName);
+		if(psBackend == NULL)
+			fprintf(stderr, "Unknown VC8000 backend %s, use %s \n", szName, g_sVC8000V4L2Backend.name);
+	}
+
+	if(psBackend == NULL)
+		psBackend = &g_sVC8000V4L2Backend;
+
+	//backend selected by caller before first use is kept
+	__atomic_compare_exchange_n(&s_psBackend, &psUnset, psBackend,
+			false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+const struct vc8000_backend *vc8000_backend(void)
+{
+	const struct vc8000_backend *psBackend = __atomic_load_n(&s_psBackend, __ATOMIC_ACQUIRE);
+
+	if(psBackend)
+		return psBackend;
+
+	pthread_once(&s_tBackendOnce, vc8000_backend_init);
+	return __atomic_load_n(&s_psBackend, __ATOMIC_ACQUIRE);
+}
+
+int vc8000_backend_select(
+	const char *szName
+)
+{
+	const struct vc8000_backend *psBackend = vc8000_backend_find(szName);
+
+	if(psBackend == NULL)
+		return -1;
+
+	__atomic_store_n(&s_psBackend, psBackend, __ATOMIC_RELEASE);
+	return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file vc8000_backend.h VC8000 decode backend interface
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * The library drives the decoder through a table of operations, so the V4L2
+ * driver (vc8000_v4l2.c) can be replaced by the in-process emulator
+ * (vc8000_emu.c) on machines without VC8000. The emulator decodes with the
+ * software decoder into the capture buffer layouts of the hardware.
+ * Semantics of each operation are those of the vc8000_v4l2_xxx/vc8000_jpeg_xxx
+ * function of the same name in vc8000_v4l2.h.
+ *
+ * Backend is selected by environment variable VC8000_BACKEND ("v4l2" or
+ * "emu") at first use, or by vc8000_backend_select() before first decode.
+ */
+
+#ifndef __VC8000_BACKEND_H__
+#define __VC8000_BACKEND_H__
+
+#include "vc8000_v4l2.h"
+
+struct vc8000_backend {
+	const char *name;
+
+	/* Session */
+	int (*open)(struct video **ppsVideo, int *pi32Slot, bool bShareable,
+				int pixel_format, int w, int h, uint32_t u32StreamBufSize);
+	void (*close)(struct video *psVideo, int slot);
+	void (*set_pipeline_depth)(int depth);
+	int (*get_node_count)(void);
+	int (*get_node_stats)(int node, struct vc8000_node_stats *psStats);
+
+	/* Capture buffer */
+	bool (*capture_memory_supported)(int memory);
+	bool (*capture_format_supported)(int pixel_format);
+	int (*export_capture)(struct video *psVideo, int n, int *pi32DmaBufFd);
+
+	/* Decode job */
+	int (*prepare_decompress)(struct video *psVideo, uint32_t u32ImageWidth, uint32_t u32ImageHeight,
+				uint32_t u32OutputWidth, uint32_t u32OutputHeight, bool bDirectFBOut,
+				struct video_fb_info *psFBInfo, uint32_t u32ImgFBPosX, uint32_t u32ImgFBPosY,
+				int i32RotOP, int pixel_format, int cap_memory, uint32_t u32StreamBufSize);
+	int (*prepare_bitstream)(struct video *psVideo, uint32_t u32StreamBufSize);
+	int (*get_bitstream_buffer)(struct video *psVideo, int slot, char **ppchBufferAddr);
+	int (*set_capture_buffer)(struct video *psVideo, int slot, void *pvAddr,
+				int i32DmaBufFd, uint32_t u32Size);
+	int (*set_deadline)(struct video *psVideo, int slot, uint32_t u32TimeoutMs);
+	int (*inqueue_bitstream_buffer)(struct video *psVideo, int slot, char *pchBufferAddr,
+				uint32_t u32StreamLen);
+	int (*poll_decode_done)(struct video *psVideo, int slot, int *p_cap_index);
+	int (*try_decode_done)(struct video *psVideo, int slot, int *p_cap_index);
+	int (*get_done_fd)(struct video *psVideo, int slot);
+	uint64_t (*get_decode_time)(struct video *psVideo, int slot);
+	int (*release_decompress)(struct video *psVideo, int slot);
+};
+
+/* V4L2 driver of /dev/videoN, default */
+extern const struct vc8000_backend g_sVC8000V4L2Backend;
+
+/* Software emulator, see vc8000_emu.c */
+extern const struct vc8000_backend g_sVC8000EmuBackend;
+
+//Current backend
+const struct vc8000_backend *vc8000_backend(void);
+
+//Select backend by name, return 0 or -1 if unknown. Sessions of previous backend must be closed
+int vc8000_backend_select(
+	const char *szName
+);
+
+#endif
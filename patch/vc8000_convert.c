@@ -0,0 +1,357 @@
+/**
+ * @file vc8000_convert.c: VC8000 capture buffer to scanline conversion
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * VC8000 writes ABGR32 as B, G, R, A bytes in memory. Each (capture format,
+ * output color space) pair has its own row converter, which runs the
+ * swizzle/copy kernel of simd/vc8000 picked for this CPU (NEON, SSSE3, AVX2
+ * or C). Kernels handle any width. X bytes of the RGBX family carry the
+ * hardware alpha byte like the A of the matching alpha layout.
+ *
+ * Raw data reads split NV12 chroma and YUYV rows into planes with the
+ * deinterleave kernels of the same table.
+ *
+ * Optionally a read of many rows is split into stripes of about one L1 cache
+ * of source bytes, converted by the caller and a pool of worker threads. The
+ * pool serves one image at a time, other readers convert on their own thread.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <linux/videodev2.h>
+
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "vc8000_convert.h"
+#include "simd/vc8000/jsimd_vc8000.h"
+
+/* Source byte of each output byte, BGRA source */
+static const uint8_t s_au8BGRAToRGB[4] = {2, 1, 0};
+static const uint8_t s_au8BGRAToBGR[4] = {0, 1, 2};
+static const uint8_t s_au8BGRAToARGB[4] = {3, 2, 1, 0};
+static const uint8_t s_au8BGRAToRGBA[4] = {2, 1, 0, 3};
+static const uint8_t s_au8BGRAToABGR[4] = {3, 0, 1, 2};
+
+/* Conversion threads (caller included) at first use */
+#define CONVERT_ENV_THREADS		"VC8000_CONVERT_THREADS"
+#define CONVERT_MAX_THREADS		8
+#define CONVERT_DEF_MIN_PIXELS	(640 * 480)
+#define CONVERT_STRIPE_BYTES	(32 * 1024)
+
+struct vc8000_convert_job {
+	PFN_VC8000_CONVERT_ROW pfnConvert;
+	const uint8_t *pu8Src;
+	uint32_t u32SrcStride;
+	uint8_t **ppu8Dst;
+	uint32_t u32Pixels;
+	uint32_t u32Rows;
+	uint32_t u32StripeRows;
+	uint32_t u32NextRow;			//first row of next stripe, atomic
+};
+
+static const struct vc8000_simd_kernels *s_psKernels = NULL;
+
+static void vc8000_convert_init(void);
+
+static int s_i32ConvertThreads = 1;
+static uint32_t s_u32ConvertMinPixels = CONVERT_DEF_MIN_PIXELS;
+static pthread_once_t s_tConvertOnce = PTHREAD_ONCE_INIT;
+
+//s_tPoolUseLock is held by the image using the pool, s_tPoolLock guards the rest
+static pthread_mutex_t s_tPoolUseLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t s_tPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_tPoolWorkCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_tPoolDoneCond = PTHREAD_COND_INITIALIZER;
+static int s_i32PoolWorkers = 0;
+static int s_i32PoolJobWorkers = 0;
+static int s_i32PoolBusyWorkers = 0;
+static uint32_t s_u32PoolJobSeq = 0;
+//job sequence before the submit creating the worker, its first job is the next one
+static uint32_t s_au32PoolWorkerSeq[CONVERT_MAX_THREADS];
+static struct vc8000_convert_job *s_psPoolJob = NULL;
+
+static void vc8000_bgra_to_rgb(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+)
+{
+	s_psKernels->swizzle4to3(pu8Src, pu8Dst, u32Pixels, s_au8BGRAToRGB);
+}
+
+static void vc8000_bgra_to_bgr(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+)
+{
+	s_psKernels->swizzle4to3(pu8Src, pu8Dst, u32Pixels, s_au8BGRAToBGR);
+}
+
+static void vc8000_bgra_to_argb(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+)
+{
+	s_psKernels->swizzle4to4(pu8Src, pu8Dst, u32Pixels, s_au8BGRAToARGB);
+}
+
+static void vc8000_bgra_to_rgba(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+)
+{
+	s_psKernels->swizzle4to4(pu8Src, pu8Dst, u32Pixels, s_au8BGRAToRGBA);
+}
+
+static void vc8000_bgra_to_abgr(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+)
+{
+	s_psKernels->swizzle4to4(pu8Src, pu8Dst, u32Pixels, s_au8BGRAToABGR);
+}
+
+//BGRA to BGRA
+static void vc8000_copy32(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+)
+{
+	s_psKernels->copy(pu8Src, pu8Dst, u32Pixels * 4);
+}
+
+//NV12 Y plane to grayscale
+static void vc8000_copy8(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+)
+{
+	s_psKernels->copy(pu8Src, pu8Dst, u32Pixels);
+}
+
+//RGB565 to RGB565
+static void vc8000_copy16(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+)
+{
+	s_psKernels->copy(pu8Src, pu8Dst, u32Pixels * 2);
+}
+
+PFN_VC8000_CONVERT_ROW vc8000_convert_select(
+	int pixel_format,
+	int out_color_space
+)
+{
+	//kernel table is set once, converters read it without lock
+	pthread_once(&s_tConvertOnce, vc8000_convert_init);
+
+	if(pixel_format == V4L2_PIX_FMT_ABGR32) {
+		switch(out_color_space) {
+		case JCS_RGB:
+		case JCS_EXT_RGB:
+			return vc8000_bgra_to_rgb;
+		case JCS_EXT_BGR:
+			return vc8000_bgra_to_bgr;
+		case JCS_EXT_ARGB:
+		case JCS_EXT_XRGB:
+			return vc8000_bgra_to_argb;
+		case JCS_EXT_RGBA:
+		case JCS_EXT_RGBX:
+			return vc8000_bgra_to_rgba;
+		case JCS_EXT_ABGR:
+		case JCS_EXT_XBGR:
+			return vc8000_bgra_to_abgr;
+		case JCS_EXT_BGRA:
+		case JCS_EXT_BGRX:
+			return vc8000_copy32;
+		}
+	}
+	else if(pixel_format == V4L2_PIX_FMT_RGB565) {
+		if(out_color_space == JCS_RGB565)
+			return vc8000_copy16;
+	}
+	else if(pixel_format == V4L2_PIX_FMT_NV12) {
+		if(out_color_space == JCS_GRAYSCALE)
+			return vc8000_copy8;
+	}
+
+	return NULL;
+}
+
+void vc8000_deinterleave2(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst0,
+	uint8_t *pu8Dst1,
+	uint32_t u32Pairs
+)
+{
+	pthread_once(&s_tConvertOnce, vc8000_convert_init);
+	s_psKernels->deinterleave2(pu8Src, pu8Dst0, pu8Dst1, u32Pairs);
+}
+
+void vc8000_deinterleave_yuyv(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Y,
+	uint8_t *pu8C1,
+	uint8_t *pu8C3,
+	uint32_t u32Pixels
+)
+{
+	pthread_once(&s_tConvertOnce, vc8000_convert_init);
+	s_psKernels->deinterleave_yuyv(pu8Src, pu8Y, pu8C1, pu8C3, u32Pixels);
+}
+
+//Convert stripes of job until all rows are taken
+static void vc8000_convert_stripes(
+	struct vc8000_convert_job *psJob
+)
+{
+	uint32_t u32Row;
+	uint32_t u32EndRow;
+
+	while((u32Row = __atomic_fetch_add(&psJob->u32NextRow, psJob->u32StripeRows, __ATOMIC_RELAXED)) < psJob->u32Rows) {
+		u32EndRow = u32Row + psJob->u32StripeRows;
+		if(u32EndRow > psJob->u32Rows)
+			u32EndRow = psJob->u32Rows;
+
+		for(; u32Row < u32EndRow; u32Row ++)
+			psJob->pfnConvert(psJob->pu8Src + ((size_t)u32Row * psJob->u32SrcStride), psJob->ppu8Dst[u32Row], psJob->u32Pixels);
+	}
+}
+
+static void *vc8000_convert_worker(
+	void *pvArg
+)
+{
+	int i32Index = (int)(intptr_t)pvArg;
+	struct vc8000_convert_job *psJob;
+	uint32_t u32Seq;
+
+	pthread_mutex_lock(&s_tPoolLock);
+	u32Seq = s_au32PoolWorkerSeq[i32Index];
+
+	while(1) {
+		while(s_u32PoolJobSeq == u32Seq)
+			pthread_cond_wait(&s_tPoolWorkCond, &s_tPoolLock);
+		u32Seq = s_u32PoolJobSeq;
+
+		//job may be finished already, or need fewer workers
+		psJob = s_psPoolJob;
+		if((psJob == NULL) || (i32Index >= s_i32PoolJobWorkers))
+			continue;
+
+		s_i32PoolBusyWorkers ++;
+		pthread_mutex_unlock(&s_tPoolLock);
+
+		vc8000_convert_stripes(psJob);
+
+		pthread_mutex_lock(&s_tPoolLock);
+		if(-- s_i32PoolBusyWorkers == 0)
+			pthread_cond_signal(&s_tPoolDoneCond);
+	}
+
+	return NULL;
+}
+
+static void vc8000_convert_init(void)
+{
+	const char *szThreads = getenv(CONVERT_ENV_THREADS);
+
+	s_psKernels = vc8000_simd_best();
+
+	if(szThreads && szThreads[0])
+		vc8000_convert_set_threads(atoi(szThreads), s_u32ConvertMinPixels);
+}
+
+void vc8000_convert_set_threads(
+	int i32Threads,
+	uint32_t u32MinPixels
+)
+{
+	//environment is read first, so a call overrides it
+	pthread_once(&s_tConvertOnce, vc8000_convert_init);
+
+	if(i32Threads < 1)
+		i32Threads = 1;
+	if(i32Threads > CONVERT_MAX_THREADS)
+		i32Threads = CONVERT_MAX_THREADS;
+
+	__atomic_store_n(&s_u32ConvertMinPixels, u32MinPixels, __ATOMIC_RELAXED);
+	__atomic_store_n(&s_i32ConvertThreads, i32Threads, __ATOMIC_RELAXED);
+}
+
+void vc8000_convert_rows(
+	PFN_VC8000_CONVERT_ROW pfnConvert,
+	const uint8_t *pu8Src,
+	uint32_t u32SrcStride,
+	uint8_t **ppu8Dst,
+	uint32_t u32Pixels,
+	uint32_t u32Rows
+)
+{
+	struct vc8000_convert_job sJob;
+	int i32Threads;
+	uint32_t u32Row;
+
+	pthread_once(&s_tConvertOnce, vc8000_convert_init);
+	i32Threads = __atomic_load_n(&s_i32ConvertThreads, __ATOMIC_RELAXED);
+
+	if((i32Threads <= 1) ||
+	   ((uint64_t)u32Pixels * u32Rows < __atomic_load_n(&s_u32ConvertMinPixels, __ATOMIC_RELAXED)) ||
+	   (pthread_mutex_trylock(&s_tPoolUseLock) != 0)) {
+		for(u32Row = 0; u32Row < u32Rows; u32Row ++)
+			pfnConvert(pu8Src + ((size_t)u32Row * u32SrcStride), ppu8Dst[u32Row], u32Pixels);
+		return;
+	}
+
+	sJob.pfnConvert = pfnConvert;
+	sJob.pu8Src = pu8Src;
+	sJob.u32SrcStride = u32SrcStride;
+	sJob.ppu8Dst = ppu8Dst;
+	sJob.u32Pixels = u32Pixels;
+	sJob.u32Rows = u32Rows;
+	sJob.u32StripeRows = u32SrcStride ? (CONVERT_STRIPE_BYTES / u32SrcStride) : 1;
+	if(sJob.u32StripeRows == 0)
+		sJob.u32StripeRows = 1;
+	sJob.u32NextRow = 0;
+
+	pthread_mutex_lock(&s_tPoolLock);
+
+	//workers are created on demand and live for the process
+	while(s_i32PoolWorkers < i32Threads - 1) {
+		pthread_t tWorker;
+
+		s_au32PoolWorkerSeq[s_i32PoolWorkers] = s_u32PoolJobSeq;
+		if(pthread_create(&tWorker, NULL, vc8000_convert_worker, (void *)(intptr_t)s_i32PoolWorkers) != 0)
+			break;
+		pthread_detach(tWorker);
+		s_i32PoolWorkers ++;
+	}
+
+	s_i32PoolJobWorkers = i32Threads - 1;
+	s_psPoolJob = &sJob;
+	s_u32PoolJobSeq ++;
+	pthread_cond_broadcast(&s_tPoolWorkCond);
+	pthread_mutex_unlock(&s_tPoolLock);
+
+	vc8000_convert_stripes(&sJob);
+
+	//all rows are taken, wait for stripes still converted by workers
+	pthread_mutex_lock(&s_tPoolLock);
+	s_psPoolJob = NULL;
+	while(s_i32PoolBusyWorkers > 0)
+		pthread_cond_wait(&s_tPoolDoneCond, &s_tPoolLock);
+	pthread_mutex_unlock(&s_tPoolLock);
+
+	pthread_mutex_unlock(&s_tPoolUseLock);
+}
@@ -0,0 +1,68 @@
+/**
+ * @file vc8000_convert.h VC8000 capture buffer to scanline conversion
+ *
+ * Copyright (C) 2021 nuvoton
+ */
+
+#ifndef __VC8000_CONVERT_H__
+#define __VC8000_CONVERT_H__
+
+#include <inttypes.h>
+
+/* Convert u32Pixels pixels of one capture buffer row into a scanline */
+typedef void (*PFN_VC8000_CONVERT_ROW)(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst,
+	uint32_t u32Pixels
+);
+
+/*
+Row converter from capture pixel format (V4L2_PIX_FMT_xxx) to output color
+space (J_COLOR_SPACE), selected once per image. NULL if not supported.
+*/
+PFN_VC8000_CONVERT_ROW vc8000_convert_select(
+	int pixel_format,
+	int out_color_space
+);
+
+/*
+Convert u32Rows rows of u32SrcStride bytes starting at pu8Src into ppu8Dst[]
+rows. Reads of at least the minimum pixel count are split into stripes over
+the conversion thread pool if more than one thread is set.
+*/
+void vc8000_convert_rows(
+	PFN_VC8000_CONVERT_ROW pfnConvert,
+	const uint8_t *pu8Src,
+	uint32_t u32SrcStride,
+	uint8_t **ppu8Dst,
+	uint32_t u32Pixels,
+	uint32_t u32Rows
+);
+
+/* NV12/NV24 CbCr row of u32Pairs pairs to two planes */
+void vc8000_deinterleave2(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Dst0,
+	uint8_t *pu8Dst1,
+	uint32_t u32Pairs
+);
+
+/*
+YUYV row to planes, bytes 0/2 of each pixel pair to pu8Y, byte 1 to pu8C1 and
+byte 3 to pu8C3. Odd u32Pixels also return chroma of the last pair.
+*/
+void vc8000_deinterleave_yuyv(
+	const uint8_t *pu8Src,
+	uint8_t *pu8Y,
+	uint8_t *pu8C1,
+	uint8_t *pu8C3,
+	uint32_t u32Pixels
+);
+
+/* Threads converting one read (caller included, 1 disables the pool) */
+void vc8000_convert_set_threads(
+	int i32Threads,
+	uint32_t u32MinPixels
+);
+
+#endif
@@ -0,0 +1,339 @@
+/**
+ * @file vc8000_costmodel.c: HW/SW decode cost model
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Latency of VC8000 and software decode is learned per image class (source
+ * size, scale factor, output format, subsampling) from live decodes, and each
+ * decode is routed to the faster engine. Small images are faster in software
+ * because of the hardware setup cost, large images are faster in hardware.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <pthread.h>
+
+//#define ENABLE_DBG
+
+#include "vc8000_costmodel.h"
+
+/* Number of image classes kept */
+#define COSTMODEL_MAX_ENTRY			256
+
+/* Samples of each engine needed before the model is trusted */
+#define COSTMODEL_MIN_SAMPLES		2
+
+/* Slower engine is retried once per interval to follow load changes */
+#define COSTMODEL_PROBE_INTERVAL	64
+
+/* EWMA weight of new sample is 1/COSTMODEL_EWMA_DIV */
+#define COSTMODEL_EWMA_DIV			8
+
+/* Model file read at first use */
+#define COSTMODEL_ENV_FILE			"VC8000_COSTMODEL_FILE"
+
+#define COSTMODEL_FILE_HEADER		"# vc8000 cost model v1"
+
+#define ENGINE_IDX(e)	((e) - eVC8000_ENGINE_HW)
+
+struct vc8000_cost_entry {
+	bool used;
+	uint32_t key;
+	double ns_per_pixel[2];		/* indexed by ENGINE_IDX() */
+	uint32_t samples[2];
+	uint32_t decisions;
+};
+
+static struct vc8000_cost_entry s_asCostEntry[COSTMODEL_MAX_ENTRY];
+static int s_i32Dispatch = eVC8000_DISPATCH_COST_MODEL;
+static pthread_mutex_t s_tCostLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t s_tCostOnce = PTHREAD_ONCE_INIT;
+
+uint64_t vc8000_costmodel_time_ns(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000ULL + tNow.tv_nsec;
+}
+
+static void vc8000_costmodel_init(void)
+{
+	const char *szPath = getenv(COSTMODEL_ENV_FILE);
+
+	if(szPath && szPath[0]) {
+		if(vc8000_costmodel_import(szPath) < 0)
+			fprintf(stderr, "Unable import VC8000 cost model %s \n", szPath);
+	}
+}
+
+void vc8000_costmodel_set_dispatch(int i32Mode)
+{
+	pthread_mutex_lock(&s_tCostLock);
+	s_i32Dispatch = i32Mode;
+	pthread_mutex_unlock(&s_tCostLock);
+}
+
+int vc8000_costmodel_get_dispatch(void)
+{
+	int i32Mode;
+
+	pthread_mutex_lock(&s_tCostLock);
+	i32Mode = s_i32Dispatch;
+	pthread_mutex_unlock(&s_tCostLock);
+
+	return i32Mode;
+}
+
+uint32_t vc8000_costmodel_key(
+	uint32_t u32SrcWidth,
+	uint32_t u32SrcHeight,
+	uint32_t u32ScaleNum,
+	uint32_t u32ScaleDenom,
+	int i32OutFormat,
+	int i32Subsampling
+)
+{
+	uint64_t u64Pixels = (uint64_t)u32SrcWidth * u32SrcHeight;
+	uint32_t u32SizeBucket = 0;
+	uint32_t u32Scale;
+	int i32Bit;
+
+	//half-octave size bucket: 2 * log2(pixels), rounded by next bit
+	for(i32Bit = 63; i32Bit > 0; i32Bit --) {
+		if(u64Pixels & (1ULL << i32Bit))
+			break;
+	}
+
+	u32SizeBucket = i32Bit * 2;
+	if((i32Bit > 0) && (u64Pixels & (1ULL << (i32Bit - 1))))
+		u32SizeBucket ++;
+
+	//scale factor in 1/8 unit
+	if(u32ScaleDenom == 0)
+		u32ScaleDenom = 1;
+	u32Scale = (u32ScaleNum * 8 + u32ScaleDenom / 2) / u32ScaleDenom;
+	if(u32Scale > 0xff)
+		u32Scale = 0xff;
+
+	return ((u32SizeBucket & 0x7f) << 16) | (u32Scale << 8) |
+		((i32OutFormat & 0x1f) << 3) | (i32Subsampling & 0x7);
+}
+
+//Find entry of key, must hold s_tCostLock
+static struct vc8000_cost_entry *vc8000_costmodel_find(
+	uint32_t u32Key,
+	bool bCreate
+)
+{
+	uint32_t u32Idx = (u32Key * 2654435761U) % COSTMODEL_MAX_ENTRY;
+	int i;
+
+	for(i = 0; i < COSTMODEL_MAX_ENTRY; i ++) {
+		struct vc8000_cost_entry *psEntry = &s_asCostEntry[(u32Idx + i) % COSTMODEL_MAX_ENTRY];
+
+		if(psEntry->used) {
+			if(psEntry->key == u32Key)
+				return psEntry;
+			continue;
+		}
+
+		if(!bCreate)
+			return NULL;
+
+		memset(psEntry, 0, sizeof(struct vc8000_cost_entry));
+		psEntry->used = true;
+		psEntry->key = u32Key;
+		return psEntry;
+	}
+
+	return NULL;
+}
+
+E_VC8000_ENGINE vc8000_costmodel_choose(
+	uint32_t u32Key
+)
+{
+	struct vc8000_cost_entry *psEntry;
+	E_VC8000_ENGINE eEngine;
+	E_VC8000_ENGINE eSlower;
+
+	pthread_once(&s_tCostOnce, vc8000_costmodel_init);
+
+	pthread_mutex_lock(&s_tCostLock);
+
+	if(s_i32Dispatch != eVC8000_DISPATCH_COST_MODEL) {
+		pthread_mutex_unlock(&s_tCostLock);
+		return eVC8000_ENGINE_HW;
+	}
+
+	psEntry = vc8000_costmodel_find(u32Key, true);
+	if(psEntry == NULL) {
+		//table full, keep hardware as before
+		pthread_mutex_unlock(&s_tCostLock);
+		return eVC8000_ENGINE_HW;
+	}
+
+	psEntry->decisions ++;
+
+	//calibration, measure both engines
+	if(psEntry->samples[ENGINE_IDX(eVC8000_ENGINE_HW)] < COSTMODEL_MIN_SAMPLES)
+		eEngine = eVC8000_ENGINE_HW;
+	else if(psEntry->samples[ENGINE_IDX(eVC8000_ENGINE_SW)] < COSTMODEL_MIN_SAMPLES)
+		eEngine = eVC8000_ENGINE_SW;
+	else {
+		if(psEntry->ns_per_pixel[ENGINE_IDX(eVC8000_ENGINE_HW)] <= psEntry->ns_per_pixel[ENGINE_IDX(eVC8000_ENGINE_SW)]) {
+			eEngine = eVC8000_ENGINE_HW;
+			eSlower = eVC8000_ENGINE_SW;
+		}
+		else {
+			eEngine = eVC8000_ENGINE_SW;
+			eSlower = eVC8000_ENGINE_HW;
+		}
+
+		if((psEntry->decisions % COSTMODEL_PROBE_INTERVAL) == 0)
+			eEngine = eSlower;
+	}
+
+	pthread_mutex_unlock(&s_tCostLock);
+
+#if defined (ENABLE_DBG)
+	fprintf(stdout, "Cost model key 0x%x choose %s \n", u32Key, (eEngine == eVC8000_ENGINE_HW) ? "HW" : "SW");
+#endif
+
+	return eEngine;
+}
+
+void vc8000_costmodel_record(
+	uint32_t u32Key,
+	E_VC8000_ENGINE eEngine,
+	uint32_t u32SrcPixels,
+	uint64_t u64DecodeNs
+)
+{
+	struct vc8000_cost_entry *psEntry;
+	double dNsPerPixel;
+	int i32Idx;
+
+	if((eEngine != eVC8000_ENGINE_HW) && (eEngine != eVC8000_ENGINE_SW))
+		return;
+
+	if(u32SrcPixels == 0)
+		return;
+
+	i32Idx = ENGINE_IDX(eEngine);
+	dNsPerPixel = (double)u64DecodeNs / u32SrcPixels;
+
+	pthread_mutex_lock(&s_tCostLock);
+
+	psEntry = vc8000_costmodel_find(u32Key, true);
+	if(psEntry) {
+		if(psEntry->samples[i32Idx] == 0)
+			psEntry->ns_per_pixel[i32Idx] = dNsPerPixel;
+		else
+			psEntry->ns_per_pixel[i32Idx] += (dNsPerPixel - psEntry->ns_per_pixel[i32Idx]) / COSTMODEL_EWMA_DIV;
+
+		if(psEntry->samples[i32Idx] < UINT32_MAX)
+			psEntry->samples[i32Idx] ++;
+	}
+
+	pthread_mutex_unlock(&s_tCostLock);
+
+#if defined (ENABLE_DBG)
+	fprintf(stdout, "Cost model key 0x%x %s %f ns/pixel \n", u32Key, (eEngine == eVC8000_ENGINE_HW) ? "HW" : "SW", dNsPerPixel);
+#endif
+}
+
+int vc8000_costmodel_export(
+	const char *szPath
+)
+{
+	FILE *psFile;
+	int i32Cnt = 0;
+	int i;
+
+	psFile = fopen(szPath, "w");
+	if(psFile == NULL)
+		return -1;
+
+	fprintf(psFile, "%s\n", COSTMODEL_FILE_HEADER);
+	fprintf(psFile, "# key hw_ns_per_pixel hw_samples sw_ns_per_pixel sw_samples\n");
+
+	pthread_mutex_lock(&s_tCostLock);
+	for(i = 0; i < COSTMODEL_MAX_ENTRY; i ++) {
+		struct vc8000_cost_entry *psEntry = &s_asCostEntry[i];
+
+		if(!psEntry->used)
+			continue;
+
+		fprintf(psFile, "0x%08x %.4f %u %.4f %u\n", psEntry->key,
+			psEntry->ns_per_pixel[ENGINE_IDX(eVC8000_ENGINE_HW)], psEntry->samples[ENGINE_IDX(eVC8000_ENGINE_HW)],
+			psEntry->ns_per_pixel[ENGINE_IDX(eVC8000_ENGINE_SW)], psEntry->samples[ENGINE_IDX(eVC8000_ENGINE_SW)]);
+		i32Cnt ++;
+	}
+	pthread_mutex_unlock(&s_tCostLock);
+
+	if(fclose(psFile) != 0)
+		return -1;
+
+	return i32Cnt;
+}
+
+int vc8000_costmodel_import(
+	const char *szPath
+)
+{
+	FILE *psFile;
+	char achLine[128];
+	int i32Cnt = 0;
+
+	psFile = fopen(szPath, "r");
+	if(psFile == NULL)
+		return -1;
+
+	if((fgets(achLine, sizeof(achLine), psFile) == NULL) ||
+	   (strncmp(achLine, COSTMODEL_FILE_HEADER, strlen(COSTMODEL_FILE_HEADER)) != 0)) {
+		fclose(psFile);
+		return -1;
+	}
+
+	pthread_mutex_lock(&s_tCostLock);
+	while(fgets(achLine, sizeof(achLine), psFile)) {
+		struct vc8000_cost_entry *psEntry;
+		unsigned int u32Key;
+		double dHWNs, dSWNs;
+		unsigned int u32HWSamples, u32SWSamples;
+
+		if(achLine[0] == '#')
+			continue;
+
+		if(sscanf(achLine, "%x %lf %u %lf %u", &u32Key, &dHWNs, &u32HWSamples, &dSWNs, &u32SWSamples) != 5)
+			continue;
+
+		psEntry = vc8000_costmodel_find(u32Key, true);
+		if(psEntry == NULL)
+			break;
+
+		//imported calibration replaces local one
+		psEntry->ns_per_pixel[ENGINE_IDX(eVC8000_ENGINE_HW)] = dHWNs;
+		psEntry->samples[ENGINE_IDX(eVC8000_ENGINE_HW)] = u32HWSamples;
+		psEntry->ns_per_pixel[ENGINE_IDX(eVC8000_ENGINE_SW)] = dSWNs;
+		psEntry->samples[ENGINE_IDX(eVC8000_ENGINE_SW)] = u32SWSamples;
+		i32Cnt ++;
+	}
+	pthread_mutex_unlock(&s_tCostLock);
+
+	fclose(psFile);
+	return i32Cnt;
+}
+
+void vc8000_costmodel_reset(void)
+{
+	pthread_mutex_lock(&s_tCostLock);
+	memset(s_asCostEntry, 0, sizeof(s_asCostEntry));
+	pthread_mutex_unlock(&s_tCostLock);
+}
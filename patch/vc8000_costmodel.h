@@ -0,0 +1,72 @@
+/**
+ * @file vc8000_costmodel.h HW/SW decode cost model
+ *
+ * Copyright (C) 2021 nuvoton
+ */
+
+#ifndef __VC8000_COSTMODEL_H__
+#define __VC8000_COSTMODEL_H__
+
+#include <stdio.h>
+#include <inttypes.h>
+
+/* Decode engine */
+typedef enum {
+	eVC8000_ENGINE_NONE = 0,	/* not decided/not measured */
+	eVC8000_ENGINE_HW,
+	eVC8000_ENGINE_SW,
+} E_VC8000_ENGINE;
+
+/* Output format of raw (YUV) output in model key, other formats use J_COLOR_SPACE */
+#define VC8000_COST_FMT_RAW		0x1f
+
+/* Dispatch mode */
+typedef enum {
+	eVC8000_DISPATCH_HW = 0,		/* hardware whenever image is decodable by VC8000 */
+	eVC8000_DISPATCH_COST_MODEL,	/* faster engine by measured latency (default) */
+} E_VC8000_DISPATCH;
+
+/* Monotonic time in ns */
+uint64_t vc8000_costmodel_time_ns(void);
+
+void vc8000_costmodel_set_dispatch(int i32Mode);
+
+int vc8000_costmodel_get_dispatch(void);
+
+//Model key from source size, scale factor, output format and subsampling
+uint32_t vc8000_costmodel_key(
+	uint32_t u32SrcWidth,
+	uint32_t u32SrcHeight,
+	uint32_t u32ScaleNum,
+	uint32_t u32ScaleDenom,
+	int i32OutFormat,
+	int i32Subsampling
+);
+
+//Pick engine for next decode. Engine short of samples is tried first (calibration)
+E_VC8000_ENGINE vc8000_costmodel_choose(
+	uint32_t u32Key
+);
+
+//Feed latency of a finished decode
+void vc8000_costmodel_record(
+	uint32_t u32Key,
+	E_VC8000_ENGINE eEngine,
+	uint32_t u32SrcPixels,
+	uint64_t u64DecodeNs
+);
+
+//Write model to text file, return number of entries or -1
+int vc8000_costmodel_export(
+	const char *szPath
+);
+
+//Merge model from text file written by vc8000_costmodel_export(), return number of entries or -1
+int vc8000_costmodel_import(
+	const char *szPath
+);
+
+//Forget all measurements
+void vc8000_costmodel_reset(void);
+
+#endif
@@ -0,0 +1,1002 @@
+/**
+ * @file vc8000_emu.c: in-process VC8000 emulator backend
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Emulates one VC8000 node without V4L2. Jobs are decoded one by one by an
+ * emulator thread, as the hardware does, using the software decoder of this
+ * library. The decoded image is post processed into the capture buffer
+ * layouts of the hardware (ABGR32, RGB565, NV12, NV24 and YUYV) with scaling
+ * and rotation, so the library path above the backend runs unchanged on any
+ * Linux machine. DCT scaling picks the smallest decode size covering the
+ * output, the rest of the scaling takes nearest samples; pixels are not
+ * bit exact to the hardware post processor. Unscaled YUV output carries the
+ * decoded samples, so raw data matches software decoding (see vc8kemutest.c).
+ *
+ * Frame buffer output and dmabuf capture buffers are not emulated.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <pthread.h>
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jpeglib_ext.h"
+#include "vc8000_backend.h"
+
+#define EMU_POOL_MAX_SESSION	8
+#define EMU_DEV_NAME			"emu"
+
+#define PP_OUT_MAX_WIDTH_UPSCALED(d) (3*(d))
+#define PP_OUT_MAX_HEIGHT_UPSCALED(d) (3*(d) - 2)
+
+/* Emulator session, struct video must be first */
+struct vc8000_emu_session {
+	struct video sVideo;
+	unsigned char *pu8Decoded;		/* software decoded image */
+	size_t u32DecodedSize;
+};
+
+struct vc8000_emu_error_mgr {
+	struct jpeg_error_mgr pub;
+	jmp_buf setjmp_buffer;
+};
+
+static pthread_mutex_t s_tEmuLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_tEmuJobQueuedCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_tEmuJobDoneCond;	/* CLOCK_MONOTONIC */
+static pthread_once_t s_tEmuOnce = PTHREAD_ONCE_INIT;
+static bool s_bEmuThreadStarted = false;
+
+static struct vc8000_job *s_psEmuJobHead = NULL;
+static struct vc8000_job *s_psEmuJobTail = NULL;
+static struct video *s_psEmuIdleSession = NULL;
+static int s_i32EmuIdleSessionCnt = 0;
+static struct vc8000_node_stats s_sEmuStats;
+
+static uint64_t vc8000_emu_time_ns(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000ULL + tNow.tv_nsec;
+}
+
+static void vc8000_emu_init(void)
+{
+	pthread_condattr_t tCondAttr;
+
+	pthread_condattr_init(&tCondAttr);
+	pthread_condattr_setclock(&tCondAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&s_tEmuJobDoneCond, &tCondAttr);
+	pthread_condattr_destroy(&tCondAttr);
+
+	strcpy(s_sEmuStats.dev_name, EMU_DEV_NAME);
+}
+
+//Capture plane size of pixel format, 0 if format is not emulated
+static uint32_t vc8000_emu_plane_size(
+	int pixel_format,
+	int w,
+	int h,
+	int *pi32BytesPerLine
+)
+{
+	switch(pixel_format) {
+	case V4L2_PIX_FMT_ABGR32:
+		*pi32BytesPerLine = w * 4;
+		return w * h * 4;
+	case V4L2_PIX_FMT_RGB565:
+		*pi32BytesPerLine = w * 2;
+		return w * h * 2;
+	case V4L2_PIX_FMT_YUYV:
+		*pi32BytesPerLine = w * 2;
+		return w * h * 2;
+	case V4L2_PIX_FMT_NV12:
+		//Y plane followed by CbCr plane of half height
+		*pi32BytesPerLine = w;
+		return (w * h) + ((w / 2) * 2 * ((h + 1) / 2));
+	case V4L2_PIX_FMT_NV24:
+		//Y plane followed by full size CbCr plane
+		*pi32BytesPerLine = w;
+		return w * h * 3;
+	}
+
+	return 0;
+}
+
+/*
+ * Map output pixel of rotated image back to decoded image.
+ * Output is i32OutW x i32OutH, pi32U, pi32V return position in the unrotated output.
+ */
+static void vc8000_emu_rotate(
+	int i32RotOP,
+	int x,
+	int y,
+	int i32OutW,
+	int i32OutH,
+	int *pi32U,
+	int *pi32V
+)
+{
+	switch(i32RotOP) {
+	case PP_ROTATION_RIGHT_90:
+		*pi32U = y;
+		*pi32V = i32OutW - 1 - x;
+		break;
+	case PP_ROTATION_LEFT_90:
+		*pi32U = i32OutH - 1 - y;
+		*pi32V = x;
+		break;
+	case PP_ROTATION_HOR_FLIP:
+		*pi32U = i32OutW - 1 - x;
+		*pi32V = y;
+		break;
+	case PP_ROTATION_VER_FLIP:
+		*pi32U = x;
+		*pi32V = i32OutH - 1 - y;
+		break;
+	case PP_ROTATION_180:
+		*pi32U = i32OutW - 1 - x;
+		*pi32V = i32OutH - 1 - y;
+		break;
+	default:
+		*pi32U = x;
+		*pi32V = y;
+		break;
+	}
+}
+
+/*
+ * Post processor: scale and rotate decoded image into capture buffer.
+ * Decoded image is RGB or YCbCr by pixel format, or grayscale.
+ */
+static void vc8000_emu_post_process(
+	struct video *psVideo,
+	const unsigned char *pu8Src,
+	int i32SrcW,
+	int i32SrcH,
+	int i32SrcComps,
+	unsigned char *pu8Dst
+)
+{
+	int i32OutW = psVideo->cap_w;
+	int i32OutH = psVideo->cap_h;
+	int i32RotOP = psVideo->pp_params.rotation;
+	int i32ScaledW = i32OutW;
+	int i32ScaledH = i32OutH;
+	unsigned char *pu8UV = pu8Dst + (i32OutW * i32OutH);
+	int i32UVRowBytes = (psVideo->cap_pixel_format == V4L2_PIX_FMT_NV24) ? i32OutW * 2 : (i32OutW / 2) * 2;
+	unsigned char u8PairCb = 128;
+	int x, y, u, v;
+
+	if((i32RotOP == PP_ROTATION_RIGHT_90) || (i32RotOP == PP_ROTATION_LEFT_90)) {
+		i32ScaledW = i32OutH;
+		i32ScaledH = i32OutW;
+	}
+
+	for(y = 0; y < i32OutH; y ++) {
+		for(x = 0; x < i32OutW; x ++) {
+			const unsigned char *pu8Pixel;
+			unsigned char c0, c1, c2;
+
+			vc8000_emu_rotate(i32RotOP, x, y, i32OutW, i32OutH, &u, &v);
+			pu8Pixel = pu8Src + ((((uint64_t)v * i32SrcH / i32ScaledH) * i32SrcW) +
+						((uint64_t)u * i32SrcW / i32ScaledW)) * i32SrcComps;
+
+			if(i32SrcComps == 1) {
+				c0 = pu8Pixel[0];
+				if((psVideo->cap_pixel_format == V4L2_PIX_FMT_NV12) ||
+				   (psVideo->cap_pixel_format == V4L2_PIX_FMT_NV24) ||
+				   (psVideo->cap_pixel_format == V4L2_PIX_FMT_YUYV)) {
+					c1 = 128;
+					c2 = 128;
+				}
+				else {
+					c1 = c0;
+					c2 = c0;
+				}
+			}
+			else {
+				c0 = pu8Pixel[0];
+				c1 = pu8Pixel[1];
+				c2 = pu8Pixel[2];
+			}
+
+			switch(psVideo->cap_pixel_format) {
+			case V4L2_PIX_FMT_ABGR32:
+				//memory order B, G, R, A
+				pu8Dst[0] = c2;
+				pu8Dst[1] = c1;
+				pu8Dst[2] = c0;
+				pu8Dst[3] = 0xff;
+				pu8Dst += 4;
+				break;
+			case V4L2_PIX_FMT_RGB565:
+				{
+					uint16_t u16Pixel = ((c0 >> 3) << 11) | ((c1 >> 2) << 5) | (c2 >> 3);
+
+					pu8Dst[0] = u16Pixel & 0xff;
+					pu8Dst[1] = u16Pixel >> 8;
+					pu8Dst += 2;
+				}
+				break;
+			case V4L2_PIX_FMT_YUYV:
+				//Y0 Cr Y1 Cb as the hardware writes it, chroma of pixel pair taken from even pixel
+				pu8Dst[0] = c0;
+				if(x & 1) {
+					pu8Dst[1] = u8PairCb;
+				}
+				else {
+					pu8Dst[1] = c2;
+					u8PairCb = c1;
+				}
+				pu8Dst += 2;
+				break;
+			case V4L2_PIX_FMT_NV12:
+				pu8Dst[0] = c0;
+				pu8Dst += 1;
+				if(!(x & 1) && !(y & 1) && (x + 1 < i32OutW)) {
+					pu8UV[(y / 2) * i32UVRowBytes + x] = c1;
+					pu8UV[(y / 2) * i32UVRowBytes + x + 1] = c2;
+				}
+				break;
+			case V4L2_PIX_FMT_NV24:
+				pu8Dst[0] = c0;
+				pu8Dst += 1;
+				pu8UV[y * i32UVRowBytes + (x * 2)] = c1;
+				pu8UV[y * i32UVRowBytes + (x * 2) + 1] = c2;
+				break;
+			}
+		}
+	}
+}
+
+static void vc8000_emu_error_exit(j_common_ptr cinfo)
+{
+	struct vc8000_emu_error_mgr *err = (struct vc8000_emu_error_mgr *)cinfo->err;
+
+	longjmp(err->setjmp_buffer, 1);
+}
+
+//Decode bitstream of job into its capture buffer by software, return 0 on success
+static int vc8000_emu_decode(
+	struct vc8000_job *psJob
+)
+{
+	struct vc8000_emu_session *psSession = (struct vc8000_emu_session *)psJob->psVideo;
+	struct video *psVideo = psJob->psVideo;
+	struct jpeg_decompress_struct sInfo;
+	struct vc8000_emu_error_mgr sErr;
+	unsigned char *pu8Dst;
+	JSAMPROW pRow;
+	uint32_t u32ScaledW;
+	uint32_t u32ScaledH;
+	size_t u32DecodedSize;
+	unsigned int n;
+
+	if(psVideo->cap_memory == V4L2_MEMORY_MMAP)
+		pu8Dst = (unsigned char *)psVideo->cap_buf_addr[psJob->slot][0];
+	else
+		pu8Dst = (unsigned char *)psJob->user_addr;
+
+	if(pu8Dst == NULL)
+		return -1;
+
+	memset(&sInfo, 0, sizeof(sInfo));
+	sInfo.err = jpeg_std_error(&sErr.pub);
+	sErr.pub.error_exit = vc8000_emu_error_exit;
+
+	if(setjmp(sErr.setjmp_buffer)) {
+		jpeg_destroy_decompress(&sInfo);
+		return -1;
+	}
+
+	jpeg_CreateDecompress_Ext(&sInfo, JPEG_LIB_VERSION, sizeof(struct jpeg_decompress_struct), FALSE);
+	jpeg_mem_src(&sInfo, (const unsigned char *)psVideo->out_buf_addr[psJob->slot], psJob->stream_len);
+	jpeg_read_header(&sInfo, TRUE);
+
+	if(sInfo.num_components == 1)
+		sInfo.out_color_space = JCS_GRAYSCALE;
+	else if((psVideo->cap_pixel_format == V4L2_PIX_FMT_NV12) || (psVideo->cap_pixel_format == V4L2_PIX_FMT_NV24) ||
+			(psVideo->cap_pixel_format == V4L2_PIX_FMT_YUYV)) {
+		sInfo.out_color_space = JCS_YCbCr;
+		//chroma of even pixels must be the decoded samples, as hardware raw output
+		sInfo.do_fancy_upsampling = FALSE;
+	}
+	else
+		sInfo.out_color_space = JCS_RGB;
+
+	//smallest DCT scaled size which still covers the (unrotated) output
+	u32ScaledW = psVideo->cap_w;
+	u32ScaledH = psVideo->cap_h;
+	if((psVideo->pp_params.rotation == PP_ROTATION_RIGHT_90) || (psVideo->pp_params.rotation == PP_ROTATION_LEFT_90)) {
+		u32ScaledW = psVideo->cap_h;
+		u32ScaledH = psVideo->cap_w;
+	}
+
+	sInfo.scale_denom = 8;
+	for(n = 1; n < 8; n ++) {
+		if((((sInfo.image_width * n + 7) / 8) >= u32ScaledW) &&
+		   (((sInfo.image_height * n + 7) / 8) >= u32ScaledH))
+			break;
+	}
+	sInfo.scale_num = n;
+
+	jpeg_start_decompress(&sInfo);
+
+	//emulated hardware decode is not an image of the caller
+	sInfo.master->bHWStatsOpen = FALSE;
+
+	u32DecodedSize = (size_t)sInfo.output_width * sInfo.output_height * sInfo.output_components;
+	if(psSession->u32DecodedSize < u32DecodedSize) {
+		unsigned char *pu8Decoded = realloc(psSession->pu8Decoded, u32DecodedSize);
+
+		if(pu8Decoded == NULL) {
+			jpeg_destroy_decompress(&sInfo);
+			return -1;
+		}
+
+		psSession->pu8Decoded = pu8Decoded;
+		psSession->u32DecodedSize = u32DecodedSize;
+	}
+
+	while(sInfo.output_scanline < sInfo.output_height) {
+		pRow = psSession->pu8Decoded + ((size_t)sInfo.output_scanline * sInfo.output_width * sInfo.output_components);
+		jpeg_read_scanlines(&sInfo, &pRow, 1);
+	}
+
+	vc8000_emu_post_process(psVideo, psSession->pu8Decoded,
+							sInfo.output_width, sInfo.output_height, sInfo.output_components,
+							pu8Dst);
+
+	jpeg_finish_decompress(&sInfo);
+	jpeg_destroy_decompress(&sInfo);
+	return 0;
+}
+
+//Finish job, must hold s_tEmuLock
+static void vc8000_emu_complete(
+	struct vc8000_job *psJob,
+	int i32Result
+)
+{
+	uint64_t u64Cnt = 1;
+
+	if(i32Result == 0)
+		s_sEmuStats.jobs_done ++;
+	else
+		s_sEmuStats.jobs_failed ++;
+
+	psJob->result = i32Result;
+	psJob->cap_index = psJob->slot;
+	psJob->state = eVC8000_JOB_DONE;
+	psJob->decode_ns = vc8000_emu_time_ns() - psJob->submit_ns;
+	pthread_cond_broadcast(&s_tEmuJobDoneCond);
+
+	if(write(psJob->evt_fd, &u64Cnt, sizeof(u64Cnt)) != sizeof(u64Cnt))
+		fprintf(stderr, "Unable signal job done event \n");
+}
+
+//Emulated hardware, decodes queued jobs one by one
+static void *vc8000_emu_thread(void *arg)
+{
+	struct vc8000_job *psJob;
+	uint64_t u64StartNs;
+	int i32Ret;
+
+	pthread_mutex_lock(&s_tEmuLock);
+
+	for(;;) {
+		while(s_psEmuJobHead == NULL)
+			pthread_cond_wait(&s_tEmuJobQueuedCond, &s_tEmuLock);
+
+		psJob = s_psEmuJobHead;
+		s_psEmuJobHead = psJob->next;
+		if(s_psEmuJobHead == NULL)
+			s_psEmuJobTail = NULL;
+		psJob->next = NULL;
+		psJob->state = eVC8000_JOB_RUNNING;
+		pthread_mutex_unlock(&s_tEmuLock);
+
+		u64StartNs = vc8000_emu_time_ns();
+		i32Ret = vc8000_emu_decode(psJob);
+
+		pthread_mutex_lock(&s_tEmuLock);
+		s_sEmuStats.busy_ns += vc8000_emu_time_ns() - u64StartNs;
+		vc8000_emu_complete(psJob, psJob->cancel ? VC8000_JOB_ERR_TIMEOUT : i32Ret);
+	}
+
+	return NULL;
+}
+
+/*
+ * Cancel job, must hold s_tEmuLock. A queued job is dropped right away,
+ * a running job completes with VC8000_JOB_ERR_TIMEOUT.
+ */
+static void vc8000_emu_cancel(
+	struct vc8000_job *psJob
+)
+{
+	struct vc8000_job *psPrev = NULL;
+	struct vc8000_job *psCur;
+
+	psJob->cancel = true;
+
+	if(psJob->state != eVC8000_JOB_PENDING)
+		return;
+
+	for(psCur = s_psEmuJobHead; psCur; psPrev = psCur, psCur = psCur->next) {
+		if(psCur != psJob)
+			continue;
+
+		if(psPrev)
+			psPrev->next = psJob->next;
+		else
+			s_psEmuJobHead = psJob->next;
+
+		if(s_psEmuJobTail == psJob)
+			s_psEmuJobTail = psPrev;
+		break;
+	}
+
+	psJob->next = NULL;
+	vc8000_emu_complete(psJob, VC8000_JOB_ERR_TIMEOUT);
+}
+
+//Check deadline of unfinished job, must hold s_tEmuLock
+static void vc8000_emu_check_deadline(
+	struct vc8000_job *psJob
+)
+{
+	if((psJob->deadline_ns == 0) || psJob->cancel || (psJob->state == eVC8000_JOB_DONE))
+		return;
+
+	if(vc8000_emu_time_ns() >= psJob->deadline_ns) {
+		s_sEmuStats.jobs_timeout ++;
+		vc8000_emu_cancel(psJob);
+	}
+}
+
+//Take decode result of done job, must hold s_tEmuLock
+static int vc8000_emu_take_result(
+	struct vc8000_job *psJob,
+	int *p_cap_index
+)
+{
+	uint64_t u64Cnt;
+
+	//reset done event
+	if(read(psJob->evt_fd, &u64Cnt, sizeof(u64Cnt)) != sizeof(u64Cnt))
+		u64Cnt = 0;
+
+	psJob->state = eVC8000_JOB_IDLE;
+	*p_cap_index = psJob->cap_index;
+	return psJob->result;
+}
+
+static void vc8000_emu_destroy_session(struct video *psVideo)
+{
+	struct vc8000_emu_session *psSession = (struct vc8000_emu_session *)psVideo;
+
+	if(psVideo->cap_memory == V4L2_MEMORY_MMAP)
+		free(psVideo->cap_buf_addr[0][0]);
+	free(psVideo->out_buf_addr[0]);
+	free(psSession->pu8Decoded);
+
+	if(psVideo->job[0].evt_fd >= 0)
+		close(psVideo->job[0].evt_fd);
+
+	free(psSession);
+}
+
+static int vc8000_emu_open(
+	struct video **ppsVideo,
+	int *pi32Slot,
+	bool bShareable,
+	int pixel_format,
+	int w,
+	int h,
+	uint32_t u32StreamBufSize
+)
+{
+	struct vc8000_emu_session *psSession;
+	struct video *psVideo;
+	int i;
+
+	pthread_once(&s_tEmuOnce, vc8000_emu_init);
+
+	//every decoder gets a session of its own, pipelined sessions are not emulated
+	pthread_mutex_lock(&s_tEmuLock);
+	psVideo = s_psEmuIdleSession;
+	if(psVideo) {
+		s_psEmuIdleSession = psVideo->next;
+		s_i32EmuIdleSessionCnt --;
+		psVideo->next = NULL;
+	}
+	s_sEmuStats.inflight ++;
+	if(s_sEmuStats.inflight > s_sEmuStats.max_inflight)
+		s_sEmuStats.max_inflight = s_sEmuStats.inflight;
+	pthread_mutex_unlock(&s_tEmuLock);
+
+	if(psVideo == NULL) {
+		psSession = calloc(1, sizeof(struct vc8000_emu_session));
+		if(psSession == NULL)
+			goto open_fail;
+
+		psVideo = &psSession->sVideo;
+		psVideo->fd = -1;
+		psVideo->cap_memory = V4L2_MEMORY_MMAP;
+		psVideo->slot_cnt = 1;
+		for(i = 0; i < MAX_CAP_BUF; i ++)
+			psVideo->cap_buf_dmabuf_fd[i] = -1;
+		for(i = 0; i < MAX_OUT_BUF; i ++) {
+			psVideo->job[i].psVideo = psVideo;
+			psVideo->job[i].slot = i;
+			psVideo->job[i].evt_fd = -1;
+		}
+
+		psVideo->job[0].evt_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(psVideo->job[0].evt_fd < 0) {
+			free(psSession);
+			goto open_fail;
+		}
+	}
+
+	psVideo->slot_used[0] = true;
+	psVideo->slot_users = 1;
+	psVideo->job[0].state = eVC8000_JOB_IDLE;
+	psVideo->job[0].deadline_ns = 0;
+
+	*ppsVideo = psVideo;
+	*pi32Slot = 0;
+	return 0;
+
+open_fail:
+	pthread_mutex_lock(&s_tEmuLock);
+	s_sEmuStats.inflight --;
+	pthread_mutex_unlock(&s_tEmuLock);
+	return -1;
+}
+
+static int vc8000_emu_release_decompress(
+	struct video *psVideo,
+	int slot
+)
+{
+	struct vc8000_job *psJob = &psVideo->job[slot];
+	int i32CapIndex;
+
+	//job still queued or running must not touch buffers anymore
+	pthread_mutex_lock(&s_tEmuLock);
+	if(psJob->state != eVC8000_JOB_IDLE) {
+		if(psJob->state != eVC8000_JOB_DONE)
+			vc8000_emu_cancel(psJob);
+		while(psJob->state != eVC8000_JOB_DONE)
+			pthread_cond_wait(&s_tEmuJobDoneCond, &s_tEmuLock);
+		vc8000_emu_take_result(psJob, &i32CapIndex);
+	}
+	pthread_mutex_unlock(&s_tEmuLock);
+
+	psVideo->streaming = false;
+	psVideo->out_buf_flag[0] = eV4L2_BUF_DEQUEUE;
+	psVideo->cap_buf_flag[0] = eV4L2_BUF_DEQUEUE;
+	return 0;
+}
+
+static void vc8000_emu_close(
+	struct video *psVideo,
+	int slot
+)
+{
+	vc8000_emu_release_decompress(psVideo, slot);
+
+	//keep session alive for next image
+	pthread_mutex_lock(&s_tEmuLock);
+	s_sEmuStats.inflight --;
+	psVideo->slot_used[slot] = false;
+	psVideo->slot_users = 0;
+	if(s_i32EmuIdleSessionCnt < EMU_POOL_MAX_SESSION) {
+		psVideo->next = s_psEmuIdleSession;
+		s_psEmuIdleSession = psVideo;
+		s_i32EmuIdleSessionCnt ++;
+		psVideo = NULL;
+	}
+	pthread_mutex_unlock(&s_tEmuLock);
+
+	if(psVideo)
+		vc8000_emu_destroy_session(psVideo);
+}
+
+static void vc8000_emu_set_pipeline_depth(int depth)
+{
+}
+
+static int vc8000_emu_get_node_count(void)
+{
+	return 1;
+}
+
+static int vc8000_emu_get_node_stats(
+	int node,
+	struct vc8000_node_stats *psStats
+)
+{
+	if(node != 0)
+		return -1;
+
+	pthread_once(&s_tEmuOnce, vc8000_emu_init);
+
+	pthread_mutex_lock(&s_tEmuLock);
+	*psStats = s_sEmuStats;
+	pthread_mutex_unlock(&s_tEmuLock);
+
+	return 0;
+}
+
+static bool vc8000_emu_capture_memory_supported(int memory)
+{
+	return (memory == V4L2_MEMORY_MMAP) || (memory == V4L2_MEMORY_USERPTR);
+}
+
+static bool vc8000_emu_capture_format_supported(int pixel_format)
+{
+	int i32BytesPerLine;
+
+	return vc8000_emu_plane_size(pixel_format, 2, 2, &i32BytesPerLine) != 0;
+}
+
+static int vc8000_emu_export_capture(
+	struct video *psVideo,
+	int n,
+	int *pi32DmaBufFd
+)
+{
+	return -1;
+}
+
+static int vc8000_emu_prepare_bitstream(
+	struct video *psVideo,
+	uint32_t u32StreamBufSize
+)
+{
+	char *pchBuf;
+
+	if(psVideo->streaming)
+		vc8000_emu_release_decompress(psVideo, 0);
+
+	//bitstream buffer is only reallocated when it grows over the high-water mark
+	if((psVideo->out_buf_cnt == 0) || (psVideo->out_buf_size < u32StreamBufSize)) {
+		pchBuf = realloc(psVideo->out_buf_addr[0], u32StreamBufSize);
+		if(pchBuf == NULL)
+			return -5;
+
+		psVideo->out_buf_addr[0] = pchBuf;
+		psVideo->out_buf_size = u32StreamBufSize;
+		psVideo->out_buf_cnt = 1;
+		psVideo->out_slot_cnt = 1;
+	}
+
+	psVideo->out_buf_flag[0] = eV4L2_BUF_DEQUEUE;
+	return 0;
+}
+
+static int vc8000_emu_prepare_decompress(
+	struct video *psVideo,
+	uint32_t u32ImageWidth,
+	uint32_t u32ImageHeight,
+	uint32_t u32OutputWidth,
+	uint32_t u32OutputHeight,
+	bool bDirectFBOut,
+	struct video_fb_info *psFBInfo,
+	uint32_t u32ImgFBPosX,
+	uint32_t u32ImgFBPosY,
+	int i32RotOP,
+	int pixel_format,
+	int cap_memory,
+	uint32_t u32StreamBufSize
+)
+{
+	uint32_t u32PlaneSize;
+	int i32BytesPerLine;
+	int i32Ret;
+
+	//no frame buffer to emulate
+	if(bDirectFBOut)
+		return -1;
+
+	if((u32OutputWidth > MAX_DEC_OUTPUT_WIDTH) || (u32OutputHeight > MAX_DEC_OUTPUT_HEIGHT))
+		return -2;
+
+	if(u32OutputWidth > PP_OUT_MAX_WIDTH_UPSCALED(u32ImageWidth))
+		return -3;
+
+	if(u32OutputHeight > PP_OUT_MAX_HEIGHT_UPSCALED(u32ImageHeight))
+		return -4;
+
+	if(!vc8000_emu_capture_memory_supported(cap_memory))
+		return -6;
+
+	u32PlaneSize = vc8000_emu_plane_size(pixel_format, u32OutputWidth, u32OutputHeight, &i32BytesPerLine);
+	if(u32PlaneSize == 0)
+		return -6;
+
+	i32Ret = vc8000_emu_prepare_bitstream(psVideo, u32StreamBufSize);
+	if(i32Ret != 0)
+		return i32Ret;
+
+	//capture buffer is only reallocated when output size or format changes
+	if((psVideo->cap_pixel_format != pixel_format) ||
+		(psVideo->cap_req_w != u32OutputWidth) ||
+		(psVideo->cap_req_h != u32OutputHeight) ||
+		(psVideo->cap_memory != cap_memory))
+	{
+		if(psVideo->cap_memory == V4L2_MEMORY_MMAP)
+			free(psVideo->cap_buf_addr[0][0]);
+		psVideo->cap_buf_addr[0][0] = NULL;
+		psVideo->cap_buf_cnt = 0;
+		psVideo->cap_pixel_format = 0;
+
+		if(cap_memory == V4L2_MEMORY_MMAP) {
+			psVideo->cap_buf_addr[0][0] = malloc(u32PlaneSize);
+			if(psVideo->cap_buf_addr[0][0] == NULL)
+				return -6;
+		}
+
+		psVideo->cap_memory = cap_memory;
+		psVideo->cap_w = u32OutputWidth;
+		psVideo->cap_h = u32OutputHeight;
+		psVideo->cap_bytesperline = i32BytesPerLine;
+		psVideo->cap_buf_num_planes = 1;
+		psVideo->cap_buf_planes_size[0][0] = u32PlaneSize;
+		psVideo->cap_buf_cnt = 1;
+		psVideo->cap_buf_cnt_min = 1;
+		psVideo->cap_pixel_format = pixel_format;
+		psVideo->cap_req_w = u32OutputWidth;
+		psVideo->cap_req_h = u32OutputHeight;
+		psVideo->cap_slot_cnt = 1;
+	}
+
+	psFBInfo->frame_buf_paddr = 0;
+	psFBInfo->frame_buf_size = 0;
+	psFBInfo->frame_buf_w = psVideo->cap_w;
+	psFBInfo->frame_buf_h = psVideo->cap_h;
+	psFBInfo->direct_fb_out = 0;
+
+	memzero(psVideo->pp_params);
+	psVideo->pp_params.enable_pp = 1;
+	psVideo->pp_params.img_out_w = psVideo->cap_w;
+	psVideo->pp_params.img_out_h = psVideo->cap_h;
+	psVideo->pp_params.img_out_fmt = pixel_format;
+	psVideo->pp_params.rotation = i32RotOP;
+	psVideo->pp_params.libjpeg_mode = 1;
+
+	psVideo->cap_buf_flag[0] = eV4L2_BUF_DEQUEUE;
+	psVideo->streaming = true;
+	return 0;
+}
+
+static int vc8000_emu_get_bitstream_buffer(
+	struct video *psVideo,
+	int slot,
+	char **ppchBufferAddr
+)
+{
+	*ppchBufferAddr = NULL;
+
+	if((slot < psVideo->out_buf_cnt) && (psVideo->out_buf_flag[slot] == eV4L2_BUF_DEQUEUE))
+		*ppchBufferAddr = psVideo->out_buf_addr[slot];
+
+	return psVideo->out_buf_size;
+}
+
+static int vc8000_emu_set_capture_buffer(
+	struct video *psVideo,
+	int slot,
+	void *pvAddr,
+	int i32DmaBufFd,
+	uint32_t u32Size
+)
+{
+	if(psVideo->cap_memory != V4L2_MEMORY_USERPTR)
+		return -1;
+
+	if((slot >= psVideo->cap_buf_cnt) || (u32Size < psVideo->cap_buf_planes_size[slot][0]))
+		return -2;
+
+	psVideo->job[slot].user_addr = pvAddr;
+	psVideo->job[slot].user_fd = i32DmaBufFd;
+	psVideo->job[slot].user_size = u32Size;
+	return 0;
+}
+
+static int vc8000_emu_set_deadline(
+	struct video *psVideo,
+	int slot,
+	uint32_t u32TimeoutMs
+)
+{
+	if(u32TimeoutMs == 0)
+		psVideo->job[slot].deadline_ns = 0;
+	else
+		psVideo->job[slot].deadline_ns = vc8000_emu_time_ns() + (uint64_t)u32TimeoutMs * 1000000ULL;
+
+	return 0;
+}
+
+static int vc8000_emu_inqueue_bitstream_buffer(
+	struct video *psVideo,
+	int slot,
+	char *pchBufferAddr,
+	uint32_t u32StreamLen
+)
+{
+	struct vc8000_job *psJob;
+
+	if((slot >= psVideo->out_buf_cnt) || (psVideo->out_buf_addr[slot] != pchBufferAddr) || !psVideo->streaming)
+		return -1;
+
+	psJob = &psVideo->job[slot];
+
+	pthread_mutex_lock(&s_tEmuLock);
+
+	if(!s_bEmuThreadStarted) {
+		pthread_attr_t tAttr;
+		pthread_t tThread;
+
+		pthread_attr_init(&tAttr);
+		pthread_attr_setdetachstate(&tAttr, PTHREAD_CREATE_DETACHED);
+		if(pthread_create(&tThread, &tAttr, vc8000_emu_thread, NULL) != 0) {
+			pthread_attr_destroy(&tAttr);
+			pthread_mutex_unlock(&s_tEmuLock);
+			fprintf(stderr, "Unable create VC8000 emulator thread \n");
+			return -1;
+		}
+		pthread_attr_destroy(&tAttr);
+		s_bEmuThreadStarted = true;
+	}
+
+	psJob->stream_len = u32StreamLen;
+	psJob->state = eVC8000_JOB_PENDING;
+	psJob->result = -1;
+	psJob->cap_index = -1;
+	psJob->cancel = false;
+	psJob->submit_ns = vc8000_emu_time_ns();
+	psJob->decode_ns = 0;
+	psJob->next = NULL;
+
+	if(s_psEmuJobTail)
+		s_psEmuJobTail->next = psJob;
+	else
+		s_psEmuJobHead = psJob;
+	s_psEmuJobTail = psJob;
+	s_sEmuStats.jobs_submitted ++;
+
+	psVideo->out_buf_flag[slot] = eV4L2_BUF_INQUEUE;
+	psVideo->cap_buf_flag[slot] = eV4L2_BUF_INQUEUE;
+
+	pthread_cond_signal(&s_tEmuJobQueuedCond);
+	pthread_mutex_unlock(&s_tEmuLock);
+
+	return 0;
+}
+
+static int vc8000_emu_poll_decode_done(
+	struct video *psVideo,
+	int slot,
+	int *p_cap_index
+)
+{
+	struct vc8000_job *psJob = &psVideo->job[slot];
+	int i32Ret;
+
+	pthread_mutex_lock(&s_tEmuLock);
+
+	if(psJob->state == eVC8000_JOB_IDLE) {
+		pthread_mutex_unlock(&s_tEmuLock);
+		return -1;
+	}
+
+	while(psJob->state != eVC8000_JOB_DONE) {
+		vc8000_emu_check_deadline(psJob);
+		if(psJob->state == eVC8000_JOB_DONE)
+			break;
+
+		if((psJob->deadline_ns == 0) || psJob->cancel) {
+			pthread_cond_wait(&s_tEmuJobDoneCond, &s_tEmuLock);
+		}
+		else {
+			struct timespec tDeadline;
+
+			tDeadline.tv_sec = psJob->deadline_ns / 1000000000ULL;
+			tDeadline.tv_nsec = psJob->deadline_ns % 1000000000ULL;
+			pthread_cond_timedwait(&s_tEmuJobDoneCond, &s_tEmuLock, &tDeadline);
+		}
+	}
+
+	i32Ret = vc8000_emu_take_result(psJob, p_cap_index);
+	pthread_mutex_unlock(&s_tEmuLock);
+
+	return i32Ret;
+}
+
+static int vc8000_emu_try_decode_done(
+	struct video *psVideo,
+	int slot,
+	int *p_cap_index
+)
+{
+	struct vc8000_job *psJob = &psVideo->job[slot];
+	int i32Ret;
+
+	pthread_mutex_lock(&s_tEmuLock);
+
+	if(psJob->state == eVC8000_JOB_IDLE) {
+		pthread_mutex_unlock(&s_tEmuLock);
+		return -1;
+	}
+
+	vc8000_emu_check_deadline(psJob);
+
+	if(psJob->state != eVC8000_JOB_DONE) {
+		pthread_mutex_unlock(&s_tEmuLock);
+		return 1;
+	}
+
+	i32Ret = vc8000_emu_take_result(psJob, p_cap_index);
+	pthread_mutex_unlock(&s_tEmuLock);
+
+	return i32Ret;
+}
+
+static int vc8000_emu_get_done_fd(
+	struct video *psVideo,
+	int slot
+)
+{
+	return psVideo->job[slot].evt_fd;
+}
+
+static uint64_t vc8000_emu_get_decode_time(
+	struct video *psVideo,
+	int slot
+)
+{
+	uint64_t u64DecodeNs;
+
+	pthread_mutex_lock(&s_tEmuLock);
+	u64DecodeNs = psVideo->job[slot].decode_ns;
+	pthread_mutex_unlock(&s_tEmuLock);
+
+	return u64DecodeNs;
+}
+
+const struct vc8000_backend g_sVC8000EmuBackend = {
+	.name = "emu",
+	.open = vc8000_emu_open,
+	.close = vc8000_emu_close,
+	.set_pipeline_depth = vc8000_emu_set_pipeline_depth,
+	.get_node_count = vc8000_emu_get_node_count,
+	.get_node_stats = vc8000_emu_get_node_stats,
+	.capture_memory_supported = vc8000_emu_capture_memory_supported,
+	.capture_format_supported = vc8000_emu_capture_format_supported,
+	.export_capture = vc8000_emu_export_capture,
+	.prepare_decompress = vc8000_emu_prepare_decompress,
+	.prepare_bitstream = vc8000_emu_prepare_bitstream,
+	.get_bitstream_buffer = vc8000_emu_get_bitstream_buffer,
+	.set_capture_buffer = vc8000_emu_set_capture_buffer,
+	.set_deadline = vc8000_emu_set_deadline,
+	.inqueue_bitstream_buffer = vc8000_emu_inqueue_bitstream_buffer,
+	.poll_decode_done = vc8000_emu_poll_decode_done,
+	.try_decode_done = vc8000_emu_try_decode_done,
+	.get_done_fd = vc8000_emu_get_done_fd,
+	.get_decode_time = vc8000_emu_get_decode_time,
+	.release_decompress = vc8000_emu_release_decompress,
+};
@@ -0,0 +1,178 @@
+/**
+ * @file vc8000_trace.c: V4L2 pipeline event trace
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * A thread allocates its ring at first event and links it into a global list
+ * by compare-and-swap, so recording never takes a lock. The ring keeps the
+ * newest VC8000_TRACE_RING_SIZE records of the thread. Rings of exited
+ * threads are kept until process exit so they appear in the dump.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <pthread.h>
+
+#include "vc8000_trace.h"
+
+/* Records per thread, power of 2 */
+#ifndef VC8000_TRACE_RING_SIZE
+#define VC8000_TRACE_RING_SIZE		4096
+#endif
+
+/* Trace file written at exit */
+#define TRACE_ENV_FILE				"VC8000_TRACE_FILE"
+
+struct vc8000_trace_ring {
+	struct vc8000_trace_ring *next;
+	uint32_t tid;
+	uint64_t head;					/* records written, updated by owner thread only */
+	struct vc8000_trace_record records[VC8000_TRACE_RING_SIZE];
+};
+
+static struct vc8000_trace_ring *s_psTraceRings = NULL;
+static __thread struct vc8000_trace_ring *s_psThreadRing = NULL;
+static pthread_once_t s_tTraceOnce = PTHREAD_ONCE_INIT;
+static char *s_szTraceExitFile = NULL;
+
+uint64_t vc8000_trace_time_ns(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000ULL + tNow.tv_nsec;
+}
+
+static void vc8000_trace_exit(void)
+{
+	if(vc8000_trace_dump(s_szTraceExitFile) < 0)
+		fprintf(stderr, "Unable write VC8000 trace %s \n", s_szTraceExitFile);
+}
+
+static void vc8000_trace_init(void)
+{
+	const char *szPath = getenv(TRACE_ENV_FILE);
+
+	if(szPath && szPath[0]) {
+		s_szTraceExitFile = strdup(szPath);
+		if(s_szTraceExitFile)
+			atexit(vc8000_trace_exit);
+	}
+}
+
+static struct vc8000_trace_ring *vc8000_trace_thread_ring(void)
+{
+	struct vc8000_trace_ring *psRing = s_psThreadRing;
+
+	if(psRing)
+		return psRing;
+
+	pthread_once(&s_tTraceOnce, vc8000_trace_init);
+
+	psRing = calloc(1, sizeof(struct vc8000_trace_ring));
+	if(psRing == NULL)
+		return NULL;
+
+	psRing->tid = (uint32_t)syscall(SYS_gettid);
+
+	psRing->next = __atomic_load_n(&s_psTraceRings, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&s_psTraceRings, &psRing->next, psRing,
+			true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	s_psThreadRing = psRing;
+	return psRing;
+}
+
+void vc8000_trace_record(
+	E_VC8000_TRACE_EVENT eEvent,
+	uint64_t u64StartNs,
+	int i32Fd,
+	int32_t i32Arg
+)
+{
+	struct vc8000_trace_ring *psRing = vc8000_trace_thread_ring();
+	struct vc8000_trace_record *psRecord;
+	uint64_t u64Now;
+
+	if(psRing == NULL)
+		return;
+
+	u64Now = vc8000_trace_time_ns();
+	psRecord = &psRing->records[psRing->head & (VC8000_TRACE_RING_SIZE - 1)];
+
+	if(u64StartNs) {
+		psRecord->ts_ns = u64StartNs;
+		psRecord->dur_ns = u64Now - u64StartNs;
+	}
+	else {
+		psRecord->ts_ns = u64Now;
+		psRecord->dur_ns = 0;
+	}
+
+	psRecord->tid = psRing->tid;
+	psRecord->event = eEvent;
+	psRecord->reserved = 0;
+	psRecord->fd = i32Fd;
+	psRecord->arg = i32Arg;
+
+	//publish record to vc8000_trace_dump()
+	__atomic_store_n(&psRing->head, psRing->head + 1, __ATOMIC_RELEASE);
+}
+
+//Records of threads still tracing during dump may be torn at the oldest end
+int vc8000_trace_dump(
+	const char *szPath
+)
+{
+	struct vc8000_trace_file_header sHeader;
+	struct vc8000_trace_ring *psRing;
+	FILE *psFile;
+	int i32Cnt = 0;
+
+	psFile = fopen(szPath, "wb");
+	if(psFile == NULL)
+		return -1;
+
+	memset(&sHeader, 0, sizeof(sHeader));
+	memcpy(sHeader.magic, VC8000_TRACE_FILE_MAGIC, sizeof(sHeader.magic));
+	sHeader.record_size = sizeof(struct vc8000_trace_record);
+	sHeader.pid = (uint32_t)getpid();
+
+	if(fwrite(&sHeader, sizeof(sHeader), 1, psFile) != 1) {
+		fclose(psFile);
+		return -1;
+	}
+
+	psRing = __atomic_load_n(&s_psTraceRings, __ATOMIC_ACQUIRE);
+	while(psRing) {
+		uint64_t u64Head = __atomic_load_n(&psRing->head, __ATOMIC_ACQUIRE);
+		uint64_t u64First = 0;
+		uint64_t i;
+
+		if(u64Head > VC8000_TRACE_RING_SIZE)
+			u64First = u64Head - VC8000_TRACE_RING_SIZE;
+
+		for(i = u64First; i < u64Head; i ++) {
+			if(fwrite(&psRing->records[i & (VC8000_TRACE_RING_SIZE - 1)],
+					sizeof(struct vc8000_trace_record), 1, psFile) != 1) {
+				fclose(psFile);
+				return -1;
+			}
+			i32Cnt ++;
+		}
+
+		psRing = psRing->next;
+	}
+
+	if(fclose(psFile) != 0)
+		return -1;
+
+	return i32Cnt;
+}
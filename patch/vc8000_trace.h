@@ -0,0 +1,79 @@
+/**
+ * @file vc8000_trace.h V4L2 pipeline event trace
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Built only with -DWITH_VC8000_TRACE, otherwise the trace macros compile to
+ * nothing. Each thread writes fixed-size records into its own ring buffer
+ * without locking. Records are written to a binary file by
+ * vc8000_trace_dump(), or at exit if environment variable VC8000_TRACE_FILE
+ * is set. test/VC8000TraceDump converts the file to Chrome trace JSON.
+ */
+
+#ifndef __VC8000_TRACE_H__
+#define __VC8000_TRACE_H__
+
+#include <inttypes.h>
+
+/* Trace events */
+typedef enum {
+	eVC8000_TRACE_QBUF_OUTPUT = 0,
+	eVC8000_TRACE_QBUF_CAPTURE,
+	eVC8000_TRACE_DQBUF_OUTPUT,
+	eVC8000_TRACE_DQBUF_CAPTURE,
+	eVC8000_TRACE_POLL,				/* poll() of dispatcher, arg = revents */
+	eVC8000_TRACE_STREAMON,			/* arg = buffer type */
+	eVC8000_TRACE_STREAMOFF,		/* arg = buffer type */
+	eVC8000_TRACE_MMAP,				/* arg = length */
+	eVC8000_TRACE_MUNMAP,			/* arg = length */
+	eVC8000_TRACE_LOCK_WAIT,		/* wait for scheduler lock */
+	eVC8000_TRACE_EVENT_CNT,
+} E_VC8000_TRACE_EVENT;
+
+/* One trace record, 32 bytes */
+struct vc8000_trace_record {
+	uint64_t ts_ns;					/* CLOCK_MONOTONIC start time */
+	uint64_t dur_ns;				/* 0 for instant event */
+	uint32_t tid;
+	uint16_t event;					/* E_VC8000_TRACE_EVENT */
+	uint16_t reserved;
+	int32_t fd;						/* V4L2 fd, -1 if none */
+	int32_t arg;
+};
+
+/* Trace file: header followed by records of all threads */
+#define VC8000_TRACE_FILE_MAGIC		"VC8KTRC1"
+
+struct vc8000_trace_file_header {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t pid;
+};
+
+#if defined (WITH_VC8000_TRACE)
+
+uint64_t vc8000_trace_time_ns(void);
+
+void vc8000_trace_record(
+	E_VC8000_TRACE_EVENT eEvent,
+	uint64_t u64StartNs,
+	int i32Fd,
+	int32_t i32Arg
+);
+
+//Write records of all threads, return number of records or -1
+int vc8000_trace_dump(
+	const char *szPath
+);
+
+#define VC8000_TRACE_TIME()						vc8000_trace_time_ns()
+#define VC8000_TRACE(event, start, fd, arg)	vc8000_trace_record(event, start, fd, arg)
+
+#else
+
+#define VC8000_TRACE_TIME()						0
+#define VC8000_TRACE(event, start, fd, arg)	((void)(start))
+
+#endif
+
+#endif
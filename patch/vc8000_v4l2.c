@@ -11,19 +11,26 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <inttypes.h>
 #include <errno.h>
 #include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <limits.h>
 
 #include <pthread.h>
 
 #define VC8000_DEV_MAX_NO 4
+#define VC8000_POOL_MAX_SESSION 8
 #define DEFAULT_VC8000_DEV_NAME "/dev/video0"
 
 //#define ENABLE_DBG
 
 #include "vc8000_v4l2.h"
+#include "vc8000_backend.h"
 #include "msm-v4l2-controls.h"
+#include "vc8000_trace.h"
 
 
 static char *dbg_type[2] = {"OUTPUT", "CAPTURE"};
@@ -33,7 +40,68 @@ static uint8_t *s_pu8FrameBufAddr = NULL;
 static uint32_t s_u32FrameBufSize = 0;
 static uint32_t s_u32FrameBufPlanes = 0;
 
-static pthread_mutex_t s_tHantroLock = PTHREAD_MUTEX_INITIALIZER;
+/* VC8000 device node, enumerated once by device manager */
+struct vc8000_node {
+	char strDevNode[50];
+
+	/* Idle decode sessions (fd and mmapped buffers kept alive) */
+	struct video *psIdleSession;
+	int i32IdleSessionCnt;
+
+	/* Sessions in use, pipelined sessions are joined from here */
+	struct video *psActiveSession;
+
+	/* Hardware job scheduler of this node */
+	pthread_cond_t tJobQueuedCond;
+	struct vc8000_job *psJobHead;
+	struct vc8000_job *psJobTail;
+	int i32WakeFd;				/* wake scheduler waiting for hardware */
+	pthread_t tSchedThread;
+	bool bSchedStarted;
+
+	struct vc8000_node_stats sStats;
+};
+
+static struct vc8000_node s_asNode[VC8000_DEV_MAX_NO];
+static int s_i32NodeCnt = 0;
+static pthread_once_t s_tNodeOnce = PTHREAD_ONCE_INIT;
+
+/* Protect session pool, job queues and node statistics */
+static pthread_mutex_t s_tSchedLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_tJobDoneCond;	/* CLOCK_MONOTONIC, initialized by vc8000_v4l2_enum_nodes() */
+
+/* Number of slots of pipelined sessions, 1: pipelined mode disabled */
+static int s_i32PipelineDepth = 1;
+
+/* Set once driver refuses caller capture buffers */
+static bool s_bUserPtrCaptureFailed = false;
+static bool s_bDmaBufCaptureFailed = false;
+
+/* Capture pixel formats listed by VIDIOC_ENUM_FMT of first node */
+#define VC8000_CAP_FMT_MAX	32
+static uint32_t s_au32CapFormat[VC8000_CAP_FMT_MAX];
+static int s_i32CapFormatCnt = 0;
+
+static uint64_t vc8000_get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//Take scheduler lock, contended acquisition is traced as lock wait
+static void vc8000_sched_lock(void)
+{
+	uint64_t u64TraceNs;
+
+	if(pthread_mutex_trylock(&s_tSchedLock) == 0)
+		return;
+
+	u64TraceNs = VC8000_TRACE_TIME();
+	pthread_mutex_lock(&s_tSchedLock);
+	VC8000_TRACE(eVC8000_TRACE_LOCK_WAIT, u64TraceNs, -1, 0);
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////
 static int v4l2_queue_buf(
@@ -48,6 +116,7 @@ static int v4l2_queue_buf(
 	struct video *vid = psVideo;
 	struct v4l2_buffer buf;
 	struct v4l2_plane planes[MAX_PLANES];
+	uint64_t u64TraceNs;
 	int ret;
 	int p;
 
@@ -76,7 +145,10 @@ static int v4l2_queue_buf(
 			buf.flags |= V4L2_QCOM_BUF_FLAG_EOS;
 	}
 
+	u64TraceNs = VC8000_TRACE_TIME();
 	ret = ioctl(vid->fd, VIDIOC_QBUF, &buf);
+	VC8000_TRACE((type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) ? eVC8000_TRACE_QBUF_CAPTURE : eVC8000_TRACE_QBUF_OUTPUT,
+		u64TraceNs, vid->fd, n);
 	if (ret) {
 		fprintf(stderr, "Failed to queue buffer (index=%d) on %s (ret:%d)",
 		    buf.index,
@@ -100,9 +172,13 @@ static int v4l2_dequeue_buf(
 )
 {
 	struct video *vid = psVideo;
+	uint64_t u64TraceNs;
 	int ret;
 
+	u64TraceNs = VC8000_TRACE_TIME();
 	ret = ioctl(vid->fd, VIDIOC_DQBUF, buf);
+	VC8000_TRACE((buf->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) ? eVC8000_TRACE_DQBUF_CAPTURE : eVC8000_TRACE_DQBUF_OUTPUT,
+		u64TraceNs, vid->fd, (ret < 0) ? -errno : (int32_t)buf->index);
 	if (ret < 0) {
 		fprintf(stderr, "Failed to dequeue buffer (%d)", -errno);
 		return -errno;
@@ -118,100 +194,376 @@ static int v4l2_dequeue_buf(
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
-/*
- *  Private V4L2 post processing ioctl for VC8K
- */
-
-struct vc8k_pp_params {
-	int   enable_pp;
-	unsigned int   frame_buf_paddr;           /* physical address of frame buffer          */
-	int   frame_buff_size;
-	int   frame_buf_w;               /* width of frame buffer width               */
-	int   frame_buf_h;               /* height of frame buffer                    */
-	int   img_out_x;                 /* image original point(x,y) on frame buffer */
-	int   img_out_y;                 /* image original point(x,y) on frame buffer */
-	int   img_out_w;                 /* image output width on frame buffer        */
-	int   img_out_h;                 /* image output height on frame buffer       */
-	int   img_out_fmt;               /* image output format                       */
-	int   rotation;
-	int   pp_out_dst;                /* PP output destination.                    */
-					 /* 0: fb0                                    */
-					 /* 1: fb1                                    */
-					 /* otherwise: frame_buf_paddr                */
-	int   libjpeg_mode;		 /* 0: v4l2-only; 1: libjpeg+v4l2             */
-	int   resserved[8];
-};
-
-
 #define VC8KIOC_PP_SET_CONFIG	_IOW ('v', 91, struct vc8k_pp_params)
 #define VC8KIOC_PP_GET_CONFIG	_IOW ('v', 92, struct vc8k_pp_params)
 #define VC8KIOC_GET_BUF_PHY_ADDR	_IOWR ('v', 193, struct v4l2_buffer)
 
-int vc8000_v4l2_open(struct video *psVideo)
+//List capture pixel formats of node
+static void vc8000_v4l2_enum_capture_formats(int fd)
+{
+	struct v4l2_fmtdesc fmtdesc;
+
+	for(s_i32CapFormatCnt = 0; s_i32CapFormatCnt < VC8000_CAP_FMT_MAX; s_i32CapFormatCnt ++) {
+		memzero(fmtdesc);
+		fmtdesc.index = s_i32CapFormatCnt;
+		fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+		if (ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc) != 0)
+			break;
+
+		s_au32CapFormat[s_i32CapFormatCnt] = fmtdesc.pixelformat;
+	}
+}
+
+//Probe /dev/video0..N once and keep all nodes capable of JPEG decode
+static void vc8000_v4l2_enum_nodes(void)
 {
 	struct v4l2_capability cap;
 	int ret;
+	int fd;
 	char strVideoDevNode[50];
 	int i32DefaultDevNodeLen = strlen(DEFAULT_VC8000_DEV_NAME);
 	int i = 0;
+	pthread_condattr_t tCondAttr;
+
+	//job deadline is measured by monotonic clock
+	pthread_condattr_init(&tCondAttr);
+	pthread_condattr_setclock(&tCondAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&s_tJobDoneCond, &tCondAttr);
+	pthread_condattr_destroy(&tCondAttr);
 	
 	memset(strVideoDevNode, 0, 50);
 	strcpy(strVideoDevNode, DEFAULT_VC8000_DEV_NAME);
 
-	psVideo->fd = -1;
-	pthread_mutex_lock(&s_tHantroLock);
-
 	for( i = 0; i < VC8000_DEV_MAX_NO; i ++) {
 		sprintf(strVideoDevNode + i32DefaultDevNodeLen - 1, "%d", i);
 
-		psVideo->fd = open(strVideoDevNode, O_RDWR, 0);
-		if (psVideo->fd < 0) {
+		fd = open(strVideoDevNode, O_RDWR, 0);
+		if (fd < 0) {
 			fprintf(stderr, "Warning: Unable open video decoder: %s \n", strVideoDevNode);
-			psVideo->fd = -1;
 			continue;
 		}
 
 		memzero(cap);
-		ret = ioctl(psVideo->fd, VIDIOC_QUERYCAP, &cap);
+		ret = ioctl(fd, VIDIOC_QUERYCAP, &cap);
 		if (ret) {
 			fprintf(stderr, "Warning: Unable verify capabilities \n");
-			close(psVideo->fd);
-			psVideo->fd = -1;
+			close(fd);
 			continue;
 		}
 
 #if defined (ENABLE_DBG)
 		fprintf(stdout, "caps (%s): driver=\"%s\" bus_info=\"%s\" card=\"%s\" fd=0x%x \n",
-			 strVideoDevNode, cap.driver, cap.bus_info, cap.card, psVideo->fd);
+			 strVideoDevNode, cap.driver, cap.bus_info, cap.card, fd);
 #endif
+		//all nodes are the same decoder, list formats once
+		if ((cap.capabilities & V4L2_CAP_VIDEO_CAPTURE_MPLANE) && (s_i32CapFormatCnt == 0))
+			vc8000_v4l2_enum_capture_formats(fd);
+		close(fd);
 
 		if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE_MPLANE) ||
 			!(cap.capabilities & V4L2_CAP_VIDEO_OUTPUT_MPLANE) ||
 			!(cap.capabilities & V4L2_CAP_STREAMING)) {
 			fprintf(stderr, "Warning: Insufficient capabilities for video device (is %s correct?) \n", strVideoDevNode);
-			close(psVideo->fd);
-			psVideo->fd = -1;
 			continue;
 		}
 
-		break;
+		memset(&s_asNode[s_i32NodeCnt], 0, sizeof(struct vc8000_node));
+		strcpy(s_asNode[s_i32NodeCnt].strDevNode, strVideoDevNode);
+		strncpy(s_asNode[s_i32NodeCnt].sStats.dev_name, strVideoDevNode, sizeof(s_asNode[s_i32NodeCnt].sStats.dev_name) - 1);
+		pthread_cond_init(&s_asNode[s_i32NodeCnt].tJobQueuedCond, NULL);
+		s_asNode[s_i32NodeCnt].i32WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		s_i32NodeCnt ++;
+	}
+}
+
+//Pick the node with the fewest jobs in flight, must hold s_tSchedLock
+static int vc8000_v4l2_least_loaded_node(void)
+{
+	int i;
+	int i32Node = 0;
+
+	for(i = 1; i < s_i32NodeCnt; i ++) {
+		if(s_asNode[i].sStats.inflight < s_asNode[i32Node].sStats.inflight)
+			i32Node = i;
+	}
+
+	return i32Node;
+}
+
+//Stop streaming, release all buffers of session and close device
+static void vc8000_v4l2_destroy_session(struct video *psVideo)
+{
+	int i;
+
+	if(psVideo->fd >= 0) {
+		if(psVideo->cap_pixel_format || psVideo->out_buf_cnt)
+			vc8000_v4l2_stop(psVideo);
+		close(psVideo->fd);
+	}
+
+	for(i = 0; i < MAX_OUT_BUF; i ++) {
+		if(psVideo->job[i].evt_fd >= 0)
+			close(psVideo->job[i].evt_fd);
 	}
 
+	free(psVideo);
+}
+
+static struct video *vc8000_v4l2_create_session(
+	struct vc8000_node *psNode,
+	int i32Node
+)
+{
+	struct video *psVideo;
+	int i;
+
+	psVideo = calloc(1, sizeof(struct video));
+	if(psVideo == NULL)
+		return NULL;
+
+	psVideo->node = i32Node;
+	psVideo->cap_memory = V4L2_MEMORY_MMAP;
+	for(i = 0; i < MAX_CAP_BUF; i ++)
+		psVideo->cap_buf_dmabuf_fd[i] = -1;
+	for(i = 0; i < MAX_OUT_BUF; i ++) {
+		psVideo->job[i].psVideo = psVideo;
+		psVideo->job[i].slot = i;
+		psVideo->job[i].evt_fd = -1;
+	}
+
+	psVideo->fd = open(psNode->strDevNode, O_RDWR, 0);
 	if(psVideo->fd < 0) {
-		pthread_mutex_unlock(&s_tHantroLock);
+		fprintf(stderr, "Warning: Unable open video decoder: %s \n", psNode->strDevNode);
+		free(psVideo);
+		return NULL;
+	}
+
+	return psVideo;
+}
+
+//Find active pipelined session of same output configuration with free slot, must hold s_tSchedLock
+static struct video *vc8000_v4l2_find_joinable(
+	int pixel_format,
+	int w,
+	int h,
+	uint32_t u32StreamBufSize
+)
+{
+	struct video *psVideo;
+	int i;
+
+	for(i = 0; i < s_i32NodeCnt; i ++) {
+		for(psVideo = s_asNode[i].psActiveSession; psVideo; psVideo = psVideo->next_active) {
+			if(psVideo->joinable &&
+				(psVideo->slot_users < psVideo->slot_cnt) &&
+				(psVideo->cap_pixel_format == pixel_format) &&
+				(psVideo->cap_req_w == w) &&
+				(psVideo->cap_req_h == h) &&
+				(psVideo->out_buf_size >= u32StreamBufSize))
+				return psVideo;
+		}
+	}
+
+	return NULL;
+}
+
+//Take slot of session, must hold s_tSchedLock
+static void vc8000_v4l2_attach_slot(
+	struct vc8000_node *psNode,
+	struct video *psVideo,
+	int slot,
+	int slot_cnt
+)
+{
+	if(psVideo->slot_users == 0) {
+		//first decoder of session, configures it in vc8000_jpeg_prepare_decompress()
+		psVideo->slot_cnt = slot_cnt;
+		psVideo->next_active = psNode->psActiveSession;
+		psNode->psActiveSession = psVideo;
+	}
+
+	psVideo->slot_used[slot] = true;
+	psVideo->slot_users ++;
+}
+
+int vc8000_v4l2_open(
+	struct video **ppsVideo,
+	int *pi32Slot,
+	bool bShareable,
+	int pixel_format,
+	int w,
+	int h,
+	uint32_t u32StreamBufSize
+)
+{
+	struct video *psVideo = NULL;
+	struct vc8000_node *psNode;
+	int i32Node;
+	int i32Slot = 0;
+	int i32SlotCnt = 1;
+
+	*ppsVideo = NULL;
+	*pi32Slot = 0;
+
+	pthread_once(&s_tNodeOnce, vc8000_v4l2_enum_nodes);
+	if(s_i32NodeCnt == 0)
 		return -1;
+
+	vc8000_sched_lock();
+
+	if(bShareable)
+		i32SlotCnt = s_i32PipelineDepth;
+
+	//pipelined mode: join active session of same output configuration
+	if(i32SlotCnt > 1)
+		psVideo = vc8000_v4l2_find_joinable(pixel_format, w, h, u32StreamBufSize);
+
+	if(psVideo) {
+		i32Node = psVideo->node;
+		psNode = &s_asNode[i32Node];
+		while(psVideo->slot_used[i32Slot])
+			i32Slot ++;
+		vc8000_v4l2_attach_slot(psNode, psVideo, i32Slot, i32SlotCnt);
 	}
-	
+	else {
+		//dispatch to least loaded node, reuse its idle session if any
+		i32Node = vc8000_v4l2_least_loaded_node();
+		psNode = &s_asNode[i32Node];
+
+		if(psNode->psIdleSession) {
+			psVideo = psNode->psIdleSession;
+			psNode->psIdleSession = psVideo->next;
+			psNode->i32IdleSessionCnt --;
+			psVideo->next = NULL;
+			vc8000_v4l2_attach_slot(psNode, psVideo, i32Slot, i32SlotCnt);
+		}
+	}
+
+	psNode->sStats.inflight ++;
+	if(psNode->sStats.inflight > psNode->sStats.max_inflight)
+		psNode->sStats.max_inflight = psNode->sStats.inflight;
+	pthread_mutex_unlock(&s_tSchedLock);
+
+	if(psVideo == NULL) {
+		psVideo = vc8000_v4l2_create_session(psNode, i32Node);
+		if(psVideo == NULL) {
+			vc8000_sched_lock();
+			psNode->sStats.inflight --;
+			pthread_mutex_unlock(&s_tSchedLock);
+			return -1;
+		}
+
+		vc8000_sched_lock();
+		vc8000_v4l2_attach_slot(psNode, psVideo, i32Slot, i32SlotCnt);
+		pthread_mutex_unlock(&s_tSchedLock);
+	}
+
+	//signaled by job scheduler when the job is done, pollable by application
+	if(psVideo->job[i32Slot].evt_fd < 0) {
+		psVideo->job[i32Slot].evt_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(psVideo->job[i32Slot].evt_fd < 0) {
+			vc8000_v4l2_close(psVideo, i32Slot);
+			return -1;
+		}
+	}
+
+#if defined (ENABLE_DBG)
+	fprintf(stdout, "vc8000_v4l2_open session %p slot %d node %s fd %x \n", psVideo, i32Slot, psNode->strDevNode, psVideo->fd);
+#endif
+
+	*ppsVideo = psVideo;
+	*pi32Slot = i32Slot;
 	return 0;
 }
 
-void vc8000_v4l2_close(struct video *psVideo)
+void vc8000_v4l2_close(
+	struct video *psVideo,
+	int slot
+)
 {
+	struct vc8000_node *psNode = &s_asNode[psVideo->node];
+	struct video **ppsActive;
+	bool bLastUser = true;
+
 #if defined (ENABLE_DBG)
-	fprintf(stdout, "vc8000_v4l2_close video fd %x \n", psVideo->fd);
+	fprintf(stdout, "vc8000_v4l2_close video fd %x slot %d \n", psVideo->fd, slot);
 #endif
-	close(psVideo->fd);
-	pthread_mutex_unlock(&s_tHantroLock);
+
+	vc8000_sched_lock();
+	psNode->sStats.inflight --;
+
+	if(psVideo->slot_used[slot]) {
+		psVideo->slot_used[slot] = false;
+		psVideo->slot_users --;
+		bLastUser = (psVideo->slot_users == 0);
+	}
+
+	if(bLastUser) {
+		psVideo->joinable = false;
+		for(ppsActive = &psNode->psActiveSession; *ppsActive; ppsActive = &(*ppsActive)->next_active) {
+			if(*ppsActive == psVideo) {
+				*ppsActive = psVideo->next_active;
+				break;
+			}
+		}
+		psVideo->next_active = NULL;
+	}
+	pthread_mutex_unlock(&s_tSchedLock);
+
+	//other decoders are still using the pipelined session
+	if(!bLastUser)
+		return;
+
+	if(psVideo->streaming)
+		vc8000_jpeg_release_decompress(psVideo, slot);
+
+	//keep session alive for next image
+	vc8000_sched_lock();
+	if(psNode->i32IdleSessionCnt < VC8000_POOL_MAX_SESSION) {
+		psVideo->next = psNode->psIdleSession;
+		psNode->psIdleSession = psVideo;
+		psNode->i32IdleSessionCnt ++;
+		psVideo = NULL;
+	}
+	pthread_mutex_unlock(&s_tSchedLock);
+
+	if(psVideo)
+		vc8000_v4l2_destroy_session(psVideo);
+}
+
+void vc8000_v4l2_set_pipeline_depth(int depth)
+{
+	if(depth < 1)
+		depth = 1;
+	if(depth > MAX_OUT_BUF)
+		depth = MAX_OUT_BUF;
+
+	vc8000_sched_lock();
+	s_i32PipelineDepth = depth;
+	pthread_mutex_unlock(&s_tSchedLock);
+}
+
+int vc8000_v4l2_get_node_count(void)
+{
+	pthread_once(&s_tNodeOnce, vc8000_v4l2_enum_nodes);
+	return s_i32NodeCnt;
+}
+
+int vc8000_v4l2_get_node_stats(
+	int node,
+	struct vc8000_node_stats *psStats
+)
+{
+	pthread_once(&s_tNodeOnce, vc8000_v4l2_enum_nodes);
+
+	if((node < 0) || (node >= s_i32NodeCnt))
+		return -1;
+
+	vc8000_sched_lock();
+	*psStats = s_asNode[node].sStats;
+	pthread_mutex_unlock(&s_tSchedLock);
+
+	return 0;
 }
 
 //setup output(bitstream) plane
@@ -227,6 +579,7 @@ int vc8000_v4l2_setup_output(
 	struct v4l2_requestbuffers reqbuf;
 	struct v4l2_buffer buf;
 	struct v4l2_plane planes[OUT_PLANES];
+	uint64_t u64TraceNs;
 	int ret;
 	int n;
 
@@ -286,10 +639,12 @@ int vc8000_v4l2_setup_output(
 		vid->out_buf_off[n] = buf.m.planes[0].m.mem_offset;
 		vid->out_buf_size = buf.m.planes[0].length;
 
+		u64TraceNs = VC8000_TRACE_TIME();
 		vid->out_buf_addr[n] = mmap(NULL, buf.m.planes[0].length,
 					    PROT_READ | PROT_WRITE, MAP_SHARED,
 					    vid->fd,
 					    buf.m.planes[0].m.mem_offset);
+		VC8000_TRACE(eVC8000_TRACE_MMAP, u64TraceNs, vid->fd, buf.m.planes[0].length);
 
 		if (vid->out_buf_addr[n] == MAP_FAILED) {
 			fprintf(stderr, "Failed to MMAP OUTPUT buffer \n");
@@ -311,6 +666,8 @@ void vc8000_v4l2_release_output(
 )
 {
 	struct video *vid = psVideo;
+	uint64_t u64TraceNs;
+	int ret;
 	int n;
 	
 	for(n = 0; n < vid->out_buf_cnt; n++)
@@ -320,7 +677,10 @@ void vc8000_v4l2_release_output(
 #if defined (ENABLE_DBG)
 			fprintf(stdout, "unmap output memeory n:%d , addr:%x, size %d \n", n, vid->out_buf_addr[n], vid->out_buf_size);
 #endif
-			if(munmap(vid->out_buf_addr[n], vid->out_buf_size) != 0)
+			u64TraceNs = VC8000_TRACE_TIME();
+			ret = munmap(vid->out_buf_addr[n], vid->out_buf_size);
+			VC8000_TRACE(eVC8000_TRACE_MUNMAP, u64TraceNs, vid->fd, vid->out_buf_size);
+			if(ret != 0)
 			{
 #if defined (ENABLE_DBG)
 				fprintf(stdout, "unable unmap output memeory %p\n", vid->out_buf_addr[n]);
@@ -331,6 +691,7 @@ void vc8000_v4l2_release_output(
 
 	}
 
+	vid->out_buf_cnt = 0;
 }
 
 /* 
@@ -348,6 +709,7 @@ int vc8000_v4l2_setup_capture(struct video *psVideo, int pixel_format, int buf_c
 	struct v4l2_requestbuffers reqbuf;
 	struct v4l2_buffer buf;
 	struct v4l2_plane planes[MAX_PLANES];
+	uint64_t u64TraceNs;
 	int ret;
 	int n,p;
 
@@ -392,6 +754,7 @@ int vc8000_v4l2_setup_capture(struct video *psVideo, int pixel_format, int buf_c
 	vid->cap_h = fmt.fmt.pix_mp.height;
 
 	vid->cap_buf_num_planes = fmt.fmt.pix_mp.num_planes;
+	vid->cap_bytesperline = fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
 	
 	for(p = 0; p < vid->cap_buf_num_planes; p ++)
 	{
@@ -411,10 +774,13 @@ int vc8000_v4l2_setup_capture(struct video *psVideo, int pixel_format, int buf_c
 	    fmt.fmt.pix_mp.width, fmt.fmt.pix_mp.height, fmt.fmt.pix_mp.num_planes);
 #endif
 
+	if(vid->cap_memory == 0)
+		vid->cap_memory = V4L2_MEMORY_MMAP;
+
 	memzero(reqbuf);
 	reqbuf.count = vid->cap_buf_cnt;
 	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-	reqbuf.memory = V4L2_MEMORY_MMAP;
+	reqbuf.memory = vid->cap_memory;
 
 	ret = ioctl(vid->fd, VIDIOC_REQBUFS, &reqbuf);
 	if (ret != 0) {
@@ -429,6 +795,16 @@ int vc8000_v4l2_setup_capture(struct video *psVideo, int pixel_format, int buf_c
 
 	vid->cap_buf_cnt = reqbuf.count;
 
+	//USERPTR/DMABUF: buffer of each job is given by caller, nothing to map
+	if(vid->cap_memory != V4L2_MEMORY_MMAP) {
+		for (n = 0; n < vid->cap_buf_cnt; n++) {
+			for(p = 0; p < vid->cap_buf_num_planes; p ++)
+				vid->cap_buf_planes_size[n][p] = fmt.fmt.pix_mp.plane_fmt[p].sizeimage;
+			vid->cap_buf_flag[n] = eV4L2_BUF_DEQUEUE;
+		}
+		return 0;
+	}
+
 	for (n = 0; n < vid->cap_buf_cnt; n++) {
 		memzero(buf);
 		memset(planes, 0, sizeof(planes));
@@ -448,11 +824,13 @@ int vc8000_v4l2_setup_capture(struct video *psVideo, int pixel_format, int buf_c
 
 			vid->cap_buf_off[n][p] = buf.m.planes[p].m.mem_offset;
 
+			u64TraceNs = VC8000_TRACE_TIME();
 			vid->cap_buf_addr[n][p] = mmap(NULL, buf.m.planes[p].length,
 							   PROT_READ | PROT_WRITE,
 							   MAP_SHARED,
 							   vid->fd,
 							   buf.m.planes[p].m.mem_offset);
+			VC8000_TRACE(eVC8000_TRACE_MMAP, u64TraceNs, vid->fd, buf.m.planes[p].length);
 
 			if (vid->cap_buf_addr[n][p] == MAP_FAILED) {
 				fprintf(stderr, "Failed to MMAP CAPTURE buffer on plane0 \n");
@@ -507,6 +885,7 @@ int vc8000_v4l2_setup_post_processing(struct video *psVideo,
 {
 	struct vc8k_pp_params  sVC8K_PP;
 
+	memzero(sVC8K_PP);
 	sVC8K_PP.enable_pp = bEnablePP;
 	sVC8K_PP.frame_buff_size = psFBInfo->frame_buf_size;
 	sVC8K_PP.frame_buf_paddr= psFBInfo->frame_buf_paddr;
@@ -520,8 +899,9 @@ int vc8000_v4l2_setup_post_processing(struct video *psVideo,
 	sVC8K_PP.img_out_fmt = pixel_format;
 	sVC8K_PP.pp_out_dst = psFBInfo->frame_buf_no;
 	sVC8K_PP.libjpeg_mode = 1;
-		
-	ioctl(psVideo->fd, VC8KIOC_PP_SET_CONFIG, &sVC8K_PP);
+
+	//applied by job scheduler right before the job is queued to hardware
+	psVideo->pp_params = sVC8K_PP;
 
 #if defined (ENABLE_DBG)
 //	printf("DDDDD vc8000_v4l2_setup_post_processing sVC8K_PP.enable_pp %x \n", sVC8K_PP.enable_pp);
@@ -544,6 +924,8 @@ void vc8000_v4l2_release_capture(
 )
 {
 	struct video *vid = psVideo;
+	uint64_t u64TraceNs;
+	int ret;
 	int n,p;
 	
 	for(n = 0; n < vid->cap_buf_cnt; n++)
@@ -557,7 +939,10 @@ void vc8000_v4l2_release_capture(
 #if defined (ENABLE_DBG)
 				fprintf(stdout, "unmap capture memeory n:%d, p:%d, addr:%x, size %d \n", n, p, vid->cap_buf_addr[n][p], vid->cap_buf_planes_size[n][p]);
 #endif
-				if(munmap(vid->cap_buf_addr[n][p], vid->cap_buf_planes_size[n][p]) != 0)
+				u64TraceNs = VC8000_TRACE_TIME();
+				ret = munmap(vid->cap_buf_addr[n][p], vid->cap_buf_planes_size[n][p]);
+				VC8000_TRACE(eVC8000_TRACE_MUNMAP, u64TraceNs, vid->fd, vid->cap_buf_planes_size[n][p]);
+				if(ret != 0)
 				{
 #if defined (ENABLE_DBG)
 					fprintf(stdout, "unable unmap capture memeory %p\n", vid->cap_buf_addr[n][p]);
@@ -567,6 +952,18 @@ void vc8000_v4l2_release_capture(
 			}
 		}
 	}
+
+	for(n = 0; n < MAX_CAP_BUF; n++)
+	{
+		if(vid->cap_buf_dmabuf_fd[n] >= 0)
+		{
+			close(vid->cap_buf_dmabuf_fd[n]);
+			vid->cap_buf_dmabuf_fd[n] = -1;
+		}
+	}
+
+	vid->cap_buf_cnt = 0;
+	vid->cap_pixel_format = 0;
 }
 
 int vc8000_v4l2_queue_output(
@@ -602,6 +999,129 @@ int vc8000_v4l2_queue_capture(
 			       V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, psVideo->cap_buf_num_planes);
 }
 
+int vc8000_v4l2_queue_capture_user(
+	struct video *psVideo,
+	int n,
+	void *pvAddr,
+	int i32DmaBufFd,
+	uint32_t u32Size
+)
+{
+	struct video *vid = psVideo;
+	struct v4l2_buffer buf;
+	struct v4l2_plane planes[MAX_PLANES];
+	uint64_t u64TraceNs;
+	int ret;
+
+	if ((n >= vid->cap_buf_cnt) || (vid->cap_buf_num_planes != 1)) {
+		fprintf(stderr, "Tried to queue a non exisiting buffer \n");
+		return -1;
+	}
+
+	if (u32Size < vid->cap_buf_planes_size[n][0]) {
+		fprintf(stderr, "CAPTURE user buffer too small (%u < %d) \n", u32Size, vid->cap_buf_planes_size[n][0]);
+		return -1;
+	}
+
+	memzero(buf);
+	memset(planes, 0, sizeof(planes));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	buf.memory = vid->cap_memory;
+	buf.index = n;
+	buf.length = 1;
+	buf.m.planes = planes;
+	buf.m.planes[0].length = u32Size;
+
+	if (vid->cap_memory == V4L2_MEMORY_DMABUF)
+		buf.m.planes[0].m.fd = i32DmaBufFd;
+	else
+		buf.m.planes[0].m.userptr = (unsigned long)pvAddr;
+
+	u64TraceNs = VC8000_TRACE_TIME();
+	ret = ioctl(vid->fd, VIDIOC_QBUF, &buf);
+	VC8000_TRACE(eVC8000_TRACE_QBUF_CAPTURE, u64TraceNs, vid->fd, n);
+	if (ret) {
+		fprintf(stderr, "Failed to queue %s user buffer on CAPTURE (%s) \n",
+		    (vid->cap_memory == V4L2_MEMORY_DMABUF) ? "DMABUF" : "USERPTR", strerror(errno));
+
+		//driver can't import this kind of memory, stop trying
+		if (vid->cap_memory == V4L2_MEMORY_DMABUF)
+			s_bDmaBufCaptureFailed = true;
+		else
+			s_bUserPtrCaptureFailed = true;
+		return -1;
+	}
+
+	return 0;
+}
+
+bool vc8000_v4l2_capture_memory_supported(int memory)
+{
+	if (memory == V4L2_MEMORY_USERPTR)
+		return !s_bUserPtrCaptureFailed;
+	if (memory == V4L2_MEMORY_DMABUF)
+		return !s_bDmaBufCaptureFailed;
+
+	return (memory == V4L2_MEMORY_MMAP);
+}
+
+bool vc8000_v4l2_capture_format_supported(int pixel_format)
+{
+	int i;
+
+	pthread_once(&s_tNodeOnce, vc8000_v4l2_enum_nodes);
+
+	//driver without format list, formats the decoder always had
+	if (s_i32CapFormatCnt == 0)
+		return (pixel_format == V4L2_PIX_FMT_NV12) || (pixel_format == V4L2_PIX_FMT_ABGR32) ||
+			(pixel_format == V4L2_PIX_FMT_RGB565) || (pixel_format == V4L2_PIX_FMT_YUYV);
+
+	for (i = 0; i < s_i32CapFormatCnt; i ++) {
+		if (s_au32CapFormat[i] == (uint32_t)pixel_format)
+			return true;
+	}
+
+	return false;
+}
+
+int vc8000_v4l2_export_capture(
+	struct video *psVideo,
+	int n,
+	int *pi32DmaBufFd
+)
+{
+	struct video *vid = psVideo;
+	struct v4l2_exportbuffer expbuf;
+	int ret;
+
+	*pi32DmaBufFd = -1;
+
+	if ((n < 0) || (n >= vid->cap_buf_cnt) || (vid->cap_memory != V4L2_MEMORY_MMAP)) {
+		fprintf(stderr, "Tried to export a non exisiting buffer \n");
+		return -1;
+	}
+
+	//exported once, dmabuf stays valid as long as the buffer is allocated
+	if (vid->cap_buf_dmabuf_fd[n] < 0) {
+		memzero(expbuf);
+		expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+		expbuf.index = n;
+		expbuf.plane = 0;
+		expbuf.flags = O_CLOEXEC | O_RDWR;
+
+		ret = ioctl(vid->fd, VIDIOC_EXPBUF, &expbuf);
+		if (ret) {
+			fprintf(stderr, "EXPBUF failed on CAPTURE buffer %d (%s) \n", n, strerror(errno));
+			return -1;
+		}
+
+		vid->cap_buf_dmabuf_fd[n] = expbuf.fd;
+	}
+
+	*pi32DmaBufFd = vid->cap_buf_dmabuf_fd[n];
+	return 0;
+}
+
 int vc8000_v4l2_dequeue_output(
 	struct video *psVideo,
 	int *n
@@ -638,7 +1158,7 @@ int vc8000_v4l2_dequeue_capture(
 
 	memzero(buf);
 	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-	buf.memory = V4L2_MEMORY_MMAP;
+	buf.memory = psVideo->cap_memory;
 	buf.m.planes = planes;
 	buf.length = psVideo->cap_buf_num_planes; //CAP_PLANES;
 
@@ -667,9 +1187,13 @@ int vc8000_v4l2_stream(
 )
 {
 	struct video *vid = psVideo;
+	uint64_t u64TraceNs;
 	int ret;
 
+	u64TraceNs = VC8000_TRACE_TIME();
 	ret = ioctl(vid->fd, status, &type);
+	VC8000_TRACE((status == VIDIOC_STREAMOFF) ? eVC8000_TRACE_STREAMOFF : eVC8000_TRACE_STREAMON,
+		u64TraceNs, vid->fd, type);
 	if (ret) {
 		fprintf(stderr, "Failed to change streaming (type=%s, status=%s) \n",
 		    dbg_type[type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE],
@@ -699,7 +1223,7 @@ int vc8000_v4l2_stop_capture(
 		fprintf(stderr, "STREAMOFF CAPTURE queue failed (%s) \n", strerror(errno));
 
 	memzero(reqbuf);
-	reqbuf.memory = V4L2_MEMORY_MMAP;
+	reqbuf.memory = vid->cap_memory;
 	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 
 	ret = ioctl(vid->fd, VIDIOC_REQBUFS, &reqbuf);
@@ -747,6 +1271,42 @@ int vc8000_v4l2_stop(
 {
 	vc8000_v4l2_stop_capture(psVideo);
 	vc8000_v4l2_stop_output(psVideo);
+	psVideo->streaming = false;
+
+	return 0;
+}
+
+int vc8000_jpeg_prepare_bitstream(
+	struct video *psVideo,
+	uint32_t u32StreamBufSize
+)
+{
+	int i32Ret;
+
+	if(psVideo->fd < 0)
+		return -1;
+
+	if(psVideo->streaming)
+		vc8000_jpeg_release_decompress(psVideo, 0);
+
+	//bitstream buffer is only reallocated when it grows over the high-water mark
+	if((psVideo->out_buf_cnt == 0) || (psVideo->out_buf_size < u32StreamBufSize) ||
+		(psVideo->out_slot_cnt != psVideo->slot_cnt))
+	{
+		if(psVideo->out_buf_cnt)
+			vc8000_v4l2_stop_output(psVideo);
+
+		i32Ret = vc8000_v4l2_setup_output(psVideo, 
+									V4L2_PIX_FMT_JPEG, 
+									u32StreamBufSize, 
+									psVideo->slot_cnt);
+		if(i32Ret != 0){
+			vc8000_v4l2_stop_output(psVideo);
+			return -5;
+		}
+
+		psVideo->out_slot_cnt = psVideo->slot_cnt;
+	}
 
 	return 0;
 }
@@ -765,11 +1325,14 @@ int vc8000_jpeg_prepare_decompress(
 	uint32_t u32ImgFBPosX,
 	uint32_t u32ImgFBPosY,	
 	int i32RotOP,
-	int pixel_format
+	int pixel_format,
+	int cap_memory,
+	uint32_t u32StreamBufSize
 )
 {
 	int i32Ret = 0; 
-	int n;
+	int i32CapWidth;
+	int i32CapHeight;
 
 	if(psVideo->fd < 0)
 		return -1;
@@ -790,35 +1353,51 @@ int vc8000_jpeg_prepare_decompress(
 		return -4;
 	}
 
+	//pipelined session joined by vc8000_v4l2_open() is already configured and streaming
+	if(psVideo->joinable)
+		return 0;
 
-	i32Ret = vc8000_v4l2_setup_output(psVideo, 
-								V4L2_PIX_FMT_JPEG, 
-								u32ImageWidth * u32ImageHeight, 
-								1);
-	if(i32Ret != 0){
-		return -5;
-	}
+	i32Ret = vc8000_jpeg_prepare_bitstream(psVideo, u32StreamBufSize);
+	if(i32Ret != 0)
+		return i32Ret;
 
+	//capture buffer is only reconfigured when output size or format changes
 	if(bDirectFBOut == true){
-		i32Ret = vc8000_v4l2_setup_capture(psVideo, 
-									pixel_format, 
-									1, 
-									32,
-									32
-									);
+		i32CapWidth = 32;
+		i32CapHeight = 32;
 	}
 	else {
+		i32CapWidth = u32OutputWidth;
+		i32CapHeight = u32OutputHeight;
+	}
+
+	if((psVideo->cap_pixel_format != pixel_format) ||
+		(psVideo->cap_req_w != i32CapWidth) ||
+		(psVideo->cap_req_h != i32CapHeight) ||
+		(psVideo->cap_memory != cap_memory) ||
+		(psVideo->cap_slot_cnt != psVideo->slot_cnt))
+	{
+		if(psVideo->cap_buf_cnt)
+			vc8000_v4l2_stop_capture(psVideo);
+
+		psVideo->cap_memory = cap_memory;
+
 		i32Ret = vc8000_v4l2_setup_capture(psVideo, 
 									pixel_format, 
-									1, 
-									u32OutputWidth,
-									u32OutputHeight
+									psVideo->slot_cnt, 
+									i32CapWidth,
+									i32CapHeight
 									);
-	}
 
-	if(i32Ret != 0){
-		vc8000_v4l2_release_output(psVideo);
-		return -6;
+		if(i32Ret != 0){
+			vc8000_v4l2_stop_capture(psVideo);
+			return -6;
+		}
+
+		psVideo->cap_pixel_format = pixel_format;
+		psVideo->cap_req_w = i32CapWidth;
+		psVideo->cap_req_h = i32CapHeight;
+		psVideo->cap_slot_cnt = psVideo->slot_cnt;
 	}
 
 //    struct video_fb_info sFBInfo;
@@ -843,144 +1422,716 @@ int vc8000_jpeg_prepare_decompress(
 	    
 	vc8000_v4l2_stream(psVideo, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, VIDIOC_STREAMON);
     vc8000_v4l2_stream(psVideo, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, VIDIOC_STREAMON);                
-
-	//put capture dequeued buffer into queue
-	for(n = 0; n < psVideo->cap_buf_cnt; n ++)
-	{
-			if(psVideo->cap_buf_flag[n] == eV4L2_BUF_DEQUEUE)
-			{
-					vc8000_v4l2_queue_capture(psVideo, n);
-					psVideo->cap_buf_flag[n] = eV4L2_BUF_INQUEUE;
-			}       
-	}
-
+	psVideo->streaming = true;
+
+	//driver may give less buffers than requested, pipelined session is open for other decoders now
+	vc8000_sched_lock();
+	if(psVideo->out_buf_cnt < psVideo->slot_cnt)
+		psVideo->slot_cnt = psVideo->out_buf_cnt;
+	if(psVideo->cap_buf_cnt < psVideo->slot_cnt)
+		psVideo->slot_cnt = psVideo->cap_buf_cnt;
+	if(psVideo->slot_cnt > 1)
+		psVideo->joinable = true;
+	pthread_mutex_unlock(&s_tSchedLock);
+
+	//capture buffers are queued by job scheduler
 	return 0;
 }
 
 int vc8000_jpeg_get_bitstream_buffer(
 	struct video *psVideo,
+	int slot,
 	char **ppchBufferAddr
 )
 {
-	int n;
 	*ppchBufferAddr = NULL;
 	
-	//Get output dequeued buffer 
-	for(n = 0; n < psVideo->out_buf_cnt; n ++)
-	{
-		if(psVideo->out_buf_flag[n] == eV4L2_BUF_DEQUEUE)
-		{
-			*ppchBufferAddr = psVideo->out_buf_addr[n];
-			break;
-		}
-	}
+	//Get output dequeued buffer of slot
+	if((slot < psVideo->out_buf_cnt) && (psVideo->out_buf_flag[slot] == eV4L2_BUF_DEQUEUE))
+		*ppchBufferAddr = psVideo->out_buf_addr[slot];
 
 	return psVideo->out_buf_size;
 }
 
-int vc8000_jpeg_inqueue_bitstream_buffer(
+/*
+ * Wait hardware progress of jobs queued on session, called by job scheduler only.
+ * Dequeued buffers are matched to jobs in queued order, hardware decodes them
+ * one by one. i32TimeoutMs < 0 waits without limit. Return -1 if the session
+ * can not make progress anymore.
+ */
+static int vc8000_v4l2_poll_jobs(
+	struct vc8000_node *psNode,
 	struct video *psVideo,
-	char *pchBufferAddr,
-	uint32_t u32StreamLen
+	struct vc8000_job *psHWHead,
+	int i32TimeoutMs
 )
 {
-	int n;
-	int ret;
-	//Get output dequeued buffer index
-	for(n = 0; n < psVideo->out_buf_cnt; n ++)
-	{
-		if(psVideo->out_buf_addr[n] == pchBufferAddr)
-		{
-			ret = vc8000_v4l2_queue_output(psVideo, n, u32StreamLen);
-			psVideo->out_buf_flag[n] = eV4L2_BUF_INQUEUE;
+	struct pollfd asPfd[2];
+	struct vc8000_job *psJob;
+	short revents;
+	int ret, cap_index, finished, output_index;
+	unsigned int bytesused;
+	uint64_t u64Cnt;
+	uint64_t u64TraceNs;
+
+	asPfd[0].fd = psVideo->fd;
+	asPfd[0].events = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM |
+				 POLLRDBAND | POLLPRI;
+	asPfd[0].revents = 0;
+
+	//new job may be pipelined behind running ones
+	asPfd[1].fd = psNode->i32WakeFd;
+	asPfd[1].events = POLLIN;
+	asPfd[1].revents = 0;
+
+	u64TraceNs = VC8000_TRACE_TIME();
+	ret = poll(asPfd, 2, i32TimeoutMs);
+	VC8000_TRACE(eVC8000_TRACE_POLL, u64TraceNs, psVideo->fd, asPfd[0].revents);
+	if (ret < 0) {
+		if (errno == EINTR)
 			return 0;
+		fprintf(stderr, "poll error");
+		return -1;
+	}
+
+	if (asPfd[1].revents & POLLIN) {
+		if(read(psNode->i32WakeFd, &u64Cnt, sizeof(u64Cnt)) != sizeof(u64Cnt))
+			u64Cnt = 0;
+	}
+
+	revents = asPfd[0].revents;
+
+	if (revents & (POLLIN | POLLRDNORM)) {
+		/* capture buffer is ready */
+		ret = vc8000_v4l2_dequeue_capture(psVideo, &cap_index, &finished,
+									&bytesused);
+		if (ret == 0) {
+			psVideo->cap_buf_flag[cap_index] = eV4L2_BUF_DEQUEUE;
+			psVideo->total_captured++;
+
+			for(psJob = psHWHead; psJob; psJob = psJob->next) {
+				if(!psJob->cap_dequeued) {
+					psJob->cap_dequeued = true;
+					psJob->cap_index = cap_index;
+					psJob->result = finished ? 0 : -3;
+					break;
+				}
+			}
+		}
+	}
+
+	if (revents & (POLLOUT | POLLWRNORM)) {
+		ret = vc8000_v4l2_dequeue_output(psVideo, &output_index);
+		if (ret < 0) {
+			fprintf(stderr, "dequeue output buffer fail");
+		} else {
+			psVideo->out_buf_flag[output_index] = eV4L2_BUF_DEQUEUE;
+
+			for(psJob = psHWHead; psJob; psJob = psJob->next) {
+				if(!psJob->out_dequeued) {
+					psJob->out_dequeued = true;
+					break;
+				}
+			}
 		}
 	}
 
-	return -1;
+	if ((revents & POLLERR) &&
+		!(revents & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM)))
+		return -1;
+
+	return 0;
 }
 
-int vc8000_jpeg_poll_decode_done(
-        struct video *psVideo,
-        int *p_cap_index
+//Queue capture and bitstream buffer of job slot to hardware
+static int vc8000_v4l2_start_job(
+	struct vc8000_job *psJob
 )
 {
-	struct pollfd pfd;
-	short revents;
-	int ret, cap_index, finished, output_index;
+	struct video *psVideo = psJob->psVideo;
+	int n = psJob->slot;
+	int i32Ret;
 
-	pfd.fd = psVideo->fd;
-	pfd.events = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM |
-				 POLLRDBAND | POLLPRI;
+	psJob->cap_dequeued = false;
+	psJob->out_dequeued = false;
+	psJob->cap_index = -1;
+	psJob->result = -1;
 
-	ret = -1;
-	cap_index = -1;
-	output_index = -1;
+	if(psVideo->cap_buf_flag[n] == eV4L2_BUF_DEQUEUE)
+	{
+		if(psVideo->cap_memory != V4L2_MEMORY_MMAP)
+			i32Ret = vc8000_v4l2_queue_capture_user(psVideo, n, psJob->user_addr, psJob->user_fd, psJob->user_size);
+		else
+			i32Ret = vc8000_v4l2_queue_capture(psVideo, n);
 
-	while (1) {
-		//ret = poll(&pfd, 1, 2000);
-		ret = poll(&pfd, 1, -1);
+		if(i32Ret != 0)
+			return -1;
+		psVideo->cap_buf_flag[n] = eV4L2_BUF_INQUEUE;
+	}
 
-		if (!ret) {
-			//timeout
-			ret = -1;
-			break;
-		} else if (ret < 0) {
-			fprintf(stderr, "poll error");
-			ret = -2;
-			break;
+	if(vc8000_v4l2_queue_output(psVideo, n, psJob->stream_len) != 0)
+		return -1;
+
+	psVideo->out_buf_flag[n] = eV4L2_BUF_INQUEUE;
+	return 0;
+}
+
+//Return all buffers of session from driver after failure, other slots can go on
+static void vc8000_v4l2_reset_stream(
+	struct video *psVideo
+)
+{
+	int n;
+
+	vc8000_v4l2_stream(psVideo, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, VIDIOC_STREAMOFF);
+	vc8000_v4l2_stream(psVideo, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, VIDIOC_STREAMOFF);
+
+	for(n = 0; n < psVideo->out_buf_cnt; n ++)
+		psVideo->out_buf_flag[n] = eV4L2_BUF_DEQUEUE;
+
+	for(n = 0; n < psVideo->cap_buf_cnt; n ++)
+		psVideo->cap_buf_flag[n] = eV4L2_BUF_DEQUEUE;
+
+	vc8000_v4l2_stream(psVideo, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, VIDIOC_STREAMON);
+	vc8000_v4l2_stream(psVideo, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, VIDIOC_STREAMON);
+}
+
+/*
+ * Job scheduler. Decode sessions queue their job to the node they were
+ * dispatched to and a dispatcher thread per node runs the jobs, so the device
+ * is only held for the queue/dequeue window. Bitstream filling and pixel
+ * conversion of other sessions are running at the same time.
+ *
+ * Jobs of the session owning the hardware are queued to the driver back to
+ * back (one per slot), so hardware goes on with next image of a pipelined
+ * session without waiting for the scheduler.
+ */
+static void vc8000_sched_signal_done(
+	struct vc8000_job *psJob
+)
+{
+	uint64_t u64Cnt = 1;
+
+	if(write(psJob->evt_fd, &u64Cnt, sizeof(u64Cnt)) != sizeof(u64Cnt))
+		fprintf(stderr, "Unable signal job done event \n");
+}
+
+//Finish job, must hold s_tSchedLock
+static void vc8000_sched_complete(
+	struct vc8000_node *psNode,
+	struct vc8000_job *psJob,
+	int i32Result
+)
+{
+	if(i32Result == 0)
+		psNode->sStats.jobs_done ++;
+	else
+		psNode->sStats.jobs_failed ++;
+
+	psJob->result = i32Result;
+	psJob->state = eVC8000_JOB_DONE;
+	psJob->decode_ns = vc8000_get_time_ns() - psJob->submit_ns;
+	pthread_cond_broadcast(&s_tJobDoneCond);
+	vc8000_sched_signal_done(psJob);
+}
+
+//Take decode result of done job, must hold s_tSchedLock
+static int vc8000_sched_take_result(
+	struct vc8000_job *psJob,
+	int *p_cap_index
+)
+{
+	uint64_t u64Cnt;
+
+	//reset done event
+	if(read(psJob->evt_fd, &u64Cnt, sizeof(u64Cnt)) != sizeof(u64Cnt))
+		u64Cnt = 0;
+
+	psJob->state = eVC8000_JOB_IDLE;
+	*p_cap_index = psJob->cap_index;
+	return psJob->result;
+}
+
+static void vc8000_sched_cancel(struct vc8000_job *psJob);
+static void vc8000_sched_check_deadline(struct vc8000_job *psJob);
+
+//Poll timeout until nearest deadline of jobs in hardware or queued, -1 if none, must hold s_tSchedLock
+static int vc8000_sched_poll_timeout(
+	struct vc8000_node *psNode,
+	struct vc8000_job *psHWHead
+)
+{
+	struct vc8000_job *apsList[2] = {psHWHead, psNode->psJobHead};
+	struct vc8000_job *psJob;
+	uint64_t u64Deadline = 0;
+	uint64_t u64Now;
+	int i;
+
+	for(i = 0; i < 2; i ++) {
+		for(psJob = apsList[i]; psJob; psJob = psJob->next) {
+			if((psJob->deadline_ns == 0) || psJob->cancel)
+				continue;
+			if((u64Deadline == 0) || (psJob->deadline_ns < u64Deadline))
+				u64Deadline = psJob->deadline_ns;
 		}
+	}
+
+	if(u64Deadline == 0)
+		return -1;
 
-		revents = pfd.revents;
+	u64Now = vc8000_get_time_ns();
+	if(u64Deadline <= u64Now)
+		return 0;
 
-		if (revents & (POLLIN | POLLRDNORM)) {
-			unsigned int bytesused;
+	//round up, poll must not return before the deadline
+	u64Deadline = (u64Deadline - u64Now + 999999ULL) / 1000000ULL;
+	return (u64Deadline > INT_MAX) ? INT_MAX : (int)u64Deadline;
+}
 
-			/* capture buffer is ready */
+//Cancel jobs in hardware or queued past their deadline, must hold s_tSchedLock
+static void vc8000_sched_expire(
+	struct vc8000_node *psNode,
+	struct vc8000_job *psHWHead
+)
+{
+	struct vc8000_job *psJob;
+	struct vc8000_job *psNext;
 
-			ret = vc8000_v4l2_dequeue_capture(psVideo, &cap_index, &finished,
-										&bytesused);
-			if (ret < 0)
-					goto next_event;
+	for(psJob = psHWHead; psJob; psJob = psJob->next)
+		vc8000_sched_check_deadline(psJob);
 
-			psVideo->cap_buf_flag[cap_index] = eV4L2_BUF_DEQUEUE;
-			psVideo->total_captured++;
+	//queued job is unlinked and completed by cancel
+	for(psJob = psNode->psJobHead; psJob; psJob = psNext) {
+		psNext = psJob->next;
+		vc8000_sched_check_deadline(psJob);
+	}
+}
+
+static void *vc8000_sched_thread(void *arg)
+{
+	struct vc8000_node *psNode = (struct vc8000_node *)arg;
+	struct vc8000_job *psJob;
+	struct vc8000_job *psHWHead = NULL;		//jobs queued to hardware, in decode order
+	struct vc8000_job *psHWTail = NULL;
+	struct video *psHWVideo = NULL;			//session owning the hardware
+	int i32InHW = 0;
+	int i32Ret;
+	bool bCancel;
+	int i32TimeoutMs;
+	uint64_t u64StartTime = 0;
+
+	while(1) {
+		vc8000_sched_lock();
+		while((psNode->psJobHead == NULL) && (i32InHW == 0))
+			pthread_cond_wait(&psNode->tJobQueuedCond, &s_tSchedLock);
+
+		//admit jobs in submit order, only jobs of session owning the hardware are pipelined
+		while((psJob = psNode->psJobHead) != NULL) {
+			if(i32InHW && ((psJob->psVideo != psHWVideo) || (i32InHW >= psHWVideo->slot_cnt)))
+				break;
+
+			psNode->psJobHead = psJob->next;
+			if(psNode->psJobHead == NULL)
+				psNode->psJobTail = NULL;
+			psJob->next = NULL;
+			psJob->state = eVC8000_JOB_RUNNING;
+			pthread_mutex_unlock(&s_tSchedLock);
+
+			if(i32InHW == 0) {
+				psHWVideo = psJob->psVideo;
+				u64StartTime = vc8000_get_time_ns();
+				ioctl(psHWVideo->fd, VC8KIOC_PP_SET_CONFIG, &psHWVideo->pp_params);
+			}
+
+			i32Ret = vc8000_v4l2_start_job(psJob);
+
+			vc8000_sched_lock();
+			if(i32Ret != 0) {
+				if(i32InHW == 0)
+					psNode->sStats.busy_ns += vc8000_get_time_ns() - u64StartTime;
+				vc8000_sched_complete(psNode, psJob, -1);
+				continue;
+			}
 
-			//fprintf(stdout, "decoded frame %ld", vid->total_captured);
+			if(psHWTail)
+				psHWTail->next = psJob;
+			else
+				psHWHead = psJob;
+			psHWTail = psJob;
+			i32InHW ++;
 		}
+		//a hung job never signals the driver, deadlines are kept by the scheduler
+		i32TimeoutMs = vc8000_sched_poll_timeout(psNode, psHWHead);
+		pthread_mutex_unlock(&s_tSchedLock);
 
-next_event:
+		if(i32InHW == 0)
+			continue;
+
+		i32Ret = vc8000_v4l2_poll_jobs(psNode, psHWVideo, psHWHead, i32TimeoutMs);
+
+		vc8000_sched_lock();
+		vc8000_sched_expire(psNode, psHWHead);
+		bCancel = false;
+		for(psJob = psHWHead; psJob; psJob = psJob->next) {
+			if(psJob->cancel)
+				bCancel = true;
+		}
+		pthread_mutex_unlock(&s_tSchedLock);
+
+		//stop streams to get buffers of broken or cancelled job back
+		if((i32Ret != 0) || bCancel)
+			vc8000_v4l2_reset_stream(psHWVideo);
+
+		//jobs are done in queued order, all jobs in hardware fail if session is broken
+		vc8000_sched_lock();
+		while((psJob = psHWHead) != NULL) {
+			if((i32Ret == 0) && !(psJob->cap_dequeued && psJob->out_dequeued))
+				break;
+
+			psHWHead = psJob->next;
+			if(psHWHead == NULL)
+				psHWTail = NULL;
+			psJob->next = NULL;
+			i32InHW --;
+			vc8000_sched_complete(psNode, psJob, (i32Ret == 0) ? psJob->result : -1);
+		}
+
+		//cancelled jobs are done, other jobs of session go back to queue head in order
+		if(bCancel && psHWHead) {
+			struct vc8000_job *psRequeueHead = NULL;
+			struct vc8000_job *psRequeueTail = NULL;
 
-		if (revents & (POLLOUT | POLLWRNORM)) {
+			while((psJob = psHWHead) != NULL) {
+				psHWHead = psJob->next;
+				psJob->next = NULL;
+
+				if(psJob->cancel) {
+					vc8000_sched_complete(psNode, psJob, VC8000_JOB_ERR_TIMEOUT);
+					continue;
+				}
 
-			ret = vc8000_v4l2_dequeue_output(psVideo, &output_index);
-			if (ret < 0) {
-					fprintf(stderr, "dequeue output buffer fail");
-			} else {
-					psVideo->out_buf_flag[output_index] = eV4L2_BUF_DEQUEUE;
+				psJob->state = eVC8000_JOB_PENDING;
+				if(psRequeueTail)
+					psRequeueTail->next = psJob;
+				else
+					psRequeueHead = psJob;
+				psRequeueTail = psJob;
 			}
 
+			if(psRequeueHead) {
+				psRequeueTail->next = psNode->psJobHead;
+				psNode->psJobHead = psRequeueHead;
+				if(psNode->psJobTail == NULL)
+					psNode->psJobTail = psRequeueTail;
+			}
+
+			psHWTail = NULL;
+			i32InHW = 0;
+		}
+
+		if(i32InHW == 0)
+			psNode->sStats.busy_ns += vc8000_get_time_ns() - u64StartTime;
+		pthread_mutex_unlock(&s_tSchedLock);
+	}
+
+	return NULL;
+}
+
+static void vc8000_sched_wake(
+	struct vc8000_node *psNode
+)
+{
+	uint64_t u64Cnt = 1;
+
+	if(psNode->i32WakeFd >= 0) {
+		if(write(psNode->i32WakeFd, &u64Cnt, sizeof(u64Cnt)) != sizeof(u64Cnt))
+			fprintf(stderr, "Unable wake VC8000 job scheduler \n");
+	}
+}
+
+static int vc8000_sched_submit(
+	struct vc8000_job *psJob
+)
+{
+	struct vc8000_node *psNode = &s_asNode[psJob->psVideo->node];
+
+	vc8000_sched_lock();
+
+	if(!psNode->bSchedStarted) {
+		pthread_attr_t tAttr;
+
+		pthread_attr_init(&tAttr);
+		pthread_attr_setdetachstate(&tAttr, PTHREAD_CREATE_DETACHED);
+		if(pthread_create(&psNode->tSchedThread, &tAttr, vc8000_sched_thread, psNode) != 0) {
+			pthread_attr_destroy(&tAttr);
+			pthread_mutex_unlock(&s_tSchedLock);
+			fprintf(stderr, "Unable create VC8000 job scheduler for %s \n", psNode->strDevNode);
+			return -1;
+		}
+		pthread_attr_destroy(&tAttr);
+		psNode->bSchedStarted = true;
+	}
+
+	psJob->state = eVC8000_JOB_PENDING;
+	psJob->result = -1;
+	psJob->cap_index = -1;
+	psJob->cancel = false;
+	psJob->submit_ns = vc8000_get_time_ns();
+	psJob->decode_ns = 0;
+	psJob->next = NULL;
+
+	if(psNode->psJobTail)
+		psNode->psJobTail->next = psJob;
+	else
+		psNode->psJobHead = psJob;
+	psNode->psJobTail = psJob;
+	psNode->sStats.jobs_submitted ++;
+
+	pthread_cond_signal(&psNode->tJobQueuedCond);
+	pthread_mutex_unlock(&s_tSchedLock);
+
+	//scheduler may be waiting for hardware
+	vc8000_sched_wake(psNode);
+
+	return 0;
+}
+
+/*
+ * Cancel job past its deadline, must hold s_tSchedLock. A queued job is
+ * dropped right away, a job in hardware is stopped by the scheduler.
+ */
+static void vc8000_sched_cancel(
+	struct vc8000_job *psJob
+)
+{
+	struct vc8000_node *psNode = &s_asNode[psJob->psVideo->node];
+	struct vc8000_job *psPrev = NULL;
+	struct vc8000_job *psCur;
+
+	psJob->cancel = true;
+	psNode->sStats.jobs_timeout ++;
+
+	if(psJob->state != eVC8000_JOB_PENDING) {
+		vc8000_sched_wake(psNode);
+		return;
+	}
+
+	for(psCur = psNode->psJobHead; psCur; psPrev = psCur, psCur = psCur->next) {
+		if(psCur != psJob)
+			continue;
+
+		if(psPrev)
+			psPrev->next = psJob->next;
+		else
+			psNode->psJobHead = psJob->next;
+
+		if(psNode->psJobTail == psJob)
+			psNode->psJobTail = psPrev;
+		break;
+	}
+
+	psJob->next = NULL;
+	vc8000_sched_complete(psNode, psJob, VC8000_JOB_ERR_TIMEOUT);
+}
+
+//Check deadline of unfinished job, must hold s_tSchedLock
+static void vc8000_sched_check_deadline(
+	struct vc8000_job *psJob
+)
+{
+	if((psJob->deadline_ns == 0) || psJob->cancel || (psJob->state == eVC8000_JOB_DONE))
+		return;
+
+	if(vc8000_get_time_ns() >= psJob->deadline_ns)
+		vc8000_sched_cancel(psJob);
+}
+
+int vc8000_jpeg_set_capture_buffer(
+	struct video *psVideo,
+	int slot,
+	void *pvAddr,
+	int i32DmaBufFd,
+	uint32_t u32Size
+)
+{
+	if(psVideo->cap_memory == V4L2_MEMORY_MMAP)
+		return -1;
+
+	if((slot >= psVideo->cap_buf_cnt) || (u32Size < psVideo->cap_buf_planes_size[slot][0]))
+		return -2;
+
+	psVideo->job[slot].user_addr = pvAddr;
+	psVideo->job[slot].user_fd = i32DmaBufFd;
+	psVideo->job[slot].user_size = u32Size;
+	return 0;
+}
+
+uint64_t vc8000_jpeg_get_decode_time(
+	struct video *psVideo,
+	int slot
+)
+{
+	uint64_t u64DecodeNs;
+
+	vc8000_sched_lock();
+	u64DecodeNs = psVideo->job[slot].decode_ns;
+	pthread_mutex_unlock(&s_tSchedLock);
+
+	return u64DecodeNs;
+}
+
+int vc8000_jpeg_set_deadline(
+	struct video *psVideo,
+	int slot,
+	uint32_t u32TimeoutMs
+)
+{
+	if(u32TimeoutMs == 0)
+		psVideo->job[slot].deadline_ns = 0;
+	else
+		psVideo->job[slot].deadline_ns = vc8000_get_time_ns() + (uint64_t)u32TimeoutMs * 1000000ULL;
+
+	return 0;
+}
+
+int vc8000_jpeg_inqueue_bitstream_buffer(
+	struct video *psVideo,
+	int slot,
+	char *pchBufferAddr,
+	uint32_t u32StreamLen
+)
+{
+	if((slot >= psVideo->out_buf_cnt) || (psVideo->out_buf_addr[slot] != pchBufferAddr))
+		return -1;
+
+	psVideo->job[slot].stream_len = u32StreamLen;
+	return vc8000_sched_submit(&psVideo->job[slot]);
+}
+
+int vc8000_jpeg_poll_decode_done(
+        struct video *psVideo,
+        int slot,
+        int *p_cap_index
+)
+{
+	struct vc8000_job *psJob = &psVideo->job[slot];
+	int i32Ret;
+
+	vc8000_sched_lock();
+
+	if(psJob->state == eVC8000_JOB_IDLE) {
+		pthread_mutex_unlock(&s_tSchedLock);
+		return -1;
+	}
+
+	while(psJob->state != eVC8000_JOB_DONE) {
+		vc8000_sched_check_deadline(psJob);
+		if(psJob->state == eVC8000_JOB_DONE)
 			break;
-			// dbg("dequeued output buffer %d", n);
+
+		if((psJob->deadline_ns == 0) || psJob->cancel) {
+			//no deadline, or cancelled and waiting scheduler to stop it
+			pthread_cond_wait(&s_tJobDoneCond, &s_tSchedLock);
+		}
+		else {
+			struct timespec tDeadline;
+
+			tDeadline.tv_sec = psJob->deadline_ns / 1000000000ULL;
+			tDeadline.tv_nsec = psJob->deadline_ns % 1000000000ULL;
+			pthread_cond_timedwait(&s_tJobDoneCond, &s_tSchedLock, &tDeadline);
 		}
 	}
 
-	*p_cap_index = cap_index;
+	i32Ret = vc8000_sched_take_result(psJob, p_cap_index);
+	pthread_mutex_unlock(&s_tSchedLock);
 
-	if (finished == 0) {
-		return -3;
+	return i32Ret;
+}
+
+int vc8000_jpeg_try_decode_done(
+        struct video *psVideo,
+        int slot,
+        int *p_cap_index
+)
+{
+	struct vc8000_job *psJob = &psVideo->job[slot];
+	int i32Ret;
+
+	vc8000_sched_lock();
+
+	if(psJob->state == eVC8000_JOB_IDLE) {
+		pthread_mutex_unlock(&s_tSchedLock);
+		return -1;
+	}
+
+	vc8000_sched_check_deadline(psJob);
+
+	if(psJob->state != eVC8000_JOB_DONE) {
+		pthread_mutex_unlock(&s_tSchedLock);
+		return 1;
 	}
 
-//	fprintf(stdout, "vc8000_jpeg_poll_decode_done result %d \n", ret);
-	return ret;
+	i32Ret = vc8000_sched_take_result(psJob, p_cap_index);
+	pthread_mutex_unlock(&s_tSchedLock);
+
+	return i32Ret;
 }
 
-int vc8000_jpeg_release_decompress(
-        struct video *psVideo
+int vc8000_jpeg_get_done_fd(
+        struct video *psVideo,
+        int slot
 )
 {
-	vc8000_v4l2_stop(psVideo);
+	return psVideo->job[slot].evt_fd;
 }
 
+int vc8000_jpeg_release_decompress(
+        struct video *psVideo,
+        int slot
+)
+{
+	int n;
+
+	if(!psVideo->streaming)
+		return 0;
 
+	//buffers of pipelined session stay in rotation, stream is stopped when last decoder leaves
+	if(psVideo->joinable)
+		return 0;
 
+	//STREAMOFF returns all buffers to user space, buffers are kept for next image
+	vc8000_v4l2_stream(psVideo, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, VIDIOC_STREAMOFF);
+	vc8000_v4l2_stream(psVideo, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, VIDIOC_STREAMOFF);
+	psVideo->streaming = false;
+
+	for(n = 0; n < psVideo->out_buf_cnt; n ++)
+		psVideo->out_buf_flag[n] = eV4L2_BUF_DEQUEUE;
+
+	for(n = 0; n < psVideo->cap_buf_cnt; n ++)
+		psVideo->cap_buf_flag[n] = eV4L2_BUF_DEQUEUE;
+
+	return 0;
+}
+
+const struct vc8000_backend g_sVC8000V4L2Backend = {
+	.name = "v4l2",
+	.open = vc8000_v4l2_open,
+	.close = vc8000_v4l2_close,
+	.set_pipeline_depth = vc8000_v4l2_set_pipeline_depth,
+	.get_node_count = vc8000_v4l2_get_node_count,
+	.get_node_stats = vc8000_v4l2_get_node_stats,
+	.capture_memory_supported = vc8000_v4l2_capture_memory_supported,
+	.capture_format_supported = vc8000_v4l2_capture_format_supported,
+	.export_capture = vc8000_v4l2_export_capture,
+	.prepare_decompress = vc8000_jpeg_prepare_decompress,
+	.prepare_bitstream = vc8000_jpeg_prepare_bitstream,
+	.get_bitstream_buffer = vc8000_jpeg_get_bitstream_buffer,
+	.set_capture_buffer = vc8000_jpeg_set_capture_buffer,
+	.set_deadline = vc8000_jpeg_set_deadline,
+	.inqueue_bitstream_buffer = vc8000_jpeg_inqueue_bitstream_buffer,
+	.poll_decode_done = vc8000_jpeg_poll_decode_done,
+	.try_decode_done = vc8000_jpeg_try_decode_done,
+	.get_done_fd = vc8000_jpeg_get_done_fd,
+	.get_decode_time = vc8000_jpeg_get_decode_time,
+	.release_decompress = vc8000_jpeg_release_decompress,
+};
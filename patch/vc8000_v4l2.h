@@ -68,9 +68,78 @@ typedef enum {
 	eV4L2_BUF_INQUEUE
 }E_V4L2_BUF_STATUS;
 
+/*
+ *  Private V4L2 post processing ioctl for VC8K
+ */
+
+struct vc8k_pp_params {
+	int   enable_pp;
+	unsigned int   frame_buf_paddr;           /* physical address of frame buffer          */
+	int   frame_buff_size;
+	int   frame_buf_w;               /* width of frame buffer width               */
+	int   frame_buf_h;               /* height of frame buffer                    */
+	int   img_out_x;                 /* image original point(x,y) on frame buffer */
+	int   img_out_y;                 /* image original point(x,y) on frame buffer */
+	int   img_out_w;                 /* image output width on frame buffer        */
+	int   img_out_h;                 /* image output height on frame buffer       */
+	int   img_out_fmt;               /* image output format                       */
+	int   rotation;
+	int   pp_out_dst;                /* PP output destination.                    */
+					 /* 0: fb0                                    */
+					 /* 1: fb1                                    */
+					 /* otherwise: frame_buf_paddr                */
+	int   libjpeg_mode;		 /* 0: v4l2-only; 1: libjpeg+v4l2             */
+	int   resserved[8];
+};
+
+
+/* Decode job state */
+typedef enum {
+	eVC8000_JOB_IDLE,
+	eVC8000_JOB_PENDING,		/* waiting in scheduler queue */
+	eVC8000_JOB_RUNNING,		/* queued to hardware */
+	eVC8000_JOB_DONE
+}E_VC8000_JOB_STATE;
+
+/* Per device node statistics */
+struct vc8000_node_stats {
+	char dev_name[32];
+	int inflight;				/* decode sessions currently dispatched to node */
+	int max_inflight;
+	unsigned long jobs_submitted;
+	unsigned long jobs_done;
+	unsigned long jobs_failed;
+	unsigned long jobs_timeout;		/* cancelled at deadline */
+	uint64_t busy_ns;			/* time hardware held by jobs */
+};
+
+struct video;
+
+/* Decode job, one per pipeline slot (bitstream and capture buffer pair) */
+struct vc8000_job {
+	struct video *psVideo;		/* session owning the slot */
+	int slot;					/* bitstream/capture buffer index of job */
+	E_VC8000_JOB_STATE state;
+	uint32_t stream_len;
+	int cap_index;				/* decoded capture buffer index */
+	bool cap_dequeued;
+	bool out_dequeued;
+	bool cancel;				/* deadline passed, stop job */
+	uint64_t deadline_ns;		/* CLOCK_MONOTONIC, 0: no deadline */
+	uint64_t submit_ns;
+	uint64_t decode_ns;			/* submit to done */
+	int result;
+	int evt_fd;					/* eventfd, readable when job is done */
+	void *user_addr;			/* caller capture buffer (USERPTR) */
+	int user_fd;				/* caller capture buffer (DMABUF) */
+	uint32_t user_size;
+	struct vc8000_job *next;	/* next job in scheduler/hardware queue */
+};
+
 /* video decoder related parameters */
 struct video {
 	int fd;
+	int node;					/* device node index of device manager */
 
 	/* Output queue related for encoded bitstream*/ 
 	int out_buf_cnt;
@@ -95,7 +164,32 @@ struct video {
 //	uint32_t cap_buf_dma_addr[MAX_CAP_BUF][MAX_PLANES];
 	E_V4L2_BUF_STATUS cap_buf_flag[MAX_CAP_BUF];
 	int cap_buf_queued;
+	int cap_memory;				/* V4L2_MEMORY_MMAP/USERPTR/DMABUF */
+	int cap_bytesperline;
+	int cap_buf_dmabuf_fd[MAX_CAP_BUF];	/* exported by VIDIOC_EXPBUF, -1: not exported */
 	unsigned long total_captured;
+
+	/* Session pool related: configuration kept alive across images */
+	int cap_pixel_format;		/* configured capture format, 0: not configured */
+	int cap_req_w;				/* requested capture width  */
+	int cap_req_h;				/* requested capture height */
+	bool streaming;
+	struct video *next;			/* next idle session in pool */
+
+	/* Post processing parameters of current image */
+	struct vc8k_pp_params pp_params;
+
+	/* Pipelined mode: decoders of same output configuration share the session */
+	int slot_cnt;				/* bitstream/capture buffer pairs in rotation */
+	int out_slot_cnt;			/* slot count the bitstream buffers were allocated for */
+	int cap_slot_cnt;			/* slot count the capture buffers were allocated for */
+	int slot_users;
+	bool slot_used[MAX_OUT_BUF];
+	bool joinable;				/* configured and streaming, other decoders may join */
+	struct video *next_active;	/* next active session of node */
+
+	/* Job scheduler related */
+	struct vc8000_job job[MAX_OUT_BUF];
 };
 
 // video decode post processing
@@ -108,8 +202,50 @@ struct video_fb_info {
 	unsigned int frame_buf_no;       /* frame buffer number for direct fb output */
 };
 
-int vc8000_v4l2_open(struct video *psVideo);
-void vc8000_v4l2_close(struct video *psVideo);
+/* Bitstream buffer size requested for image */
+#define VC8000_STREAM_BUF_SIZE(w, h)	((w) * (h))
+
+/*
+Get a decode session. Idle sessions are kept in a pool per device node with the device fd,
+bitstream and capture buffers still mmapped, so only the first image (or an
+image with different output size/format) pays the V4L2 setup cost.
+
+In pipelined mode (pipeline depth > 1) a shareable decoder joins an active session
+with the same capture format/size and a big enough bitstream buffer. Each decoder of
+the session owns one slot (bitstream and capture buffer pair), the job scheduler
+queues jobs of all slots back to back, so filling bitstream of next image and
+converting pixels of previous image overlap with hardware decode.
+*pi32Slot returns the slot of decoder.
+*/
+int vc8000_v4l2_open(
+	struct video **ppsVideo,
+	int *pi32Slot,
+	bool bShareable,
+	int pixel_format,
+	int w,
+	int h,
+	uint32_t u32StreamBufSize
+);
+
+//Leave slot, session is returned to pool when its last slot is left
+void vc8000_v4l2_close(
+	struct video *psVideo,
+	int slot
+);
+
+//Set number of slots of pipelined sessions, 1 disables pipelined mode
+void vc8000_v4l2_set_pipeline_depth(int depth);
+
+/*
+All capable /dev/videoN nodes are enumerated once, each new session is
+dispatched to the node with fewest jobs in flight.
+*/
+int vc8000_v4l2_get_node_count(void);
+
+int vc8000_v4l2_get_node_stats(
+	int node,
+	struct vc8000_node_stats *psStats
+);
 
 /*setup vc8000 v4l2 output(bitstream) plane
 codec:
@@ -162,6 +298,28 @@ int vc8000_v4l2_queue_capture(
 	int n
 );
 
+//queue caller memory as capture buffer (USERPTR or DMABUF session, single plane)
+int vc8000_v4l2_queue_capture_user(
+	struct video *psVideo,
+	int n,
+	void *pvAddr,
+	int i32DmaBufFd,
+	uint32_t u32Size
+);
+
+//false once driver refused caller capture buffer of this memory type
+bool vc8000_v4l2_capture_memory_supported(int memory);
+
+//true if node lists capture pixel format (V4L2_PIX_FMT_xxx) in VIDIOC_ENUM_FMT
+bool vc8000_v4l2_capture_format_supported(int pixel_format);
+
+//export mmapped capture buffer as dmabuf, fd is owned by session until capture buffers are released
+int vc8000_v4l2_export_capture(
+	struct video *psVideo,
+	int n,
+	int *pi32DmaBufFd
+);
+
 //dequeue output buffer
 int vc8000_v4l2_dequeue_output(
 	struct video *psVideo,
@@ -208,31 +366,88 @@ int vc8000_jpeg_prepare_decompress(
 	uint32_t u32ImgFBPosX,
 	uint32_t u32ImgFBPosY,
 	int i32RotOP,
-	int pixel_format
+	int pixel_format,
+	int cap_memory,
+	uint32_t u32StreamBufSize
+);
+
+/*
+Make sure session has bitstream buffers of at least u32StreamBufSize bytes. Done by
+vc8000_jpeg_prepare_decompress(), or before the image is known if caller writes the
+bitstream itself (buffers already big enough are kept with their content).
+*/
+int vc8000_jpeg_prepare_bitstream(
+	struct video *psVideo,
+	uint32_t u32StreamBufSize
 );
 
 //Get JPEG decompress bitstream buffer
 int vc8000_jpeg_get_bitstream_buffer(
 	struct video *psVideo,
+	int slot,
 	char **ppchBufferAddr
 );
 
-//Inqueue bitstream and trigger decompress
+/*
+Decode into caller buffer (session prepared with V4L2_MEMORY_USERPTR or DMABUF cap_memory).
+The buffer must hold the whole capture plane (cap_buf_planes_size) of prepared image.
+*/
+int vc8000_jpeg_set_capture_buffer(
+	struct video *psVideo,
+	int slot,
+	void *pvAddr,
+	int i32DmaBufFd,
+	uint32_t u32Size
+);
+
+//Submit bitstream to job scheduler, the decode is triggered when hardware is free
 int vc8000_jpeg_inqueue_bitstream_buffer(
 	struct video *psVideo,
+	int slot,
 	char *pchBufferAddr,
 	uint32_t u32StreamLen
 );
 
-//Wait JPEG decode done
+/* Result of job cancelled at deadline */
+#define VC8000_JOB_ERR_TIMEOUT	-4
+
+//Set deadline of next job from now, 0 waits forever. Job past deadline is cancelled by the scheduler and completes with VC8000_JOB_ERR_TIMEOUT, also for event fd waiters
+int vc8000_jpeg_set_deadline(
+	struct video *psVideo,
+	int slot,
+	uint32_t u32TimeoutMs
+);
+
+//Time from job submit to done in ns, valid after job is done
+uint64_t vc8000_jpeg_get_decode_time(
+	struct video *psVideo,
+	int slot
+);
+
+//Wait JPEG decode job done
 int vc8000_jpeg_poll_decode_done(
         struct video *psVideo,
+        int slot,
         int *p_cap_index
 );
 
+//Check JPEG decode job without blocking, return 1 if job is still running
+int vc8000_jpeg_try_decode_done(
+        struct video *psVideo,
+        int slot,
+        int *p_cap_index
+);
+
+//Get file descriptor which becomes readable when decode job is done
+int vc8000_jpeg_get_done_fd(
+        struct video *psVideo,
+        int slot
+);
+
 //Release JPEG decompress
 int vc8000_jpeg_release_decompress(
-        struct video *psVideo
+        struct video *psVideo,
+        int slot
 );
 
 #endif
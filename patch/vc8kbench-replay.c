@@ -0,0 +1,802 @@
+/**
+ * @file vc8kbench-replay.c: VC8000 stand-in for vc8kbench -replay
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * open(), close(), ioctl(), mmap(), munmap() and poll() of the benchmark are
+ * interposed. Once replay is enabled, /dev/video0 is emulated: V4L2 buffers
+ * are host memory, and a job (one bitstream buffer plus one capture buffer)
+ * completes after the hardware decode time recorded on a board for the same
+ * capture size. Jobs run one at a time like the hardware. Pixels are not
+ * decoded, the capture buffer keeps its old contents. Everything else goes
+ * to libc.
+ */
+#undef _FORTIFY_SOURCE
+#undef _FILE_OFFSET_BITS
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <linux/videodev2.h>
+
+#include <pthread.h>
+
+#include "vc8kbench.h"
+
+#define REPLAY_DEV_NODE			"/dev/video0"
+#define REPLAY_DEV_PREFIX		"/dev/video"
+
+#define REPLAY_MAX_SESSION		16
+#define REPLAY_MAX_BUF			8
+#define REPLAY_MAX_JOB			(REPLAY_MAX_SESSION * REPLAY_MAX_BUF)
+#define REPLAY_MAX_RECORD		4096
+#define REPLAY_MAX_POLL_FD		64
+
+/* Bitstream buffer size if not given by S_FMT */
+#define REPLAY_DEF_OUT_SIZE		(1024 * 1024)
+
+/* mmap offset of buffer n */
+#define REPLAY_OUT_OFFSET(n)	((off_t)(n) << 24)
+#define REPLAY_CAP_OFFSET(n)	(((off_t)(n) + REPLAY_MAX_BUF) << 24)
+
+struct replay_record {
+	uint32_t w;
+	uint32_t h;
+	uint64_t ns;
+};
+
+struct replay_buf {
+	uint8_t *addr;
+	uint32_t size;
+	bool owned;						/* allocated by stand-in (MMAP) */
+};
+
+struct replay_fifo {
+	int index[REPLAY_MAX_BUF];
+	int cnt;
+};
+
+struct replay_session {
+	bool used;
+	int fd;							/* eventfd, readable while capture buffers are done */
+	uint32_t out_size;
+	int out_cnt;
+	struct replay_buf out[REPLAY_MAX_BUF];
+	uint32_t cap_w;
+	uint32_t cap_h;
+	uint32_t cap_fourcc;
+	uint32_t cap_bpl;
+	uint32_t cap_size;
+	int cap_cnt;
+	int cap_memory;
+	struct replay_buf cap[REPLAY_MAX_BUF];
+	struct replay_fifo out_queued;
+	struct replay_fifo cap_queued;
+	struct replay_fifo out_done;
+	struct replay_fifo cap_done;
+};
+
+struct replay_job {
+	struct replay_session *session;
+	int out_index;
+	int cap_index;
+	uint64_t done_ns;
+};
+
+static struct replay_session s_asSession[REPLAY_MAX_SESSION];
+static struct replay_job s_asJob[REPLAY_MAX_JOB];
+static int s_i32JobCnt = 0;
+static uint64_t s_u64DeviceFreeNs = 0;
+
+static struct replay_record s_asRecord[REPLAY_MAX_RECORD];
+static int s_i32RecordCnt = 0;
+static int s_i32RecordCursor = 0;
+
+static bool s_bReplay = false;
+static pthread_mutex_t s_tReplayLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_tReplayCond;
+static pthread_t s_tReplayThread;
+
+static pthread_once_t s_tLibcOnce = PTHREAD_ONCE_INIT;
+static int (*s_pfnOpen)(const char *, int, ...);
+static int (*s_pfnClose)(int);
+static int (*s_pfnIoctl)(int, unsigned long, ...);
+static void *(*s_pfnMmap)(void *, size_t, int, int, int, off_t);
+static int (*s_pfnMunmap)(void *, size_t);
+static int (*s_pfnPoll)(struct pollfd *, nfds_t, int);
+
+static void replay_libc_init(void)
+{
+	s_pfnOpen = dlsym(RTLD_NEXT, "open");
+	s_pfnClose = dlsym(RTLD_NEXT, "close");
+	s_pfnIoctl = dlsym(RTLD_NEXT, "ioctl");
+	s_pfnMmap = dlsym(RTLD_NEXT, "mmap");
+	s_pfnMunmap = dlsym(RTLD_NEXT, "munmap");
+	s_pfnPoll = dlsym(RTLD_NEXT, "poll");
+}
+
+static uint64_t replay_time_ns(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000ULL + tNow.tv_nsec;
+}
+
+static void replay_fifo_push(struct replay_fifo *psFifo, int i32Index)
+{
+	if(psFifo->cnt < REPLAY_MAX_BUF)
+		psFifo->index[psFifo->cnt ++] = i32Index;
+}
+
+static int replay_fifo_pop(struct replay_fifo *psFifo)
+{
+	int i32Index;
+
+	if(psFifo->cnt == 0)
+		return -1;
+
+	i32Index = psFifo->index[0];
+	psFifo->cnt --;
+	memmove(&psFifo->index[0], &psFifo->index[1], psFifo->cnt * sizeof(int));
+	return i32Index;
+}
+
+//Session of fake device fd, must hold s_tReplayLock
+static struct replay_session *replay_find_session(int fd)
+{
+	int i;
+
+	if(!s_bReplay || (fd < 0))
+		return NULL;
+
+	for(i = 0; i < REPLAY_MAX_SESSION; i ++) {
+		if(s_asSession[i].used && (s_asSession[i].fd == fd))
+			return &s_asSession[i];
+	}
+
+	return NULL;
+}
+
+//Recorded decode time of capture size, cycling through records of same size
+static uint64_t replay_latency(uint32_t u32Width, uint32_t u32Height)
+{
+	uint64_t u64Pixels = (uint64_t)u32Width * u32Height;
+	uint64_t u64BestDiff = UINT64_MAX;
+	int i32Best = -1;
+	int i, i32Idx;
+
+	for(i = 1; i <= s_i32RecordCnt; i ++) {
+		i32Idx = (s_i32RecordCursor + i) % s_i32RecordCnt;
+		if((s_asRecord[i32Idx].w == u32Width) && (s_asRecord[i32Idx].h == u32Height)) {
+			s_i32RecordCursor = i32Idx;
+			return s_asRecord[i32Idx].ns;
+		}
+	}
+
+	//no record of this size, scale nearest one by pixel count
+	for(i = 0; i < s_i32RecordCnt; i ++) {
+		uint64_t u64RecPixels = (uint64_t)s_asRecord[i].w * s_asRecord[i].h;
+		uint64_t u64Diff = (u64RecPixels > u64Pixels) ? u64RecPixels - u64Pixels : u64Pixels - u64RecPixels;
+
+		if(u64Diff < u64BestDiff) {
+			u64BestDiff = u64Diff;
+			i32Best = i;
+		}
+	}
+
+	if((i32Best < 0) || (s_asRecord[i32Best].w * s_asRecord[i32Best].h == 0))
+		return 0;
+
+	return s_asRecord[i32Best].ns * u64Pixels / ((uint64_t)s_asRecord[i32Best].w * s_asRecord[i32Best].h);
+}
+
+//Start jobs of queued buffer pairs, must hold s_tReplayLock
+static void replay_schedule(struct replay_session *psSession)
+{
+	uint64_t u64Now = replay_time_ns();
+
+	while((psSession->out_queued.cnt > 0) && (psSession->cap_queued.cnt > 0) &&
+		  (s_i32JobCnt < REPLAY_MAX_JOB)) {
+		struct replay_job *psJob = &s_asJob[s_i32JobCnt ++];
+
+		psJob->session = psSession;
+		psJob->out_index = replay_fifo_pop(&psSession->out_queued);
+		psJob->cap_index = replay_fifo_pop(&psSession->cap_queued);
+
+		//hardware decodes one job at a time
+		if(s_u64DeviceFreeNs < u64Now)
+			s_u64DeviceFreeNs = u64Now;
+		s_u64DeviceFreeNs += replay_latency(psSession->cap_w, psSession->cap_h);
+		psJob->done_ns = s_u64DeviceFreeNs;
+	}
+
+	pthread_cond_signal(&s_tReplayCond);
+}
+
+//Drop running jobs and queued/done buffers of one or both queues, must hold s_tReplayLock
+static void replay_flush(struct replay_session *psSession, bool bOutput, bool bCapture)
+{
+	uint64_t u64Cnt;
+	int i, j;
+
+	for(i = 0, j = 0; i < s_i32JobCnt; i ++) {
+		if(s_asJob[i].session != psSession)
+			s_asJob[j ++] = s_asJob[i];
+	}
+	s_i32JobCnt = j;
+
+	if(bOutput) {
+		memset(&psSession->out_queued, 0, sizeof(struct replay_fifo));
+		memset(&psSession->out_done, 0, sizeof(struct replay_fifo));
+	}
+
+	if(bCapture) {
+		memset(&psSession->cap_queued, 0, sizeof(struct replay_fifo));
+		memset(&psSession->cap_done, 0, sizeof(struct replay_fifo));
+
+		while(read(psSession->fd, &u64Cnt, sizeof(u64Cnt)) == sizeof(u64Cnt))
+			;
+	}
+}
+
+static void replay_free_bufs(struct replay_buf *psBuf, int *pi32Cnt)
+{
+	int i;
+
+	for(i = 0; i < *pi32Cnt; i ++) {
+		if(psBuf[i].owned)
+			free(psBuf[i].addr);
+		memset(&psBuf[i], 0, sizeof(struct replay_buf));
+	}
+
+	*pi32Cnt = 0;
+}
+
+//Complete jobs when their recorded decode time has passed
+static void *replay_thread(void *arg)
+{
+	struct timespec tWake;
+	uint64_t u64One = 1;
+
+	pthread_mutex_lock(&s_tReplayLock);
+
+	while(1) {
+		struct replay_job sJob;
+		uint64_t u64Now;
+
+		if(s_i32JobCnt == 0) {
+			pthread_cond_wait(&s_tReplayCond, &s_tReplayLock);
+			continue;
+		}
+
+		u64Now = replay_time_ns();
+		if(s_asJob[0].done_ns > u64Now) {
+			tWake.tv_sec = s_asJob[0].done_ns / 1000000000ULL;
+			tWake.tv_nsec = s_asJob[0].done_ns % 1000000000ULL;
+			pthread_cond_timedwait(&s_tReplayCond, &s_tReplayLock, &tWake);
+			continue;
+		}
+
+		sJob = s_asJob[0];
+		s_i32JobCnt --;
+		memmove(&s_asJob[0], &s_asJob[1], s_i32JobCnt * sizeof(struct replay_job));
+
+		replay_fifo_push(&sJob.session->out_done, sJob.out_index);
+		replay_fifo_push(&sJob.session->cap_done, sJob.cap_index);
+		if(write(sJob.session->fd, &u64One, sizeof(u64One)) != sizeof(u64One))
+			fprintf(stderr, "Replay unable signal job done \n");
+	}
+
+	pthread_mutex_unlock(&s_tReplayLock);
+	return NULL;
+}
+
+int vc8kbench_replay_load(
+	const char *szPath
+)
+{
+	pthread_condattr_t tCondAttr;
+	char achLine[128];
+	FILE *psFile;
+
+	pthread_once(&s_tLibcOnce, replay_libc_init);
+
+	psFile = fopen(szPath, "r");
+	if(psFile == NULL)
+		return -1;
+
+	if((fgets(achLine, sizeof(achLine), psFile) == NULL) ||
+	   (strncmp(achLine, VC8KBENCH_REPLAY_HEADER, strlen(VC8KBENCH_REPLAY_HEADER)) != 0)) {
+		fclose(psFile);
+		return -1;
+	}
+
+	pthread_mutex_lock(&s_tReplayLock);
+	while(fgets(achLine, sizeof(achLine), psFile) && (s_i32RecordCnt < REPLAY_MAX_RECORD)) {
+		unsigned int u32Width, u32Height;
+		unsigned long long u64Ns;
+
+		if(achLine[0] == '#')
+			continue;
+
+		if(sscanf(achLine, "%u %u %llu", &u32Width, &u32Height, &u64Ns) != 3)
+			continue;
+
+		s_asRecord[s_i32RecordCnt].w = u32Width;
+		s_asRecord[s_i32RecordCnt].h = u32Height;
+		s_asRecord[s_i32RecordCnt].ns = u64Ns;
+		s_i32RecordCnt ++;
+	}
+
+	if(!s_bReplay && (s_i32RecordCnt > 0)) {
+		pthread_condattr_init(&tCondAttr);
+		pthread_condattr_setclock(&tCondAttr, CLOCK_MONOTONIC);
+		pthread_cond_init(&s_tReplayCond, &tCondAttr);
+		pthread_condattr_destroy(&tCondAttr);
+
+		if(pthread_create(&s_tReplayThread, NULL, replay_thread, NULL) == 0) {
+			pthread_detach(s_tReplayThread);
+			s_bReplay = true;
+		}
+	}
+	pthread_mutex_unlock(&s_tReplayLock);
+
+	fclose(psFile);
+	return s_bReplay ? s_i32RecordCnt : -1;
+}
+
+static int replay_open(const char *szPath)
+{
+	int i;
+
+	//only one VC8000 node is emulated
+	if(strcmp(szPath, REPLAY_DEV_NODE) != 0) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	pthread_mutex_lock(&s_tReplayLock);
+	for(i = 0; i < REPLAY_MAX_SESSION; i ++) {
+		if(!s_asSession[i].used)
+			break;
+	}
+
+	if(i == REPLAY_MAX_SESSION) {
+		pthread_mutex_unlock(&s_tReplayLock);
+		errno = EBUSY;
+		return -1;
+	}
+
+	memset(&s_asSession[i], 0, sizeof(struct replay_session));
+	s_asSession[i].fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+	if(s_asSession[i].fd < 0) {
+		pthread_mutex_unlock(&s_tReplayLock);
+		return -1;
+	}
+
+	s_asSession[i].used = true;
+	pthread_mutex_unlock(&s_tReplayLock);
+
+	return s_asSession[i].fd;
+}
+
+static void replay_close(struct replay_session *psSession)
+{
+	replay_flush(psSession, true, true);
+	replay_free_bufs(psSession->out, &psSession->out_cnt);
+	replay_free_bufs(psSession->cap, &psSession->cap_cnt);
+	psSession->used = false;
+}
+
+static int replay_s_fmt(struct replay_session *psSession, struct v4l2_format *psFmt)
+{
+	struct v4l2_pix_format_mplane *psPix = &psFmt->fmt.pix_mp;
+
+	if(psFmt->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
+		if(psPix->plane_fmt[0].sizeimage == 0)
+			psPix->plane_fmt[0].sizeimage = REPLAY_DEF_OUT_SIZE;
+		psPix->num_planes = 1;
+		psSession->out_size = psPix->plane_fmt[0].sizeimage;
+		return 0;
+	}
+
+	if(psFmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	psSession->cap_w = psPix->width;
+	psSession->cap_h = psPix->height;
+	psSession->cap_fourcc = psPix->pixelformat;
+
+	switch(psPix->pixelformat) {
+	case V4L2_PIX_FMT_NV12:
+		psSession->cap_bpl = psPix->width;
+		psSession->cap_size = psPix->width * psPix->height * 3 / 2;
+		break;
+	case V4L2_PIX_FMT_NV24:
+		psSession->cap_bpl = psPix->width;
+		psSession->cap_size = psPix->width * psPix->height * 3;
+		break;
+	case V4L2_PIX_FMT_RGB565:
+	case V4L2_PIX_FMT_YUYV:
+		psSession->cap_bpl = psPix->width * 2;
+		psSession->cap_size = psSession->cap_bpl * psPix->height;
+		break;
+	default:
+		psSession->cap_bpl = psPix->width * 4;
+		psSession->cap_size = psSession->cap_bpl * psPix->height;
+		break;
+	}
+
+	psPix->num_planes = 1;
+	psPix->plane_fmt[0].bytesperline = psSession->cap_bpl;
+	psPix->plane_fmt[0].sizeimage = psSession->cap_size;
+	return 0;
+}
+
+static int replay_reqbufs(struct replay_session *psSession, struct v4l2_requestbuffers *psReq)
+{
+	struct replay_buf *psBuf;
+	uint32_t u32Size;
+	int *pi32Cnt;
+	int i;
+
+	if(psReq->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
+		psBuf = psSession->out;
+		pi32Cnt = &psSession->out_cnt;
+		u32Size = psSession->out_size;
+	}
+	else {
+		psBuf = psSession->cap;
+		pi32Cnt = &psSession->cap_cnt;
+		u32Size = psSession->cap_size;
+	}
+
+	if((psReq->memory != V4L2_MEMORY_MMAP) &&
+	   ((psReq->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) || (psReq->memory != V4L2_MEMORY_USERPTR))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	replay_flush(psSession, psReq->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE,
+		psReq->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+	replay_free_bufs(psBuf, pi32Cnt);
+
+	if(psReq->count > REPLAY_MAX_BUF)
+		psReq->count = REPLAY_MAX_BUF;
+
+	if(psReq->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+		psSession->cap_memory = psReq->memory;
+
+	for(i = 0; i < (int)psReq->count; i ++) {
+		psBuf[i].size = u32Size;
+		if(psReq->memory != V4L2_MEMORY_MMAP)
+			continue;
+
+		if(posix_memalign((void **)&psBuf[i].addr, 4096, u32Size) != 0) {
+			psReq->count = i;
+			break;
+		}
+		psBuf[i].owned = true;
+	}
+
+	*pi32Cnt = psReq->count;
+	return 0;
+}
+
+static int replay_querybuf(struct replay_session *psSession, struct v4l2_buffer *psBuf)
+{
+	bool bOutput = (psBuf->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE);
+	int i32Cnt = bOutput ? psSession->out_cnt : psSession->cap_cnt;
+
+	if((psBuf->index >= (uint32_t)i32Cnt) || (psBuf->m.planes == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	psBuf->length = 1;
+	if(bOutput) {
+		psBuf->m.planes[0].length = psSession->out[psBuf->index].size;
+		psBuf->m.planes[0].m.mem_offset = REPLAY_OUT_OFFSET(psBuf->index);
+	}
+	else {
+		psBuf->m.planes[0].length = psSession->cap[psBuf->index].size;
+		psBuf->m.planes[0].m.mem_offset = REPLAY_CAP_OFFSET(psBuf->index);
+	}
+
+	return 0;
+}
+
+static int replay_qbuf(struct replay_session *psSession, struct v4l2_buffer *psBuf)
+{
+	if(psBuf->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
+		if(psBuf->index >= (uint32_t)psSession->out_cnt) {
+			errno = EINVAL;
+			return -1;
+		}
+		replay_fifo_push(&psSession->out_queued, psBuf->index);
+	}
+	else {
+		if(psBuf->index >= (uint32_t)psSession->cap_cnt) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		if(psSession->cap_memory == V4L2_MEMORY_USERPTR) {
+			psSession->cap[psBuf->index].addr = (uint8_t *)psBuf->m.planes[0].m.userptr;
+			psSession->cap[psBuf->index].size = psBuf->m.planes[0].length;
+		}
+		replay_fifo_push(&psSession->cap_queued, psBuf->index);
+	}
+
+	replay_schedule(psSession);
+	return 0;
+}
+
+static int replay_dqbuf(struct replay_session *psSession, struct v4l2_buffer *psBuf)
+{
+	uint64_t u64Cnt;
+	int i32Index;
+
+	if(psBuf->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
+		i32Index = replay_fifo_pop(&psSession->out_done);
+	}
+	else {
+		i32Index = replay_fifo_pop(&psSession->cap_done);
+		if((i32Index >= 0) && (read(psSession->fd, &u64Cnt, sizeof(u64Cnt)) != sizeof(u64Cnt)))
+			fprintf(stderr, "Replay done count out of sync \n");
+	}
+
+	if(i32Index < 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	psBuf->index = i32Index;
+	psBuf->flags = V4L2_BUF_FLAG_DONE;
+	if(psBuf->m.planes) {
+		psBuf->m.planes[0].bytesused = (psBuf->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) ?
+			0 : psSession->cap_size;
+	}
+
+	return 0;
+}
+
+static int replay_ioctl(struct replay_session *psSession, unsigned long request, void *pvArg)
+{
+	struct v4l2_capability *psCap;
+
+	switch(request) {
+	case VIDIOC_QUERYCAP:
+		psCap = pvArg;
+		memset(psCap, 0, sizeof(struct v4l2_capability));
+		strcpy((char *)psCap->driver, "vc8000-replay");
+		strcpy((char *)psCap->card, "vc8kbench replay");
+		psCap->capabilities = V4L2_CAP_VIDEO_CAPTURE_MPLANE | V4L2_CAP_VIDEO_OUTPUT_MPLANE |
+			V4L2_CAP_STREAMING;
+		psCap->device_caps = psCap->capabilities;
+		return 0;
+	case VIDIOC_S_FMT:
+		return replay_s_fmt(psSession, pvArg);
+	case VIDIOC_REQBUFS:
+		return replay_reqbufs(psSession, pvArg);
+	case VIDIOC_QUERYBUF:
+		return replay_querybuf(psSession, pvArg);
+	case VIDIOC_QBUF:
+		return replay_qbuf(psSession, pvArg);
+	case VIDIOC_DQBUF:
+		return replay_dqbuf(psSession, pvArg);
+	case VIDIOC_STREAMON:
+		return 0;
+	case VIDIOC_STREAMOFF:
+		replay_flush(psSession, *(int *)pvArg == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE,
+			*(int *)pvArg == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE);
+		return 0;
+	default:
+		break;
+	}
+
+	//post-processor setup and other VC8000 private requests
+	if(_IOC_TYPE(request) == 'v')
+		return 0;
+
+	errno = ENOTTY;
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+// libc interposition
+
+int open(const char *file, int oflag, ...)
+{
+	mode_t tMode = 0;
+	va_list tArgs;
+
+	pthread_once(&s_tLibcOnce, replay_libc_init);
+
+	if(oflag & (O_CREAT | O_TMPFILE)) {
+		va_start(tArgs, oflag);
+		tMode = va_arg(tArgs, mode_t);
+		va_end(tArgs);
+	}
+
+	if(s_bReplay && (strncmp(file, REPLAY_DEV_PREFIX, strlen(REPLAY_DEV_PREFIX)) == 0))
+		return replay_open(file);
+
+	return s_pfnOpen(file, oflag, tMode);
+}
+
+int open64(const char *file, int oflag, ...)
+{
+	mode_t tMode = 0;
+	va_list tArgs;
+
+	if(oflag & (O_CREAT | O_TMPFILE)) {
+		va_start(tArgs, oflag);
+		tMode = va_arg(tArgs, mode_t);
+		va_end(tArgs);
+	}
+
+	return open(file, oflag | O_LARGEFILE, tMode);
+}
+
+int close(int fd)
+{
+	struct replay_session *psSession;
+
+	pthread_once(&s_tLibcOnce, replay_libc_init);
+
+	pthread_mutex_lock(&s_tReplayLock);
+	psSession = replay_find_session(fd);
+	if(psSession)
+		replay_close(psSession);
+	pthread_mutex_unlock(&s_tReplayLock);
+
+	return s_pfnClose(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	struct replay_session *psSession;
+	void *pvArg;
+	va_list tArgs;
+	int ret;
+
+	pthread_once(&s_tLibcOnce, replay_libc_init);
+
+	va_start(tArgs, request);
+	pvArg = va_arg(tArgs, void *);
+	va_end(tArgs);
+
+	pthread_mutex_lock(&s_tReplayLock);
+	psSession = replay_find_session(fd);
+	if(psSession) {
+		ret = replay_ioctl(psSession, request, pvArg);
+		pthread_mutex_unlock(&s_tReplayLock);
+		return ret;
+	}
+	pthread_mutex_unlock(&s_tReplayLock);
+
+	return s_pfnIoctl(fd, request, pvArg);
+}
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+	struct replay_session *psSession;
+	void *pvAddr = MAP_FAILED;
+	int i;
+
+	pthread_once(&s_tLibcOnce, replay_libc_init);
+
+	pthread_mutex_lock(&s_tReplayLock);
+	psSession = replay_find_session(fd);
+	if(psSession) {
+		for(i = 0; i < psSession->out_cnt; i ++) {
+			if(offset == REPLAY_OUT_OFFSET(i))
+				pvAddr = psSession->out[i].addr;
+		}
+
+		for(i = 0; i < psSession->cap_cnt; i ++) {
+			if(offset == REPLAY_CAP_OFFSET(i))
+				pvAddr = psSession->cap[i].addr;
+		}
+
+		pthread_mutex_unlock(&s_tReplayLock);
+		if(pvAddr == MAP_FAILED)
+			errno = EINVAL;
+		return pvAddr;
+	}
+	pthread_mutex_unlock(&s_tReplayLock);
+
+	return s_pfnMmap(addr, len, prot, flags, fd, offset);
+}
+
+void *mmap64(void *addr, size_t len, int prot, int flags, int fd, off64_t offset)
+{
+	return mmap(addr, len, prot, flags, fd, (off_t)offset);
+}
+
+int munmap(void *addr, size_t len)
+{
+	int i, j;
+
+	pthread_once(&s_tLibcOnce, replay_libc_init);
+
+	//stand-in buffers are freed with REQBUFS/close
+	if(s_bReplay) {
+		pthread_mutex_lock(&s_tReplayLock);
+		for(i = 0; i < REPLAY_MAX_SESSION; i ++) {
+			if(!s_asSession[i].used)
+				continue;
+
+			for(j = 0; j < REPLAY_MAX_BUF; j ++) {
+				if((s_asSession[i].out[j].owned && (s_asSession[i].out[j].addr == addr)) ||
+				   (s_asSession[i].cap[j].owned && (s_asSession[i].cap[j].addr == addr))) {
+					pthread_mutex_unlock(&s_tReplayLock);
+					return 0;
+				}
+			}
+		}
+		pthread_mutex_unlock(&s_tReplayLock);
+	}
+
+	return s_pfnMunmap(addr, len);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	short asEvents[REPLAY_MAX_POLL_FD];
+	bool abFake[REPLAY_MAX_POLL_FD];
+	bool bAnyFake = false;
+	nfds_t i;
+	int ret;
+
+	pthread_once(&s_tLibcOnce, replay_libc_init);
+
+	if(!s_bReplay || (nfds > REPLAY_MAX_POLL_FD))
+		return s_pfnPoll(fds, nfds, timeout);
+
+	//fake device is readable while jobs are done, which means capture and bitstream buffer
+	pthread_mutex_lock(&s_tReplayLock);
+	for(i = 0; i < nfds; i ++) {
+		abFake[i] = (replay_find_session(fds[i].fd) != NULL);
+		asEvents[i] = fds[i].events;
+		if(abFake[i]) {
+			fds[i].events = POLLIN;
+			bAnyFake = true;
+		}
+	}
+	pthread_mutex_unlock(&s_tReplayLock);
+
+	ret = s_pfnPoll(fds, nfds, timeout);
+
+	if(bAnyFake) {
+		for(i = 0; i < nfds; i ++) {
+			if(!abFake[i])
+				continue;
+
+			fds[i].events = asEvents[i];
+			if(fds[i].revents & POLLIN)
+				fds[i].revents = (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM) & asEvents[i];
+		}
+	}
+
+	return ret;
+}
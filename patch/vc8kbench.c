@@ -0,0 +1,831 @@
+/**
+ * @file vc8kbench.c: VC8000 JPEG decode benchmark
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Sweeps image size, scale factor, output format, thread count, source type
+ * (memory/file) and HW/SW dispatch. For each combination it reports images
+ * per second and p50/p99 of the whole decode and of each stage measured by
+ * jpeg_get_decode_stats(), as CSV or JSON.
+ *
+ * -record writes the hardware decode time of each image. -replay runs the
+ * benchmark against a stand-in for /dev/video0 which completes jobs after the
+ * recorded times (vc8kbench-replay.c), so dispatch, scheduler and conversion
+ * changes can be compared on hosts without VC8000. -backend emu decodes
+ * with the in-process emulator (vc8000_emu.c) instead of V4L2.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "jpeglib.h"
+#include "jpeglib_ext.h"
+#include "vc8kbench.h"
+
+#define BENCH_MAX_LIST			16
+#define BENCH_ROWS_PER_READ		16
+
+/* Synthetic images when no file is given */
+#define BENCH_DEF_SIZES			"640x480,1280x720,1920x1080"
+
+typedef enum {
+	eBENCH_STAGE_TOTAL = 0,
+	eBENCH_STAGE_OPEN,
+	eBENCH_STAGE_SETUP,
+	eBENCH_STAGE_FILL,
+	eBENCH_STAGE_HW_DECODE,
+	eBENCH_STAGE_CONVERT,
+	eBENCH_STAGE_SW_DECODE,
+	eBENCH_STAGE_TEARDOWN,
+	eBENCH_STAGE_CNT,
+} E_BENCH_STAGE;
+
+static const char *s_aszStageName[eBENCH_STAGE_CNT] = {
+	"total", "open", "setup", "fill", "hw_decode", "convert", "sw_decode", "teardown"
+};
+
+typedef enum {
+	eBENCH_DISPATCH_AUTO = 0,
+	eBENCH_DISPATCH_HW,
+	eBENCH_DISPATCH_SW,
+} E_BENCH_DISPATCH;
+
+static const char *s_aszDispatchName[] = { "auto", "hw", "sw" };
+
+struct bench_format {
+	const char *name;
+	J_COLOR_SPACE color_space;
+	int pixel_size;
+};
+
+static const struct bench_format s_asFormat[] = {
+	{ "rgb", JCS_RGB, 3 },
+	{ "bgr", JCS_EXT_BGR, 3 },
+	{ "rgbx", JCS_EXT_RGBX, 4 },
+	{ "bgrx", JCS_EXT_BGRX, 4 },
+	{ "xrgb", JCS_EXT_XRGB, 4 },
+	{ "xbgr", JCS_EXT_XBGR, 4 },
+	{ "rgba", JCS_EXT_RGBA, 4 },
+	{ "bgra", JCS_EXT_BGRA, 4 },
+	{ "argb", JCS_EXT_ARGB, 4 },
+	{ "abgr", JCS_EXT_ABGR, 4 },
+	{ "rgb565", JCS_RGB565, 2 },
+	{ "gray", JCS_GRAYSCALE, 1 },
+};
+
+#define BENCH_NUM_FORMAT	(int)(sizeof(s_asFormat) / sizeof(s_asFormat[0]))
+
+struct bench_image {
+	char name[64];
+	char path[256];				/* source file of -sources file */
+	unsigned char *jpeg;
+	unsigned long jpeg_size;
+	uint32_t width;
+	uint32_t height;
+};
+
+/* One benchmark point */
+struct bench_config {
+	struct bench_image *image;
+	uint32_t scale_num;
+	uint32_t scale_denom;
+	const struct bench_format *format;
+	bool file_source;
+	E_BENCH_DISPATCH dispatch;
+	int threads;
+	int iterations;
+	int warmup;
+};
+
+/* Result of one decoded image */
+struct bench_sample {
+	int status;
+	int engine;
+	uint32_t output_width;
+	uint32_t output_height;
+	uint64_t ns[eBENCH_STAGE_CNT];
+};
+
+struct bench_worker {
+	pthread_t thread;
+	struct bench_config *config;
+	struct bench_sample *samples;	/* config->iterations samples */
+	unsigned char *outbuf;
+	size_t outbuf_size;
+	uint64_t start_ns;				/* measured decodes, after warmup */
+	uint64_t end_ns;
+};
+
+struct bench_error_mgr {
+	struct jpeg_error_mgr pub;
+	jmp_buf setjmp_buffer;
+};
+
+static uint64_t bench_time_ns(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000ULL + tNow.tv_nsec;
+}
+
+static void bench_error_exit(j_common_ptr cinfo)
+{
+	struct bench_error_mgr *psErr = (struct bench_error_mgr *)cinfo->err;
+
+	longjmp(psErr->setjmp_buffer, 1);
+}
+
+static void bench_output_message(j_common_ptr cinfo)
+{
+}
+
+//Decode one image of config, return 0 on success
+static int bench_decode(
+	struct bench_worker *psWorker,
+	struct bench_sample *psSample
+)
+{
+	struct bench_config *psConfig = psWorker->config;
+	struct jpeg_decompress_struct sInfo;
+	struct bench_error_mgr sErr;
+	jpeg_decode_stats sStats;
+	JSAMPROW apRows[BENCH_ROWS_PER_READ];
+	FILE * volatile psFile = NULL;
+	uint64_t u64StartNs;
+	uint32_t u32RowBytes;
+	int i;
+
+	memset(psSample, 0, sizeof(struct bench_sample));
+	psSample->status = -1;
+
+	sInfo.err = jpeg_std_error(&sErr.pub);
+	sErr.pub.error_exit = bench_error_exit;
+	sErr.pub.output_message = bench_output_message;
+
+	u64StartNs = bench_time_ns();
+
+	if(setjmp(sErr.setjmp_buffer)) {
+		jpeg_destroy_decompress(&sInfo);
+		if(psFile)
+			fclose(psFile);
+		return -1;
+	}
+
+	jpeg_CreateDecompress_Ext(&sInfo, JPEG_LIB_VERSION, sizeof(struct jpeg_decompress_struct),
+		(psConfig->dispatch != eBENCH_DISPATCH_SW) ? TRUE : FALSE);
+
+	if(psConfig->file_source) {
+		psFile = fopen(psConfig->image->path, "rb");
+		if(psFile == NULL) {
+			jpeg_destroy_decompress(&sInfo);
+			return -1;
+		}
+		jpeg_stdio_src(&sInfo, psFile);
+	}
+	else {
+		jpeg_mem_src(&sInfo, psConfig->image->jpeg, psConfig->image->jpeg_size);
+	}
+
+	jpeg_read_header(&sInfo, TRUE);
+	sInfo.out_color_space = psConfig->format->color_space;
+	sInfo.scale_num = psConfig->scale_num;
+	sInfo.scale_denom = psConfig->scale_denom;
+
+	jpeg_start_decompress(&sInfo);
+
+	u32RowBytes = sInfo.output_width * psConfig->format->pixel_size;
+	if(psWorker->outbuf_size < (size_t)u32RowBytes * sInfo.output_height) {
+		free(psWorker->outbuf);
+		psWorker->outbuf_size = (size_t)u32RowBytes * sInfo.output_height;
+		psWorker->outbuf = malloc(psWorker->outbuf_size);
+		if(psWorker->outbuf == NULL) {
+			psWorker->outbuf_size = 0;
+			longjmp(sErr.setjmp_buffer, 1);
+		}
+	}
+
+	while(sInfo.output_scanline < sInfo.output_height) {
+		for(i = 0; i < BENCH_ROWS_PER_READ; i ++)
+			apRows[i] = psWorker->outbuf + (size_t)(sInfo.output_scanline + i) * u32RowBytes;
+
+		jpeg_read_scanlines(&sInfo, apRows,
+			(sInfo.output_height - sInfo.output_scanline < BENCH_ROWS_PER_READ) ?
+			sInfo.output_height - sInfo.output_scanline : BENCH_ROWS_PER_READ);
+	}
+
+	jpeg_finish_decompress(&sInfo);
+	jpeg_get_decode_stats(&sInfo, &sStats);
+
+	psSample->output_width = sInfo.output_width;
+	psSample->output_height = sInfo.output_height;
+	jpeg_destroy_decompress(&sInfo);
+
+	if(psFile)
+		fclose(psFile);
+
+	psSample->ns[eBENCH_STAGE_TOTAL] = bench_time_ns() - u64StartNs;
+	psSample->ns[eBENCH_STAGE_OPEN] = sStats.open_ns;
+	psSample->ns[eBENCH_STAGE_SETUP] = sStats.setup_ns;
+	psSample->ns[eBENCH_STAGE_FILL] = sStats.fill_ns;
+	psSample->ns[eBENCH_STAGE_HW_DECODE] = sStats.hw_decode_ns;
+	psSample->ns[eBENCH_STAGE_CONVERT] = sStats.convert_ns;
+	psSample->ns[eBENCH_STAGE_SW_DECODE] = sStats.sw_decode_ns;
+	psSample->ns[eBENCH_STAGE_TEARDOWN] = sStats.teardown_ns;
+	psSample->engine = sStats.engine;
+	psSample->status = 0;
+	return 0;
+}
+
+static void *bench_worker_thread(void *arg)
+{
+	struct bench_worker *psWorker = (struct bench_worker *)arg;
+	struct bench_sample sWarmup;
+	int i;
+
+	for(i = 0; i < psWorker->config->warmup; i ++)
+		bench_decode(psWorker, &sWarmup);
+
+	psWorker->start_ns = bench_time_ns();
+	for(i = 0; i < psWorker->config->iterations; i ++)
+		bench_decode(psWorker, &psWorker->samples[i]);
+	psWorker->end_ns = bench_time_ns();
+
+	return NULL;
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+	uint64_t u64A = *(const uint64_t *)a;
+	uint64_t u64B = *(const uint64_t *)b;
+
+	return (u64A > u64B) - (u64A < u64B);
+}
+
+//Nearest-rank percentile of sorted values
+static uint64_t bench_percentile(const uint64_t *pu64Sorted, int i32Cnt, int i32Pct)
+{
+	int i32Rank;
+
+	if(i32Cnt == 0)
+		return 0;
+
+	i32Rank = (i32Cnt * i32Pct + 99) / 100;
+	if(i32Rank < 1)
+		i32Rank = 1;
+
+	return pu64Sorted[i32Rank - 1];
+}
+
+struct bench_result {
+	int images;
+	int failed;
+	int hw_images;
+	int sw_images;
+	double elapsed;
+	uint64_t p50[eBENCH_STAGE_CNT];
+	uint64_t p99[eBENCH_STAGE_CNT];
+};
+
+static void bench_summarize(
+	struct bench_sample *psSamples,
+	int i32Cnt,
+	struct bench_result *psResult
+)
+{
+	uint64_t *pu64Values = malloc(sizeof(uint64_t) * (i32Cnt ? i32Cnt : 1));
+	int i, s, n;
+
+	for(i = 0; i < i32Cnt; i ++) {
+		if(psSamples[i].status != 0)
+			psResult->failed ++;
+		else if(psSamples[i].engine == JPEG_HW_ENGINE_HW)
+			psResult->hw_images ++;
+		else
+			psResult->sw_images ++;
+	}
+
+	psResult->images = i32Cnt - psResult->failed;
+
+	for(s = 0; s < eBENCH_STAGE_CNT; s ++) {
+		for(i = 0, n = 0; i < i32Cnt; i ++) {
+			if(psSamples[i].status == 0)
+				pu64Values[n ++] = psSamples[i].ns[s];
+		}
+
+		qsort(pu64Values, n, sizeof(uint64_t), bench_compare_u64);
+		psResult->p50[s] = bench_percentile(pu64Values, n, 50);
+		psResult->p99[s] = bench_percentile(pu64Values, n, 99);
+	}
+
+	free(pu64Values);
+}
+
+static void bench_print_csv_header(FILE *psOut)
+{
+	int s;
+
+	fprintf(psOut, "image,width,height,scale,format,source,dispatch,threads,images,failed,hw_images,sw_images,images_per_sec");
+	for(s = 0; s < eBENCH_STAGE_CNT; s ++)
+		fprintf(psOut, ",%s_p50_us,%s_p99_us", s_aszStageName[s], s_aszStageName[s]);
+	fprintf(psOut, "\n");
+}
+
+static void bench_print_result(
+	FILE *psOut,
+	bool bJson,
+	bool bFirst,
+	struct bench_config *psConfig,
+	struct bench_result *psResult
+)
+{
+	double dRate = (psResult->elapsed > 0) ? psResult->images / psResult->elapsed : 0;
+	int s;
+
+	if(!bJson) {
+		fprintf(psOut, "%s,%u,%u,%u/%u,%s,%s,%s,%d,%d,%d,%d,%d,%.2f",
+			psConfig->image->name, psConfig->image->width, psConfig->image->height,
+			psConfig->scale_num, psConfig->scale_denom, psConfig->format->name,
+			psConfig->file_source ? "file" : "mem", s_aszDispatchName[psConfig->dispatch],
+			psConfig->threads, psResult->images, psResult->failed, psResult->hw_images,
+			psResult->sw_images, dRate);
+		for(s = 0; s < eBENCH_STAGE_CNT; s ++)
+			fprintf(psOut, ",%.1f,%.1f", psResult->p50[s] / 1000.0, psResult->p99[s] / 1000.0);
+		fprintf(psOut, "\n");
+		return;
+	}
+
+	fprintf(psOut, "%s  {\"image\": \"%s\", \"width\": %u, \"height\": %u, \"scale\": \"%u/%u\", "
+		"\"format\": \"%s\", \"source\": \"%s\", \"dispatch\": \"%s\", \"threads\": %d, "
+		"\"images\": %d, \"failed\": %d, \"hw_images\": %d, \"sw_images\": %d, \"images_per_sec\": %.2f, "
+		"\"stages\": {",
+		bFirst ? "" : ",\n",
+		psConfig->image->name, psConfig->image->width, psConfig->image->height,
+		psConfig->scale_num, psConfig->scale_denom, psConfig->format->name,
+		psConfig->file_source ? "file" : "mem", s_aszDispatchName[psConfig->dispatch],
+		psConfig->threads, psResult->images, psResult->failed, psResult->hw_images,
+		psResult->sw_images, dRate);
+	for(s = 0; s < eBENCH_STAGE_CNT; s ++)
+		fprintf(psOut, "%s\"%s\": {\"p50_us\": %.1f, \"p99_us\": %.1f}", s ? ", " : "",
+			s_aszStageName[s], psResult->p50[s] / 1000.0, psResult->p99[s] / 1000.0);
+	fprintf(psOut, "}}");
+}
+
+//Append hardware decode time of each image for -replay
+static void bench_record(
+	FILE *psRecord,
+	struct bench_sample *psSamples,
+	int i32Cnt
+)
+{
+	int i;
+
+	for(i = 0; i < i32Cnt; i ++) {
+		if((psSamples[i].status == 0) && (psSamples[i].engine == JPEG_HW_ENGINE_HW))
+			fprintf(psRecord, "%u %u %llu\n", psSamples[i].output_width, psSamples[i].output_height,
+				(unsigned long long)psSamples[i].ns[eBENCH_STAGE_HW_DECODE]);
+	}
+}
+
+static int bench_run(
+	struct bench_config *psConfig,
+	struct bench_result *psResult,
+	FILE *psRecord
+)
+{
+	struct bench_worker *psWorkers;
+	struct bench_sample *psSamples;
+	int i32Cnt = psConfig->threads * psConfig->iterations;
+	uint64_t u64StartNs = UINT64_MAX;
+	uint64_t u64EndNs = 0;
+	int i;
+
+	memset(psResult, 0, sizeof(struct bench_result));
+
+	psWorkers = calloc(psConfig->threads, sizeof(struct bench_worker));
+	psSamples = calloc(i32Cnt, sizeof(struct bench_sample));
+	if((psWorkers == NULL) || (psSamples == NULL)) {
+		free(psWorkers);
+		free(psSamples);
+		return -1;
+	}
+
+	switch(psConfig->dispatch) {
+	case eBENCH_DISPATCH_HW:
+		jpeg_hw_set_dispatch(JPEG_HW_DISPATCH_HW);
+		break;
+	default:
+		jpeg_hw_set_dispatch(JPEG_HW_DISPATCH_COST_MODEL);
+		break;
+	}
+
+	for(i = 0; i < psConfig->threads; i ++) {
+		psWorkers[i].config = psConfig;
+		psWorkers[i].samples = &psSamples[i * psConfig->iterations];
+		if(pthread_create(&psWorkers[i].thread, NULL, bench_worker_thread, &psWorkers[i]) != 0) {
+			fprintf(stderr, "Unable create worker thread \n");
+			psConfig->threads = i;
+			break;
+		}
+	}
+
+	for(i = 0; i < psConfig->threads; i ++) {
+		pthread_join(psWorkers[i].thread, NULL);
+		free(psWorkers[i].outbuf);
+
+		if(psWorkers[i].start_ns < u64StartNs)
+			u64StartNs = psWorkers[i].start_ns;
+		if(psWorkers[i].end_ns > u64EndNs)
+			u64EndNs = psWorkers[i].end_ns;
+	}
+
+	if(u64EndNs > u64StartNs)
+		psResult->elapsed = (u64EndNs - u64StartNs) / 1e9;
+
+	bench_summarize(psSamples, psConfig->threads * psConfig->iterations, psResult);
+
+	if(psRecord)
+		bench_record(psRecord, psSamples, psConfig->threads * psConfig->iterations);
+
+	free(psWorkers);
+	free(psSamples);
+	return 0;
+}
+
+//Encode a gradient test image
+static int bench_synth_image(
+	struct bench_image *psImage,
+	uint32_t u32Width,
+	uint32_t u32Height
+)
+{
+	struct jpeg_compress_struct sInfo;
+	struct jpeg_error_mgr sErr;
+	unsigned char *pu8Row;
+	unsigned char *pu8Jpeg = NULL;
+	unsigned long u32JpegSize = 0;
+	uint32_t x;
+
+	pu8Row = malloc(u32Width * 3);
+	if(pu8Row == NULL)
+		return -1;
+
+	sInfo.err = jpeg_std_error(&sErr);
+	jpeg_create_compress(&sInfo);
+	jpeg_mem_dest(&sInfo, &pu8Jpeg, &u32JpegSize);
+
+	sInfo.image_width = u32Width;
+	sInfo.image_height = u32Height;
+	sInfo.input_components = 3;
+	sInfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&sInfo);
+	jpeg_set_quality(&sInfo, 90, TRUE);
+	jpeg_start_compress(&sInfo, TRUE);
+
+	while(sInfo.next_scanline < sInfo.image_height) {
+		for(x = 0; x < u32Width; x ++) {
+			pu8Row[x * 3] = x * 255 / u32Width;
+			pu8Row[x * 3 + 1] = sInfo.next_scanline * 255 / u32Height;
+			pu8Row[x * 3 + 2] = (x ^ sInfo.next_scanline) & 0xff;
+		}
+		jpeg_write_scanlines(&sInfo, &pu8Row, 1);
+	}
+
+	jpeg_finish_compress(&sInfo);
+	jpeg_destroy_compress(&sInfo);
+	free(pu8Row);
+
+	snprintf(psImage->name, sizeof(psImage->name), "synth_%ux%u", u32Width, u32Height);
+	psImage->jpeg = pu8Jpeg;
+	psImage->jpeg_size = u32JpegSize;
+	psImage->width = u32Width;
+	psImage->height = u32Height;
+	return 0;
+}
+
+static int bench_load_image(
+	struct bench_image *psImage,
+	const char *szPath
+)
+{
+	struct jpeg_decompress_struct sInfo;
+	struct jpeg_error_mgr sErr;
+	const char *szName = strrchr(szPath, '/');
+	FILE *psFile;
+	long i32Size;
+
+	psFile = fopen(szPath, "rb");
+	if(psFile == NULL)
+		return -1;
+
+	fseek(psFile, 0, SEEK_END);
+	i32Size = ftell(psFile);
+	fseek(psFile, 0, SEEK_SET);
+
+	psImage->jpeg = malloc(i32Size > 0 ? i32Size : 1);
+	if((psImage->jpeg == NULL) || (i32Size <= 0) ||
+	   (fread(psImage->jpeg, 1, i32Size, psFile) != (size_t)i32Size)) {
+		fclose(psFile);
+		return -1;
+	}
+	fclose(psFile);
+
+	psImage->jpeg_size = i32Size;
+	snprintf(psImage->name, sizeof(psImage->name), "%s", szName ? szName + 1 : szPath);
+	snprintf(psImage->path, sizeof(psImage->path), "%s", szPath);
+
+	//header only, keep hardware out of it
+	sInfo.err = jpeg_std_error(&sErr);
+	jpeg_CreateDecompress_Ext(&sInfo, JPEG_LIB_VERSION, sizeof(struct jpeg_decompress_struct), FALSE);
+	jpeg_mem_src(&sInfo, psImage->jpeg, psImage->jpeg_size);
+	jpeg_read_header(&sInfo, TRUE);
+	psImage->width = sInfo.image_width;
+	psImage->height = sInfo.image_height;
+	jpeg_destroy_decompress(&sInfo);
+	return 0;
+}
+
+//Write image to temporary file for -sources file
+static int bench_image_to_file(
+	struct bench_image *psImage
+)
+{
+	FILE *psFile;
+
+	if(psImage->path[0])
+		return 0;
+
+	snprintf(psImage->path, sizeof(psImage->path), "/tmp/vc8kbench_%d_%s.jpg", (int)getpid(), psImage->name);
+	psFile = fopen(psImage->path, "wb");
+	if(psFile == NULL)
+		return -1;
+
+	if(fwrite(psImage->jpeg, 1, psImage->jpeg_size, psFile) != psImage->jpeg_size) {
+		fclose(psFile);
+		return -1;
+	}
+
+	return fclose(psFile);
+}
+
+//Split comma separated list in place, return number of items
+static int bench_split(char *szList, char *apszItems[BENCH_MAX_LIST])
+{
+	int i32Cnt = 0;
+	char *pSave = NULL;
+	char *szItem;
+
+	for(szItem = strtok_r(szList, ",", &pSave); szItem && (i32Cnt < BENCH_MAX_LIST);
+		szItem = strtok_r(NULL, ",", &pSave))
+		apszItems[i32Cnt ++] = szItem;
+
+	return i32Cnt;
+}
+
+static void bench_usage(void)
+{
+	fprintf(stderr,
+		"vc8kbench [options] [jpeg file ...]\n"
+		"  -sizes WxH,...       synthetic images when no file given (default " BENCH_DEF_SIZES ")\n"
+		"  -scales N/D,...      scale factors (default 1/1)\n"
+		"  -formats F,...       rgb bgr rgbx bgrx xrgb xbgr rgba bgra argb abgr rgb565 gray (default bgra)\n"
+		"  -threads N,...       decode threads (default 1)\n"
+		"  -sources S,...       mem, file (default mem)\n"
+		"  -dispatch D,...      auto (cost model), hw (hardware only), sw (software only) (default auto)\n"
+		"  -iter N              measured decodes per thread (default 20)\n"
+		"  -warmup N            unmeasured decodes per thread (default 2)\n"
+		"  -json                JSON output instead of CSV\n"
+		"  -o file              output file (default stdout)\n"
+		"  -record file         write hardware decode times for -replay\n"
+		"  -replay file         emulate /dev/video0 with decode times written by -record\n"
+		"  -backend name        decoder backend v4l2 or emu (default v4l2)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	char achSizes[] = BENCH_DEF_SIZES;
+	char achScales[] = "1/1";
+	char achFormats[] = "bgra";
+	char achThreads[] = "1";
+	char achSources[] = "mem";
+	char achDispatch[] = "auto";
+	char *szSizes = achSizes, *szScales = achScales, *szFormats = achFormats;
+	char *szThreads = achThreads, *szSources = achSources, *szDispatch = achDispatch;
+	char *apszSizes[BENCH_MAX_LIST], *apszScales[BENCH_MAX_LIST], *apszFormats[BENCH_MAX_LIST];
+	char *apszThreads[BENCH_MAX_LIST], *apszSources[BENCH_MAX_LIST], *apszDispatch[BENCH_MAX_LIST];
+	int i32Sizes, i32Scales, i32Formats, i32Threads, i32Sources, i32Dispatch;
+	const char *szOutPath = NULL, *szRecordPath = NULL, *szReplayPath = NULL;
+	const char *szBackend = NULL;
+	struct bench_image *psImages;
+	char **apszFiles;
+	int i32Files = 0;
+	int i32Images = 0;
+	int i32Iterations = 20;
+	int i32Warmup = 2;
+	bool bJson = false;
+	bool bFirst = true;
+	FILE *psOut = stdout;
+	FILE *psRecord = NULL;
+	int i, a, b, c, d, e, f;
+
+	apszFiles = calloc(argc, sizeof(char *));
+	if(apszFiles == NULL)
+		return -3;
+
+	for(i = 1; i < argc; i ++) {
+		if(argv[i][0] != '-') {
+			apszFiles[i32Files ++] = argv[i];
+			continue;
+		}
+
+		if(strcmp(argv[i], "-json") == 0) {
+			bJson = true;
+			continue;
+		}
+
+		if(i + 1 >= argc) {
+			bench_usage();
+			return -1;
+		}
+
+		if(strcmp(argv[i], "-sizes") == 0)
+			szSizes = argv[++ i];
+		else if(strcmp(argv[i], "-scales") == 0)
+			szScales = argv[++ i];
+		else if(strcmp(argv[i], "-formats") == 0)
+			szFormats = argv[++ i];
+		else if(strcmp(argv[i], "-threads") == 0)
+			szThreads = argv[++ i];
+		else if(strcmp(argv[i], "-sources") == 0)
+			szSources = argv[++ i];
+		else if(strcmp(argv[i], "-dispatch") == 0)
+			szDispatch = argv[++ i];
+		else if(strcmp(argv[i], "-iter") == 0)
+			i32Iterations = atoi(argv[++ i]);
+		else if(strcmp(argv[i], "-warmup") == 0)
+			i32Warmup = atoi(argv[++ i]);
+		else if(strcmp(argv[i], "-o") == 0)
+			szOutPath = argv[++ i];
+		else if(strcmp(argv[i], "-record") == 0)
+			szRecordPath = argv[++ i];
+		else if(strcmp(argv[i], "-replay") == 0)
+			szReplayPath = argv[++ i];
+		else if(strcmp(argv[i], "-backend") == 0)
+			szBackend = argv[++ i];
+		else {
+			bench_usage();
+			return -1;
+		}
+	}
+
+	if(i32Iterations <= 0) {
+		bench_usage();
+		return -1;
+	}
+
+	if(szBackend && (jpeg_hw_set_backend(szBackend) != 0)) {
+		fprintf(stderr, "Unknown backend %s \n", szBackend);
+		return -1;
+	}
+
+	//stand-in device must be in place before library probes /dev/video*
+	if(szReplayPath && (vc8kbench_replay_load(szReplayPath) < 0)) {
+		fprintf(stderr, "Unable load replay file %s \n", szReplayPath);
+		return -2;
+	}
+
+	psImages = calloc(i32Files + BENCH_MAX_LIST, sizeof(struct bench_image));
+	if(psImages == NULL)
+		return -3;
+
+	for(i = 0; i < i32Files; i ++) {
+		if(bench_load_image(&psImages[i32Images], apszFiles[i]) != 0) {
+			fprintf(stderr, "Unable load jpeg file %s \n", apszFiles[i]);
+			continue;
+		}
+		i32Images ++;
+	}
+
+	if(i32Images == 0) {
+		i32Sizes = bench_split(szSizes, apszSizes);
+		for(i = 0; i < i32Sizes; i ++) {
+			unsigned int u32Width, u32Height;
+
+			if((sscanf(apszSizes[i], "%ux%u", &u32Width, &u32Height) != 2) ||
+			   (u32Width == 0) || (u32Height == 0) ||
+			   (bench_synth_image(&psImages[i32Images], u32Width, u32Height) != 0)) {
+				fprintf(stderr, "Invalid size %s \n", apszSizes[i]);
+				continue;
+			}
+			i32Images ++;
+		}
+	}
+
+	i32Scales = bench_split(szScales, apszScales);
+	i32Formats = bench_split(szFormats, apszFormats);
+	i32Threads = bench_split(szThreads, apszThreads);
+	i32Sources = bench_split(szSources, apszSources);
+	i32Dispatch = bench_split(szDispatch, apszDispatch);
+
+	if(szOutPath) {
+		psOut = fopen(szOutPath, "w");
+		if(psOut == NULL) {
+			fprintf(stderr, "Unable open output file %s \n", szOutPath);
+			return -4;
+		}
+	}
+
+	if(szRecordPath) {
+		psRecord = fopen(szRecordPath, "w");
+		if(psRecord == NULL) {
+			fprintf(stderr, "Unable open record file %s \n", szRecordPath);
+			return -5;
+		}
+		fprintf(psRecord, "%s\n", VC8KBENCH_REPLAY_HEADER);
+		fprintf(psRecord, "# output_width output_height hw_decode_ns\n");
+	}
+
+	if(bJson)
+		fprintf(psOut, "[\n");
+	else
+		bench_print_csv_header(psOut);
+
+	for(a = 0; a < i32Images; a ++)
+	for(b = 0; b < i32Scales; b ++)
+	for(c = 0; c < i32Formats; c ++)
+	for(d = 0; d < i32Sources; d ++)
+	for(e = 0; e < i32Dispatch; e ++)
+	for(f = 0; f < i32Threads; f ++) {
+		struct bench_config sConfig;
+		struct bench_result sResult;
+		unsigned int u32Num, u32Denom;
+
+		memset(&sConfig, 0, sizeof(sConfig));
+		sConfig.image = &psImages[a];
+		sConfig.iterations = i32Iterations;
+		sConfig.warmup = i32Warmup;
+		sConfig.threads = atoi(apszThreads[f]);
+		sConfig.file_source = (strcmp(apszSources[d], "file") == 0);
+
+		if((sscanf(apszScales[b], "%u/%u", &u32Num, &u32Denom) != 2) || (u32Num == 0) || (u32Denom == 0)) {
+			fprintf(stderr, "Invalid scale %s \n", apszScales[b]);
+			continue;
+		}
+		sConfig.scale_num = u32Num;
+		sConfig.scale_denom = u32Denom;
+
+		for(i = 0; i < BENCH_NUM_FORMAT; i ++) {
+			if(strcmp(apszFormats[c], s_asFormat[i].name) == 0)
+				sConfig.format = &s_asFormat[i];
+		}
+
+		for(i = 0; i < (int)(sizeof(s_aszDispatchName) / sizeof(s_aszDispatchName[0])); i ++) {
+			if(strcmp(apszDispatch[e], s_aszDispatchName[i]) == 0)
+				sConfig.dispatch = (E_BENCH_DISPATCH)i;
+		}
+
+		if((sConfig.format == NULL) || (sConfig.threads <= 0) ||
+		   (strcmp(apszDispatch[e], s_aszDispatchName[sConfig.dispatch]) != 0)) {
+			fprintf(stderr, "Invalid format/threads/dispatch %s/%s/%s \n", apszFormats[c], apszThreads[f], apszDispatch[e]);
+			continue;
+		}
+
+		if(sConfig.file_source && (bench_image_to_file(sConfig.image) != 0)) {
+			fprintf(stderr, "Unable write %s \n", sConfig.image->path);
+			continue;
+		}
+
+		if(bench_run(&sConfig, &sResult, psRecord) != 0)
+			continue;
+
+		bench_print_result(psOut, bJson, bFirst, &sConfig, &sResult);
+		bFirst = false;
+		fflush(psOut);
+	}
+
+	if(bJson)
+		fprintf(psOut, "\n]\n");
+
+	if(psRecord)
+		fclose(psRecord);
+	if(psOut != stdout)
+		fclose(psOut);
+
+	for(i = 0; i < i32Images; i ++) {
+		//remove temporary file of synthetic image
+		if(psImages[i].path[0] && (strncmp(psImages[i].name, "synth_", 6) == 0))
+			unlink(psImages[i].path);
+		free(psImages[i].jpeg);
+	}
+	free(psImages);
+	free(apszFiles);
+
+	return 0;
+}
@@ -0,0 +1,18 @@
+/**
+ * @file vc8kbench.h VC8000 JPEG decode benchmark
+ *
+ * Copyright (C) 2021 nuvoton
+ */
+
+#ifndef __VC8KBENCH_H__
+#define __VC8KBENCH_H__
+
+/* First line of file written by vc8kbench -record */
+#define VC8KBENCH_REPLAY_HEADER		"# vc8kbench replay v1"
+
+//Emulate /dev/video0 with hardware decode times of record file, return number of records or -1
+int vc8kbench_replay_load(
+	const char *szPath
+);
+
+#endif
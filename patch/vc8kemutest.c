@@ -0,0 +1,258 @@
+/**
+ * @file vc8kemutest.c: VC8000 emulator raw data test
+ *
+ * Copyright (C) 2021 nuvoton
+ *
+ * Encodes synthetic images of every subsampling read as raw data by hardware
+ * (4:2:0, 4:2:2, 4:4:4 and grayscale) and reads them with jpeg_read_raw_data()
+ * through the emulator backend (vc8000_emu.c) and through the software
+ * decoder. The component planes must be identical, so the capture layouts of
+ * the emulator and the raw data readers agree on plane and byte order. Image
+ * sizes are multiples of 16, the emulator output is then not scaled.
+ * Return 0 if all images pass.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "jpeglib.h"
+#include "jpeglib_ext.h"
+
+#define TEST_MAX_COMPS		3
+#define TEST_MAX_ROWS		(2 * DCTSIZE)	/* rows of component per iMCU row */
+
+struct emutest_case {
+	const char *name;
+	int components;
+	int h_samp;		/* luma sampling factors, chroma is 1x1 */
+	int v_samp;
+};
+
+static const struct emutest_case s_asCase[] = {
+	{"420", 3, 2, 2},
+	{"422", 3, 2, 1},
+	{"444", 3, 1, 1},
+	{"gray", 1, 1, 1},
+};
+
+static const uint32_t s_au32Size[][2] = {
+	{144, 112},
+	{320, 240},
+};
+
+/* Component planes of raw data output */
+struct emutest_planes {
+	int comps;
+	unsigned char *data[TEST_MAX_COMPS];
+	uint32_t stride[TEST_MAX_COMPS];	/* padded to whole blocks */
+	uint32_t width[TEST_MAX_COMPS];		/* samples compared */
+	uint32_t height[TEST_MAX_COMPS];
+};
+
+//Encode pattern with different Cb and Cr, return 0 on success
+static int emutest_encode(
+	const struct emutest_case *psCase,
+	uint32_t u32Width,
+	uint32_t u32Height,
+	unsigned char **ppu8Jpeg,
+	unsigned long *pu32JpegSize
+)
+{
+	struct jpeg_compress_struct sInfo;
+	struct jpeg_error_mgr sErr;
+	unsigned char *pu8Row;
+	uint32_t x;
+
+	pu8Row = malloc(u32Width * 3);
+	if(pu8Row == NULL)
+		return -1;
+
+	*ppu8Jpeg = NULL;
+	*pu32JpegSize = 0;
+
+	sInfo.err = jpeg_std_error(&sErr);
+	jpeg_create_compress(&sInfo);
+	jpeg_mem_dest(&sInfo, ppu8Jpeg, pu32JpegSize);
+
+	sInfo.image_width = u32Width;
+	sInfo.image_height = u32Height;
+	sInfo.input_components = psCase->components;
+	sInfo.in_color_space = (psCase->components == 1) ? JCS_GRAYSCALE : JCS_RGB;
+	jpeg_set_defaults(&sInfo);
+	jpeg_set_quality(&sInfo, 90, TRUE);
+	if(psCase->components == 3) {
+		sInfo.comp_info[0].h_samp_factor = psCase->h_samp;
+		sInfo.comp_info[0].v_samp_factor = psCase->v_samp;
+	}
+	jpeg_start_compress(&sInfo, TRUE);
+
+	while(sInfo.next_scanline < sInfo.image_height) {
+		for(x = 0; x < u32Width * psCase->components; x ++)
+			pu8Row[x] = ((x * 7) ^ (sInfo.next_scanline * (x % 3 + 1))) & 0xff;
+		jpeg_write_scanlines(&sInfo, &pu8Row, 1);
+	}
+
+	jpeg_finish_compress(&sInfo);
+	jpeg_destroy_compress(&sInfo);
+	free(pu8Row);
+	return 0;
+}
+
+static void emutest_free_planes(
+	struct emutest_planes *psPlanes
+)
+{
+	int c;
+
+	for(c = 0; c < TEST_MAX_COMPS; c ++) {
+		free(psPlanes->data[c]);
+		psPlanes->data[c] = NULL;
+	}
+}
+
+//Read raw data by emulator (bHW) or software, return 0 on success
+static int emutest_decode(
+	const unsigned char *pu8Jpeg,
+	unsigned long u32JpegSize,
+	boolean bHW,
+	struct emutest_planes *psPlanes
+)
+{
+	struct jpeg_decompress_struct sInfo;
+	struct jpeg_error_mgr sErr;
+	jpeg_decode_stats sStats;
+	JSAMPROW aapsRows[TEST_MAX_COMPS][TEST_MAX_ROWS];
+	JSAMPARRAY apsData[TEST_MAX_COMPS];
+	JDIMENSION u32Lines;
+	JDIMENSION u32iMCURow;
+	int i32Rows;
+	int c, j;
+
+	memset(psPlanes, 0, sizeof(struct emutest_planes));
+
+	sInfo.err = jpeg_std_error(&sErr);
+	jpeg_CreateDecompress_Ext(&sInfo, JPEG_LIB_VERSION, sizeof(struct jpeg_decompress_struct), bHW);
+	jpeg_mem_src(&sInfo, pu8Jpeg, u32JpegSize);
+	jpeg_read_header(&sInfo, TRUE);
+
+	sInfo.raw_data_out = TRUE;
+	jpeg_start_decompress(&sInfo);
+
+	jpeg_get_decode_stats(&sInfo, &sStats);
+	if(sStats.engine != (bHW ? JPEG_HW_ENGINE_HW : JPEG_HW_ENGINE_SW)) {
+		fprintf(stderr, "unexpected decode engine %d, fallback %d \n", sStats.engine, sStats.fallback);
+		jpeg_destroy_decompress(&sInfo);
+		return -1;
+	}
+
+	u32Lines = sInfo.max_v_samp_factor * DCTSIZE;
+	psPlanes->comps = sInfo.num_components;
+	for(c = 0; c < sInfo.num_components; c ++) {
+		jpeg_component_info *psComp = &sInfo.comp_info[c];
+
+		psPlanes->stride[c] = psComp->width_in_blocks * DCTSIZE;
+		psPlanes->width[c] = psComp->downsampled_width;
+		psPlanes->height[c] = psComp->downsampled_height;
+		psPlanes->data[c] = calloc(1, (size_t)psPlanes->stride[c] * sInfo.total_iMCU_rows * psComp->v_samp_factor * DCTSIZE);
+		if(psPlanes->data[c] == NULL) {
+			jpeg_destroy_decompress(&sInfo);
+			emutest_free_planes(psPlanes);
+			return -1;
+		}
+		apsData[c] = aapsRows[c];
+	}
+
+	while(sInfo.output_scanline < sInfo.output_height) {
+		u32iMCURow = sInfo.output_scanline / u32Lines;
+		for(c = 0; c < sInfo.num_components; c ++) {
+			i32Rows = sInfo.comp_info[c].v_samp_factor * DCTSIZE;
+			for(j = 0; j < i32Rows; j ++)
+				aapsRows[c][j] = psPlanes->data[c] + ((size_t)u32iMCURow * i32Rows + j) * psPlanes->stride[c];
+		}
+
+		if(jpeg_read_raw_data(&sInfo, apsData, u32Lines) == 0) {
+			fprintf(stderr, "jpeg_read_raw_data() returned no line \n");
+			jpeg_destroy_decompress(&sInfo);
+			emutest_free_planes(psPlanes);
+			return -1;
+		}
+	}
+
+	jpeg_finish_decompress(&sInfo);
+	jpeg_destroy_decompress(&sInfo);
+	return 0;
+}
+
+//Return 0 if planes are identical
+static int emutest_compare(
+	const struct emutest_planes *psHW,
+	const struct emutest_planes *psSW
+)
+{
+	uint32_t x, y;
+	int c;
+
+	if(psHW->comps != psSW->comps)
+		return -1;
+
+	for(c = 0; c < psSW->comps; c ++) {
+		for(y = 0; y < psSW->height[c]; y ++) {
+			const unsigned char *pu8HW = psHW->data[c] + (y * psHW->stride[c]);
+			const unsigned char *pu8SW = psSW->data[c] + (y * psSW->stride[c]);
+
+			for(x = 0; x < psSW->width[c]; x ++) {
+				if(pu8HW[x] != pu8SW[x]) {
+					printf("component %d (%u, %u): emu %u, sw %u \n", c, x, y, pu8HW[x], pu8SW[x]);
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct emutest_planes sHW;
+	struct emutest_planes sSW;
+	unsigned char *pu8Jpeg;
+	unsigned long u32JpegSize;
+	int i32Failed = 0;
+	int i32Ret;
+	int i, s;
+
+	if(jpeg_hw_set_backend("emu") != 0) {
+		fprintf(stderr, "emulator backend not available \n");
+		return -1;
+	}
+	jpeg_hw_set_dispatch(JPEG_HW_DISPATCH_HW);
+
+	for(i = 0; i < (int)(sizeof(s_asCase) / sizeof(s_asCase[0])); i ++) {
+		for(s = 0; s < (int)(sizeof(s_au32Size) / sizeof(s_au32Size[0])); s ++) {
+			if(emutest_encode(&s_asCase[i], s_au32Size[s][0], s_au32Size[s][1], &pu8Jpeg, &u32JpegSize) != 0) {
+				fprintf(stderr, "unable encode test image \n");
+				return -1;
+			}
+
+			i32Ret = emutest_decode(pu8Jpeg, u32JpegSize, TRUE, &sHW);
+			if(i32Ret == 0) {
+				i32Ret = emutest_decode(pu8Jpeg, u32JpegSize, FALSE, &sSW);
+				if(i32Ret == 0) {
+					i32Ret = emutest_compare(&sHW, &sSW);
+					emutest_free_planes(&sSW);
+				}
+				emutest_free_planes(&sHW);
+			}
+			free(pu8Jpeg);
+
+			printf("%s %ux%u: %s \n", s_asCase[i].name, s_au32Size[s][0], s_au32Size[s][1],
+				   (i32Ret == 0) ? "passed" : "FAILED");
+			if(i32Ret != 0)
+				i32Failed ++;
+		}
+	}
+
+	return i32Failed ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+
+using namespace std;
+
+#include "jpeglib.h"
+#include "jpeglib_ext.h"
+
+// Decode all JPEG files given in command line from one thread. Hardware decode
+// jobs are submitted together, completions are collected by epoll.
+
+static double getTimeSec(void)
+{
+  struct timeval tv;
+
+  if (gettimeofday(&tv, NULL) < 0)
+	return 0.0;
+  else
+	return (double)(tv.tv_sec ) + ((double)(tv.tv_usec / 1000000.));
+}
+
+typedef struct
+{
+	string strFileName;
+	unsigned char *pu8JpegBuf;
+	long i32JpegSize;
+	struct jpeg_decompress_struct sInfo;
+	struct jpeg_error_mgr sErr;
+	unsigned char *pu8RGBBuf;
+	int i32DoneFd;
+	double dStartTime;
+}S_ASYNC_JOB;
+
+static int ReadJpegFile(S_ASYNC_JOB *psJob)
+{
+	ifstream jpegFile(psJob->strFileName, ios::binary);
+
+	if (!jpegFile.is_open())
+		return -1;
+
+	jpegFile.seekg (0, ios::end);
+	psJob->i32JpegSize = jpegFile.tellg();
+	jpegFile.seekg (0, ios::beg);
+
+	psJob->pu8JpegBuf = new unsigned char[psJob->i32JpegSize];
+	jpegFile.read((char *)psJob->pu8JpegBuf, psJob->i32JpegSize);
+	return 0;
+}
+
+static void ReadScanlines(S_ASYNC_JOB *psJob)
+{
+	struct jpeg_decompress_struct *psInfo = &psJob->sInfo;
+	int i32RowBytes = psInfo->output_width * psInfo->output_components;
+
+	psJob->pu8RGBBuf = new unsigned char[i32RowBytes * psInfo->output_height];
+
+	while (psInfo->output_scanline < psInfo->output_height) {
+		JSAMPROW row = psJob->pu8RGBBuf + psInfo->output_scanline * i32RowBytes;
+		jpeg_read_scanlines(psInfo, &row, 1);
+	}
+
+	jpeg_finish_decompress(psInfo);
+
+	cout << psJob->strFileName << ": " << psInfo->output_width << "x" << psInfo->output_height
+		 << " done in " << (getTimeSec() - psJob->dStartTime) * 1000 << " ms" << endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	vector<S_ASYNC_JOB *> vJobs;
+	int i32EpollFd;
+	int i32Pending = 0;
+	int i32FirstFile = 1;
+	int i;
+
+	if ((argc > 2) && (strcmp(argv[1], "-p") == 0)) {
+		//share hardware session between same size images, decode them back to back
+		jpeg_hw_set_pipeline_depth(atoi(argv[2]));
+		i32FirstFile = 3;
+	}
+
+	if (argc < i32FirstFile + 1) {
+			cerr << "AsyncDecode [-p pipeline depth] <jpeg file> [jpeg file ...] \n";
+			return -1;
+	}
+
+	i32EpollFd = epoll_create1(0);
+	if (i32EpollFd < 0) {
+		cerr << "Unable create epoll" << endl;
+		return -2;
+	}
+
+	double dStartTime = getTimeSec();
+
+	for (i = i32FirstFile; i < argc; i ++) {
+		S_ASYNC_JOB *psJob = new S_ASYNC_JOB;
+
+		psJob->strFileName = argv[i];
+		psJob->pu8RGBBuf = NULL;
+		if (ReadJpegFile(psJob) != 0) {
+			cerr << "Unable open jpeg file " << psJob->strFileName << endl;
+			delete psJob;
+			continue;
+		}
+
+		psJob->sInfo.err = jpeg_std_error(&psJob->sErr);
+		jpeg_create_decompress(&psJob->sInfo);
+		jpeg_mem_src(&psJob->sInfo, psJob->pu8JpegBuf, psJob->i32JpegSize);
+		jpeg_read_header(&psJob->sInfo, TRUE);
+		psJob->sInfo.out_color_space = JCS_EXT_BGRA;
+
+		psJob->dStartTime = getTimeSec();
+		psJob->i32DoneFd = jpeg_start_decompress_async(&psJob->sInfo);
+		vJobs.push_back(psJob);
+
+		if (psJob->i32DoneFd < 0) {
+			//software decode, scanlines are ready right now
+			ReadScanlines(psJob);
+			continue;
+		}
+
+		struct epoll_event sEvent;
+		sEvent.events = EPOLLIN;
+		sEvent.data.ptr = psJob;
+		epoll_ctl(i32EpollFd, EPOLL_CTL_ADD, psJob->i32DoneFd, &sEvent);
+		i32Pending ++;
+	}
+
+	while (i32Pending > 0) {
+		struct epoll_event asEvents[8];
+		int n = epoll_wait(i32EpollFd, asEvents, 8, -1);
+
+		for (i = 0; i < n; i ++) {
+			S_ASYNC_JOB *psJob = (S_ASYNC_JOB *)asEvents[i].data.ptr;
+
+			if (!jpeg_decompress_poll(&psJob->sInfo))
+				continue;
+
+			epoll_ctl(i32EpollFd, EPOLL_CTL_DEL, psJob->i32DoneFd, NULL);
+			ReadScanlines(psJob);
+			i32Pending --;
+		}
+	}
+
+	cout << "Total " << vJobs.size() << " images in " << (getTimeSec() - dStartTime) * 1000 << " ms" << endl;
+
+	for (i = 0; i < (int)vJobs.size(); i ++) {
+		jpeg_destroy_decompress(&vJobs[i]->sInfo);
+		delete [] vJobs[i]->pu8JpegBuf;
+		delete [] vJobs[i]->pu8RGBBuf;
+		delete vJobs[i];
+	}
+
+	close(i32EpollFd);
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+#include "turbojpeg_ext.h"
+
+// Decode all JPEG files given in command line as one batch. Large images are
+// decoded by VC8000, the others by CPU workers at the same time.
+
+static const char *engineName[] = { "failed", "VC8000", "CPU" };
+
+static int ReadJpegFile(const string &strFileName, vector<unsigned char> &vJpeg)
+{
+	ifstream jpegFile(strFileName, ios::binary);
+
+	if (!jpegFile.is_open())
+		return -1;
+
+	jpegFile.seekg (0, ios::end);
+	vJpeg.resize(jpegFile.tellg());
+	jpegFile.seekg (0, ios::beg);
+
+	jpegFile.read((char *)vJpeg.data(), vJpeg.size());
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+
+	vector<string> vFileNames;
+	vector<vector<unsigned char> > vJpegs;
+	vector<tjbatchjob> vJobs;
+	tjbatchstats sStats;
+	tjhandle tjInstance;
+	int i32Threads = 0;
+	int i32FirstFile = 1;
+	int i;
+
+	if ((argc > 2) && (strcmp(argv[1], "-t") == 0)) {
+		i32Threads = atoi(argv[2]);
+		i32FirstFile = 3;
+	}
+
+	if (argc < i32FirstFile + 1) {
+		cerr << "TJBatchDecode [-t cpu workers] <jpeg file> [jpeg file ...] \n";
+		return -1;
+	}
+
+	tjInstance = tjInitDecompress();
+	if (tjInstance == NULL) {
+		cerr << "Unable init TurboJPEG" << endl;
+		return -2;
+	}
+
+	for (i = i32FirstFile; i < argc; i ++) {
+		vector<unsigned char> vJpeg;
+
+		if (ReadJpegFile(argv[i], vJpeg) != 0) {
+			cerr << "Unable open jpeg file " << argv[i] << endl;
+			continue;
+		}
+
+		vFileNames.push_back(argv[i]);
+		vJpegs.push_back(vJpeg);
+	}
+
+	vJobs.resize(vJpegs.size());
+
+	for (i = 0; i < (int)vJpegs.size(); i ++) {
+		tjbatchjob *psJob = &vJobs[i];
+		int width, height, subsamp, colorspace;
+
+		memset(psJob, 0, sizeof(tjbatchjob));
+		psJob->jpegBuf = vJpegs[i].data();
+		psJob->jpegSize = vJpegs[i].size();
+		psJob->pixelFormat = TJPF_BGRA;
+
+		if (tjDecompressHeader3(tjInstance, psJob->jpegBuf, psJob->jpegSize, &width, &height, &subsamp, &colorspace) < 0) {
+			cerr << vFileNames[i] << ": " << tjGetErrorStr2(tjInstance) << endl;
+			continue;
+		}
+
+		psJob->dstBuf = (unsigned char *)tjAlloc(width * height * tjPixelSize[TJPF_BGRA]);
+	}
+
+	if (tjDecompressBatch(vJobs.data(), vJobs.size(), i32Threads, &sStats) != 0)
+		cerr << "Some images failed" << endl;
+
+	for (i = 0; i < (int)vJobs.size(); i ++)
+		cout << vFileNames[i] << ": " << engineName[vJobs[i].engine] << endl;
+
+	cout << "Total " << vJobs.size() << " images in " << sStats.elapsed * 1000 << " ms" << endl;
+	cout << "VC8000: " << sStats.hwJobs << " images, utilization " << sStats.hwUtilization * 100 << " %" << endl;
+	cout << "CPU x " << sStats.swThreads << ": " << sStats.swJobs << " images, utilization " << sStats.swUtilization * 100 << " %" << endl;
+	cout << "Stolen " << sStats.stolenJobs << ", failed " << sStats.failedJobs << endl;
+
+	for (i = 0; i < (int)vJobs.size(); i ++)
+		tjFree(vJobs[i].dstBuf);
+
+	tjDestroy(tjInstance);
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include <string.h>
+#include <inttypes.h>
+
+using namespace std;
+
+#include "vc8000_trace.h"
+
+// Convert trace file written by jpeg_hw_trace_dump() or VC8000_TRACE_FILE to
+// Chrome trace JSON. Open the output in chrome://tracing or ui.perfetto.dev.
+
+static const char *eventName[eVC8000_TRACE_EVENT_CNT] = {
+	"QBUF OUTPUT",
+	"QBUF CAPTURE",
+	"DQBUF OUTPUT",
+	"DQBUF CAPTURE",
+	"poll",
+	"STREAMON",
+	"STREAMOFF",
+	"mmap",
+	"munmap",
+	"lock wait",
+};
+
+int main(int argc, char* argv[]) {
+
+	struct vc8000_trace_file_header sHeader;
+	struct vc8000_trace_record sRecord;
+	vector<char> vRecord;
+	ostream *pOut = &cout;
+	ofstream jsonFile;
+	int i32Cnt = 0;
+
+	if (argc < 2) {
+		cerr << "VC8000TraceDump <trace file> [json file] \n";
+		return -1;
+	}
+
+	ifstream traceFile(argv[1], ios::binary);
+
+	if (!traceFile.is_open()) {
+		cerr << "Unable open trace file " << argv[1] << endl;
+		return -2;
+	}
+
+	traceFile.read((char *)&sHeader, sizeof(sHeader));
+	if (!traceFile || (memcmp(sHeader.magic, VC8000_TRACE_FILE_MAGIC, sizeof(sHeader.magic)) != 0) ||
+	    (sHeader.record_size < sizeof(sRecord))) {
+		cerr << argv[1] << " is not a VC8000 trace file" << endl;
+		return -3;
+	}
+
+	if (argc > 2) {
+		jsonFile.open(argv[2]);
+		if (!jsonFile.is_open()) {
+			cerr << "Unable open json file " << argv[2] << endl;
+			return -4;
+		}
+		pOut = &jsonFile;
+	}
+
+	//newer library may append fields to record
+	vRecord.resize(sHeader.record_size);
+
+	*pOut << "{\"traceEvents\":[\n";
+
+	while (traceFile.read(vRecord.data(), vRecord.size())) {
+		char achLine[256];
+
+		memcpy(&sRecord, vRecord.data(), sizeof(sRecord));
+
+		if (sRecord.event >= eVC8000_TRACE_EVENT_CNT)
+			continue;
+
+		//Chrome trace time unit is us
+		if (sRecord.dur_ns)
+			snprintf(achLine, sizeof(achLine),
+				"{\"name\":\"%s\",\"cat\":\"vc8000\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"fd\":%d,\"arg\":%d}}",
+				eventName[sRecord.event], sRecord.ts_ns / 1000.0, sRecord.dur_ns / 1000.0,
+				sHeader.pid, sRecord.tid, sRecord.fd, sRecord.arg);
+		else
+			snprintf(achLine, sizeof(achLine),
+				"{\"name\":\"%s\",\"cat\":\"vc8000\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"fd\":%d,\"arg\":%d}}",
+				eventName[sRecord.event], sRecord.ts_ns / 1000.0,
+				sHeader.pid, sRecord.tid, sRecord.fd, sRecord.arg);
+
+		*pOut << (i32Cnt ? ",\n" : "") << achLine;
+		i32Cnt ++;
+	}
+
+	*pOut << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+	cerr << "Converted " << i32Cnt << " events" << endl;
+	return 0;
+}